@@ -0,0 +1,554 @@
+#define _POSIX_C_SOURCE 200809L
+#define LIBFRAMES_DLE 0x7d
+#define LIBFRAMES_XOR 0x20
+#define LIBFRAMES_LIM 0x7e
+#define LIBFRAMES_TX_BUF_SZ 512
+#include "libframes.c"
+#include "libframes_txq.c"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "error.h"
+
+#ifdef LIBFRAMES_SPSC
+#include "libframes_capture.c"
+#include "libframes_pool.c"
+#endif
+
+#ifdef __linux__
+#include "libframes_epoll.c"
+
+#include <signal.h>
+#include <sys/socket.h>
+#endif
+
+// Frames are decoded into buffers of this size, so it bounds the payload.
+#define BENCH_MAX_FRAME_SZ 1024
+// Each measurement repeats its workload for at least this long.
+#define BENCH_MIN_NS 50000000ull
+// How much encoded data the read benchmarks push through the rx ring.
+#define BENCH_STREAM_SZ (1 << 20)
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// A write_platform that throws everything away, but keeps the compiler from
+// throwing the encoding away.
+static volatile uint32_t sunk;
+
+static void sink(void *user, void *p, uint32_t sz) {
+    sunk += sz + ((uint8_t *)p)[sz - 1];
+}
+
+// Whether the codec benchmarks use COBS instead of DLE/XOR escaping.
+static int bench_cobs;
+
+// Fill a payload where escape_pct percent of the bytes need escaping: DLEs
+// and LIMs, or with COBS, zeros. The other bytes are none of these.
+static void fill_payload(uint8_t *p, uint32_t sz, uint32_t escape_pct) {
+    for (uint32_t i = 0; i < sz; i++) {
+        if ((uint32_t)(rand() % 100) < escape_pct) {
+            p[i] = bench_cobs ? 0 : rand() % 2 ? LIBFRAMES_DLE : LIBFRAMES_LIM;
+        } else {
+            do {
+                p[i] = rand();
+            } while (p[i] == 0 || p[i] == LIBFRAMES_DLE || p[i] == LIBFRAMES_LIM);
+        }
+    }
+}
+
+// The name of a codec benchmark, with COBS ones set apart.
+static const char *bench_op(const char *op) {
+    static char name[32];
+    snprintf(name, sizeof(name), "%s%s", op, bench_cobs ? "_cobs" : "");
+    return name;
+}
+
+static uint32_t bench_encode_frame(const void *p, uint32_t sz, void *out, uint32_t out_sz) {
+    return bench_cobs ? libframes_cobs_encode(p, sz, out, out_sz) : libframes_encode(p, sz, out, out_sz);
+}
+
+// One line of results; the columns are in the header printed by main.
+static void report(const char *op, uint32_t payload_sz, uint32_t escape_pct, uint32_t chunk_sz, uint32_t fill_pct,
+        uint32_t links, uint64_t frames, uint64_t ns) {
+    double s = ns / 1e9;
+    printf("%s,%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu64 ",%" PRIu64 ",%.1f,%.0f,%.1f\n",
+        op, payload_sz, escape_pct, chunk_sz, fill_pct, links, frames, ns,
+        frames * payload_sz / s / 1e6, frames / s, (double)ns / frames);
+}
+
+// libframes_write_begin/write/end into a sink.
+static void bench_write(uint32_t payload_sz, uint32_t escape_pct) {
+    static libframes_ctx_t ctx;
+    static char rx_ring[2 * BENCH_MAX_FRAME_SZ + 2];
+    static char frame_buffer[BENCH_MAX_FRAME_SZ];
+    EXPECT(libframes_init(&ctx, sink, NULL, rx_ring, sizeof(rx_ring), frame_buffer, sizeof(frame_buffer)), 0);
+    libframes_set_cobs(&ctx, bench_cobs);
+    uint8_t payload[BENCH_MAX_FRAME_SZ];
+    fill_payload(payload, payload_sz, escape_pct);
+
+    uint64_t frames = 0;
+    uint64_t start = now_ns();
+    uint64_t ns;
+    do {
+        for (int i = 0; i < 100; i++) {
+            libframes_write_begin(&ctx);
+            libframes_write(&ctx, payload, payload_sz);
+            libframes_write_end(&ctx);
+        }
+        frames += 100;
+    } while ((ns = now_ns() - start) < BENCH_MIN_NS);
+    report(bench_op("write"), payload_sz, escape_pct, 0, 0, 1, frames, ns);
+}
+
+// A writev_platform that throws everything away, like sink.
+static void sink_v(void *user, const libframes_iovec_t *iov, int iov_n) {
+    for (int i = 0; i < iov_n; i++) {
+        sunk += iov[i].sz + ((const uint8_t *)iov[i].p)[iov[i].sz - 1];
+    }
+}
+
+// libframes_write_frame of a header, the payload and a trailer into a sink,
+// or a writev sink. The header and trailer need no escaping.
+static void bench_write_frame(uint32_t payload_sz, uint32_t escape_pct, int writev) {
+    static libframes_ctx_t ctx;
+    static char rx_ring[2 * BENCH_MAX_FRAME_SZ + 2];
+    static char frame_buffer[BENCH_MAX_FRAME_SZ];
+    EXPECT(libframes_init(&ctx, sink, NULL, rx_ring, sizeof(rx_ring), frame_buffer, sizeof(frame_buffer)), 0);
+    libframes_set_cobs(&ctx, bench_cobs);
+    libframes_set_writev(&ctx, writev ? sink_v : NULL);
+    uint8_t payload[BENCH_MAX_FRAME_SZ];
+    fill_payload(payload, payload_sz, escape_pct);
+    uint8_t header[8] = "header";
+    uint8_t trailer[4] = "end";
+    libframes_iovec_t iov[] = {{header, sizeof(header)}, {payload, payload_sz}, {trailer, sizeof(trailer)}};
+
+    uint64_t frames = 0;
+    uint64_t start = now_ns();
+    uint64_t ns;
+    do {
+        for (int i = 0; i < 100; i++) {
+            libframes_write_frame(&ctx, iov, 3);
+        }
+        frames += 100;
+    } while ((ns = now_ns() - start) < BENCH_MIN_NS);
+    report(bench_op(writev ? "write_frame_v" : "write_frame"), payload_sz, escape_pct, 0, 0, 1, frames, ns);
+}
+
+static uint64_t bench_clock(void *user) {
+    return now_ns();
+}
+
+// Frames queued, alternately, in a control queue and a bulk queue of a
+// libframes_txq, and drained into a sink; so encoding and scheduling both.
+static void bench_txq(uint32_t payload_sz, uint32_t escape_pct) {
+    static libframes_ctx_t ctx;
+    static char rx_ring[2 * BENCH_MAX_FRAME_SZ + 2];
+    static char frame_buffer[BENCH_MAX_FRAME_SZ];
+    EXPECT(libframes_init(&ctx, sink, NULL, rx_ring, sizeof(rx_ring), frame_buffer, sizeof(frame_buffer)), 0);
+    libframes_set_cobs(&ctx, bench_cobs);
+    static libframes_txq_queue_t queues[2];
+    static uint8_t bufs[2][64 * (LIBFRAMES_ENCODED_MAX_SZ(BENCH_MAX_FRAME_SZ) + 16)];
+    for (int q = 0; q < 2; q++) {
+        libframes_txq_queue_init(&queues[q], bufs[q], sizeof(bufs[q]));
+    }
+    libframes_txq_t txq;
+    libframes_txq_init(&txq, &ctx, queues, 2, bench_clock, NULL);
+    uint8_t payload[BENCH_MAX_FRAME_SZ];
+    fill_payload(payload, payload_sz, escape_pct);
+
+    uint64_t frames = 0;
+    uint64_t start = now_ns();
+    uint64_t ns;
+    do {
+        for (int i = 0; i < 100; i++) {
+            EXPECT(libframes_txq_push(&txq, i & 1, payload, payload_sz), 0);
+        }
+        libframes_txq_drain(&txq, UINT32_MAX);
+        frames += 100;
+    } while ((ns = now_ns() - start) < BENCH_MIN_NS);
+    EXPECT(ctx.stats.write_frame_count, frames);
+    report(bench_op("txq"), payload_sz, escape_pct, 0, 0, 1, frames, ns);
+}
+
+// libframes_encode (or libframes_cobs_encode) into a buffer.
+static void bench_encode(uint32_t payload_sz, uint32_t escape_pct) {
+    uint8_t payload[BENCH_MAX_FRAME_SZ];
+    static uint8_t encoded[LIBFRAMES_ENCODED_MAX_SZ(BENCH_MAX_FRAME_SZ)];
+    fill_payload(payload, payload_sz, escape_pct);
+
+    uint64_t frames = 0;
+    uint64_t start = now_ns();
+    uint64_t ns;
+    do {
+        for (int i = 0; i < 100; i++) {
+            sunk += bench_encode_frame(payload, payload_sz, encoded, sizeof(encoded));
+        }
+        frames += 100;
+    } while ((ns = now_ns() - start) < BENCH_MIN_NS);
+    report(bench_op("encode"), payload_sz, escape_pct, 0, 0, 1, frames, ns);
+}
+
+// Where each frame of a stream starts, and where the last one ends.
+static uint32_t stream_offs[BENCH_STREAM_SZ / 4 + 1];
+
+// Encode frames back to back into stream, as many as fit. Returns the number
+// of frames; *stream_sz is set to the bytes used.
+static uint32_t make_stream(uint8_t *stream, uint32_t *stream_sz, uint32_t payload_sz, uint32_t escape_pct) {
+    uint32_t frames = 0;
+    uint32_t off = 0;
+    for (;;) {
+        stream_offs[frames] = off;
+        uint8_t payload[BENCH_MAX_FRAME_SZ];
+        fill_payload(payload, payload_sz, escape_pct);
+        uint32_t sz = bench_encode_frame(payload, payload_sz, &stream[off], *stream_sz - off);
+        if (sz == 0) {
+            break;
+        }
+        off += sz;
+        frames++;
+    }
+    *stream_sz = off;
+    return frames;
+}
+
+// Feed a stream of frames through libframes_inject_rx_ring in chunk_sz
+// pieces, draining the ring with libframes_read_begin/peek/end whenever it is
+// fill_pct full.
+static void bench_read(uint32_t payload_sz, uint32_t escape_pct, uint32_t chunk_sz, uint32_t fill_pct) {
+    static libframes_ctx_t ctx;
+    static char rx_ring[8 * LIBFRAMES_ENCODED_MAX_SZ(BENCH_MAX_FRAME_SZ)];
+    static char frame_buffer[BENCH_MAX_FRAME_SZ];
+    EXPECT(libframes_init(&ctx, sink, NULL, rx_ring, sizeof(rx_ring), frame_buffer, sizeof(frame_buffer)), 0);
+    libframes_set_cobs(&ctx, bench_cobs);
+    static uint8_t stream[BENCH_STREAM_SZ];
+    uint32_t stream_sz = sizeof(stream);
+    uint32_t stream_frames = make_stream(stream, &stream_sz, payload_sz, escape_pct);
+    uint32_t fill_sz = (uint64_t)sizeof(rx_ring) * fill_pct / 100;
+
+    uint64_t frames = 0;
+    uint64_t start = now_ns();
+    uint64_t ns;
+    do {
+        uint32_t off = 0;
+        while (off < stream_sz) {
+            // Fill the ring up to the fill level, or until it's full. Always
+            // add something, or a frame bigger than the fill level would
+            // never complete.
+            do {
+                uint32_t sz = stream_sz - off < chunk_sz ? stream_sz - off : chunk_sz;
+                uint32_t accepted = libframes_inject_rx_ring(&ctx, &stream[off], sz);
+                off += accepted;
+                if (accepted < sz) {
+                    break;
+                }
+            } while (off < stream_sz && rx_ring_unread(&ctx) < fill_sz);
+            // Drain it.
+            uint32_t frame_sz;
+            while (libframes_read_begin(&ctx, &frame_sz) == 0) {
+                const void *p;
+                libframes_read_peek(&ctx, &p, &frame_sz);
+                libframes_read_end(&ctx);
+            }
+        }
+        frames += stream_frames;
+    } while ((ns = now_ns() - start) < BENCH_MIN_NS);
+    EXPECT(ctx.stats.rx_frame_count, frames);
+    report(bench_op("read"), payload_sz, escape_pct, chunk_sz, fill_pct, 1, frames, ns);
+}
+
+// libframes_feed, in chunk_sz pieces. There's no ring to fill, so fill_pct
+// doesn't apply.
+static void on_frame(void *user, const void *frame, uint32_t sz) {
+    sunk += sz;
+}
+
+static void bench_feed(uint32_t payload_sz, uint32_t escape_pct, uint32_t chunk_sz) {
+    static libframes_ctx_t ctx;
+    static char rx_ring[2 * BENCH_MAX_FRAME_SZ + 2];
+    static char frame_buffer[BENCH_MAX_FRAME_SZ];
+    EXPECT(libframes_init(&ctx, sink, NULL, rx_ring, sizeof(rx_ring), frame_buffer, sizeof(frame_buffer)), 0);
+    libframes_set_cobs(&ctx, bench_cobs);
+    static uint8_t stream[BENCH_STREAM_SZ];
+    uint32_t stream_sz = sizeof(stream);
+    uint32_t stream_frames = make_stream(stream, &stream_sz, payload_sz, escape_pct);
+
+    uint64_t frames = 0;
+    uint64_t start = now_ns();
+    uint64_t ns;
+    do {
+        for (uint32_t off = 0; off < stream_sz; off += chunk_sz) {
+            uint32_t sz = stream_sz - off < chunk_sz ? stream_sz - off : chunk_sz;
+            libframes_feed(&ctx, &stream[off], sz, on_frame, NULL);
+        }
+        frames += stream_frames;
+    } while ((ns = now_ns() - start) < BENCH_MIN_NS);
+    EXPECT(ctx.stats.rx_frame_count, frames);
+    report(bench_op("feed"), payload_sz, escape_pct, chunk_sz, 0, 1, frames, ns);
+}
+
+// libframes_decode (or libframes_cobs_decode), frame by frame out of a
+// stream.
+static void bench_decode(uint32_t payload_sz, uint32_t escape_pct) {
+    static uint8_t stream[BENCH_STREAM_SZ];
+    uint32_t stream_sz = sizeof(stream);
+    uint32_t stream_frames = make_stream(stream, &stream_sz, payload_sz, escape_pct);
+
+    uint64_t frames = 0;
+    uint64_t start = now_ns();
+    uint64_t ns;
+    do {
+        for (uint32_t i = 0; i < stream_frames; i++) {
+            uint8_t decoded[BENCH_MAX_FRAME_SZ];
+            uint32_t frame_sz;
+            const uint8_t *frame = &stream[stream_offs[i]];
+            uint32_t sz = stream_offs[i + 1] - stream_offs[i];
+            EXPECT(bench_cobs ? libframes_cobs_decode(frame, sz, decoded, sizeof(decoded), &frame_sz)
+                : libframes_decode(frame, sz, decoded, sizeof(decoded), &frame_sz), 0);
+        }
+        frames += stream_frames;
+    } while ((ns = now_ns() - start) < BENCH_MIN_NS);
+    report(bench_op("decode"), payload_sz, escape_pct, 0, 0, 1, frames, ns);
+}
+
+#ifdef __linux__
+// How many frames each link of the epoll benchmark keeps in flight.
+#define BENCH_EPOLL_WINDOW 8
+
+// A link of the epoll benchmark. It answers every frame it receives with a
+// frame of its own.
+typedef struct {
+    libframes_epoll_link_t link;
+    libframes_epoll_t *ep;
+    uint32_t payload_sz;
+    char rx_ring[2 * LIBFRAMES_ENCODED_MAX_SZ(BENCH_MAX_FRAME_SZ)];
+    char frame_buffer[BENCH_MAX_FRAME_SZ];
+    char tx_queue[(BENCH_EPOLL_WINDOW + 1) * LIBFRAMES_ENCODED_MAX_SZ(BENCH_MAX_FRAME_SZ)];
+} bench_link_t;
+
+static void bench_on_frame(void *user, const void *frame, uint32_t sz) {
+    bench_link_t *l = user;
+    EXPECT(frame != NULL, 1);
+    EXPECT(libframes_epoll_send(l->ep, &l->link, frame, sz), 0);
+}
+
+// links_n links, in pairs over socketpairs, all in one libframes_epoll loop,
+// bouncing frames back and forth.
+static void bench_epoll(uint32_t payload_sz, uint32_t links_n) {
+    bench_link_t *links = malloc(links_n * sizeof(*links));
+    int *fds = malloc(links_n * sizeof(*fds));
+    libframes_epoll_t ep;
+    EXPECT(libframes_epoll_init(&ep), 0);
+    for (uint32_t i = 0; i < links_n; i += 2) {
+        EXPECT(socketpair(AF_UNIX, SOCK_STREAM, 0, &fds[i]), 0);
+        for (uint32_t j = i; j < i + 2; j++) {
+            bench_link_t *l = &links[j];
+            l->ep = &ep;
+            l->payload_sz = payload_sz;
+            EXPECT(libframes_epoll_add(&ep, &l->link, fds[j], bench_on_frame, l,
+                l->rx_ring, sizeof(l->rx_ring), l->frame_buffer, sizeof(l->frame_buffer),
+                l->tx_queue, sizeof(l->tx_queue)), 0);
+        }
+    }
+    uint8_t payload[BENCH_MAX_FRAME_SZ];
+    fill_payload(payload, payload_sz, 1);
+    for (uint32_t i = 0; i < links_n; i++) {
+        for (int j = 0; j < BENCH_EPOLL_WINDOW; j++) {
+            EXPECT(libframes_epoll_send(&ep, &links[i].link, payload, payload_sz), 0);
+        }
+    }
+
+    uint64_t frames = 0;
+    uint64_t start = now_ns();
+    uint64_t ns;
+    do {
+        int n = libframes_epoll_run(&ep, 1000);
+        EXPECT_NOT(n, -1);
+        frames += n;
+    } while ((ns = now_ns() - start) < BENCH_MIN_NS);
+    report("epoll", payload_sz, 1, 0, 0, links_n, frames, ns);
+
+    for (uint32_t i = 0; i < links_n; i++) {
+        close(fds[i]);
+    }
+    libframes_epoll_close(&ep);
+    free(fds);
+    free(links);
+}
+#endif
+
+#ifdef LIBFRAMES_SPSC
+#define BENCH_POOL_LINKS 256
+
+// A link of the pool benchmark: it sends every frame it receives back to
+// itself.
+typedef struct {
+    libframes_ctx_t ctx;
+    libframes_pool_link_t link;
+    libframes_pool_t *pool;
+    char rx_ring[4 * LIBFRAMES_ENCODED_MAX_SZ(BENCH_MAX_FRAME_SZ)];
+    char frame_buffer[BENCH_MAX_FRAME_SZ];
+} bench_pool_link_t;
+
+static void bench_pool_loopback(void *user, void *p, uint32_t sz) {
+    bench_pool_link_t *l = user;
+    EXPECT(libframes_inject_rx_ring(&l->ctx, p, sz), sz);
+    if (l->pool) {
+        libframes_pool_notify(l->pool, &l->link);
+    }
+}
+
+static void bench_pool_on_frame(void *user, const void *frame, uint32_t sz) {
+    bench_pool_link_t *l = user;
+    libframes_write_begin(&l->ctx);
+    libframes_write(&l->ctx, (void *)frame, sz);
+    libframes_write_end(&l->ctx);
+}
+
+// BENCH_POOL_LINKS links looping frames back to themselves, two each in
+// flight, on workers_n workers.
+static void bench_pool(uint32_t payload_sz, int workers_n) {
+    static bench_pool_link_t links[BENCH_POOL_LINKS];
+    static libframes_pool_link_t *queues[64 * BENCH_POOL_LINKS];
+    libframes_pool_worker_t workers[64];
+    libframes_pool_t pool;
+    EXPECT(libframes_pool_init(&pool, workers, workers_n, queues, BENCH_POOL_LINKS), 0);
+    uint8_t payload[BENCH_MAX_FRAME_SZ];
+    fill_payload(payload, payload_sz, 1);
+    for (int i = 0; i < BENCH_POOL_LINKS; i++) {
+        bench_pool_link_t *l = &links[i];
+        l->pool = NULL;
+        EXPECT(libframes_init(&l->ctx, bench_pool_loopback, l, l->rx_ring, sizeof(l->rx_ring), l->frame_buffer, sizeof(l->frame_buffer)), 0);
+        EXPECT(libframes_pool_add(&pool, &l->link, &l->ctx, bench_pool_on_frame, l), 0);
+        for (int j = 0; j < 2; j++) {
+            libframes_write_begin(&l->ctx);
+            libframes_write(&l->ctx, payload, payload_sz);
+            libframes_write_end(&l->ctx);
+        }
+    }
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < BENCH_POOL_LINKS; i++) {
+        links[i].pool = &pool;
+        libframes_pool_notify(&pool, &links[i].link);
+    }
+    struct timespec ts = {0, BENCH_MIN_NS};
+    nanosleep(&ts, NULL);
+    libframes_pool_stop(&pool);
+    uint64_t ns = now_ns() - start;
+    libframes_pool_destroy(&pool);
+
+    uint64_t frames = 0;
+    for (int i = 0; i < workers_n; i++) {
+        frames += workers[i].frame_count;
+    }
+    report("pool", payload_sz, 1, 0, 0, workers_n, frames, ns);
+}
+
+static void bench_replay_on_frame(void *user, uint64_t n, uint64_t ts_ns, const void *frame, uint32_t sz) {
+    sunk += sz;
+}
+
+// A capture of a stream of frames, replayed from its mapping on threads_n
+// threads.
+static void bench_replay(uint32_t payload_sz, uint32_t escape_pct, int threads_n) {
+    char path[] = "/tmp/libframes_bench_XXXXXX";
+    int fd = mkstemp(path);
+    EXPECT_NOT(fd, -1);
+    close(fd);
+    static uint8_t stream[BENCH_STREAM_SZ];
+    uint32_t stream_sz = sizeof(stream);
+    uint32_t stream_frames = make_stream(stream, &stream_sz, payload_sz, escape_pct);
+    libframes_capture_writer_t w;
+    EXPECT(libframes_capture_create(&w, path, bench_cobs ? LIBFRAMES_CAPTURE_COBS : 0), 0);
+    for (uint32_t i = 0; i < stream_frames; i++) {
+        EXPECT(libframes_capture_append(&w, i, &stream[stream_offs[i]], stream_offs[i + 1] - stream_offs[i]), 0);
+    }
+    EXPECT(libframes_capture_finish(&w), 0);
+    libframes_capture_t cap;
+    EXPECT(libframes_capture_open(&cap, path), 0);
+
+    uint64_t frames = 0;
+    uint64_t start = now_ns();
+    uint64_t ns;
+    do {
+        EXPECT(libframes_capture_replay_parallel(&cap, threads_n, BENCH_MAX_FRAME_SZ, bench_replay_on_frame, NULL),
+                stream_frames);
+        frames += stream_frames;
+    } while ((ns = now_ns() - start) < BENCH_MIN_NS);
+    report(bench_op("replay"), payload_sz, escape_pct, 0, 0, threads_n, frames, ns);
+
+    libframes_capture_close(&cap);
+    unlink(path);
+    strcat(path, ".idx");
+    unlink(path);
+}
+#endif
+
+int main(void) {
+    uint32_t payload_szs[] = {16, 128, 1000};
+    uint32_t escape_pcts[] = {0, 1, 50, 100};
+    uint32_t chunk_szs[] = {1, 64, 512};
+    uint32_t fill_pcts[] = {10, 100};
+
+    srand(1);
+    puts("op,payload_sz,escape_pct,chunk_sz,fill_pct,links,frames,ns,mb_per_s,frames_per_s,ns_per_frame");
+
+#ifdef LIBFRAMES_SPSC
+    // Built for threads, only the worker pool and capture replay are
+    // measured; the links column is the number of threads.
+    int workers_ns[] = {1, 2, 4, 8};
+    for (size_t i = 0; i < sizeof(payload_szs) / sizeof(payload_szs[0]); i++) {
+        for (size_t j = 0; j < sizeof(workers_ns) / sizeof(workers_ns[0]); j++) {
+            bench_pool(payload_szs[i], workers_ns[j]);
+        }
+    }
+    for (bench_cobs = 0; bench_cobs < 2; bench_cobs++) {
+        for (size_t i = 0; i < sizeof(payload_szs) / sizeof(payload_szs[0]); i++) {
+            for (size_t j = 0; j < sizeof(workers_ns) / sizeof(workers_ns[0]); j++) {
+                bench_replay(payload_szs[i], 1, workers_ns[j]);
+            }
+        }
+    }
+    return 0;
+#endif
+
+    // The codec, both ways; for COBS, escape_pct is the share of zeros.
+    for (bench_cobs = 0; bench_cobs < 2; bench_cobs++) {
+        for (size_t i = 0; i < sizeof(payload_szs) / sizeof(payload_szs[0]); i++) {
+            for (size_t j = 0; j < sizeof(escape_pcts) / sizeof(escape_pcts[0]); j++) {
+                bench_write(payload_szs[i], escape_pcts[j]);
+                bench_write_frame(payload_szs[i], escape_pcts[j], 0);
+                bench_write_frame(payload_szs[i], escape_pcts[j], 1);
+                bench_txq(payload_szs[i], escape_pcts[j]);
+                bench_encode(payload_szs[i], escape_pcts[j]);
+                bench_decode(payload_szs[i], escape_pcts[j]);
+                for (size_t k = 0; k < sizeof(chunk_szs) / sizeof(chunk_szs[0]); k++) {
+                    bench_feed(payload_szs[i], escape_pcts[j], chunk_szs[k]);
+                    for (size_t l = 0; l < sizeof(fill_pcts) / sizeof(fill_pcts[0]); l++) {
+                        bench_read(payload_szs[i], escape_pcts[j], chunk_szs[k], fill_pcts[l]);
+                    }
+                }
+            }
+        }
+    }
+    bench_cobs = 0;
+
+#ifdef __linux__
+    signal(SIGPIPE, SIG_IGN);
+    uint32_t links_ns[] = {2, 16, 128, 512};
+    for (size_t i = 0; i < sizeof(payload_szs) / sizeof(payload_szs[0]); i++) {
+        for (size_t j = 0; j < sizeof(links_ns) / sizeof(links_ns[0]); j++) {
+            bench_epoll(payload_szs[i], links_ns[j]);
+        }
+    }
+#endif
+    return 0;
+}
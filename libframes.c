@@ -1,159 +1,606 @@
 #include "libframes.h"
 
-void libframes_write_platform(void *, uint32_t);
+#include <string.h>
 
-libframes_stats_t libframes_stats = {
-    .min_rx_frame_sz = 666,
-    .write_frame_min_sz = 666
-};
+// With LIBFRAMES_SPSC, libframes_inject_rx_ring (the producer) may run on one
+// thread while the read functions (the consumer) run on another. rx_ring is
+// then handed over with C11 acquire/release atomics instead of plain loads
+// and stores.
+#ifdef LIBFRAMES_SPSC
+    #define LIBFRAMES_LOAD_RELAXED(p) atomic_load_explicit(p, memory_order_relaxed)
+    #define LIBFRAMES_LOAD_ACQUIRE(p) atomic_load_explicit(p, memory_order_acquire)
+    #define LIBFRAMES_STORE_RELEASE(p, v) atomic_store_explicit(p, v, memory_order_release)
+#else
+    #define LIBFRAMES_LOAD_RELAXED(p) (*(p))
+    #define LIBFRAMES_LOAD_ACQUIRE(p) (*(p))
+    #define LIBFRAMES_STORE_RELEASE(p, v) (*(p) = (v))
+#endif
+
+// Updates to the stats go away with LIBFRAMES_NO_STATS.
+#ifdef LIBFRAMES_NO_STATS
+    #define LIBFRAMES_STAT(s)
+#else
+    #define LIBFRAMES_STAT(s) s
+#endif
+
+// Scanning for bytes that need escaping uses SSE2/AVX2 when the compiler
+// targets them, unless LIBFRAMES_NO_SIMD is defined.
+#if !defined(LIBFRAMES_NO_SIMD) && defined(__AVX2__)
+    #include <immintrin.h>
+    #define LIBFRAMES_SIMD_AVX2
+#elif !defined(LIBFRAMES_NO_SIMD) && defined(__SSE2__)
+    #include <emmintrin.h>
+    #define LIBFRAMES_SIMD_SSE2
+#endif
 
-#define LIBFRAMES_RX_RING_SZ (LIBFRAMES_MAX_FRAME_SZ * LIBFRAMES_RX_RING_FRAMES)
-static char rx_ring[LIBFRAMES_RX_RING_SZ];
-static uint32_t rx_ring_tail = 0;
-static uint32_t rx_ring_unread = 0;
+// CRC-32C has its own instruction in SSE4.2.
+#if LIBFRAMES_CRC == 32 && !defined(LIBFRAMES_NO_SIMD) && defined(__SSE4_2__)
+    #include <nmmintrin.h>
+    #define LIBFRAMES_CRC32C_HW
+#endif
 
-static enum {
+// The receiver runs the checksum over the payload followed by the
+// transmitted checksum, and ends up with LIBFRAMES_CRC_RESIDUE if the frame
+// is intact.
+#if LIBFRAMES_CRC == 32
+    #define LIBFRAMES_CRC_INIT 0xffffffff
+    #define LIBFRAMES_CRC_RESIDUE 0xb798b438
+#elif LIBFRAMES_CRC == 16
+    #define LIBFRAMES_CRC_INIT 0xffff
+    #define LIBFRAMES_CRC_RESIDUE 0
+#else
+    #define LIBFRAMES_CRC_INIT 0
+    #define LIBFRAMES_CRC_RESIDUE 0
+#endif
+
+enum {
     NOT_READING,
     READING
-} read_state = NOT_READING;
+};
+
+enum {
+    NOT_WRITING,
+    WRITING
+};
+
+int libframes_init(libframes_ctx_t *ctx, libframes_write_platform_t write_platform, void *user,
+        void *rx_ring, uint32_t rx_ring_sz, void *frame_buffer, uint32_t max_frame_sz) {
+    // The ring has to hold the biggest frame there is, fully escaped, or it
+    // could fill up without ever completing a frame. Keep it well clear of
+    // where the byte counters would overflow, too.
+    if (max_frame_sz < LIBFRAMES_CRC_SZ || rx_ring_sz < 2 * max_frame_sz + 2 || rx_ring_sz > 0x40000000) {
+        return LIBFRAMES_ERROR_BAD_SIZE;
+    }
+
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->write_platform = write_platform;
+    ctx->user = user;
+    ctx->rx_ring = rx_ring;
+    ctx->rx_ring_sz = rx_ring_sz;
+    ctx->rx_ring_mask = (rx_ring_sz & (rx_ring_sz - 1)) == 0 ? rx_ring_sz - 1 : 0;
+    ctx->frame_buffer = frame_buffer;
+    ctx->max_frame_sz = max_frame_sz;
+    ctx->read_state = NOT_READING;
+    ctx->rx_running_crc = LIBFRAMES_CRC_INIT;
+    ctx->write_state = NOT_WRITING;
+    return 0;
+}
+
+void libframes_set_resync(libframes_ctx_t *ctx, int resync) {
+    ctx->rx_resync = resync;
+}
+
+void libframes_set_cobs(libframes_ctx_t *ctx, int cobs) {
+    ctx->cobs = cobs;
+}
 
-static uint8_t crc8_table[256];
+void libframes_set_writev(libframes_ctx_t *ctx, libframes_writev_platform_t writev_platform) {
+    ctx->writev_platform = writev_platform;
+}
+
+// What delimits frames on this link.
+static uint8_t lim(libframes_ctx_t *ctx) {
+    return ctx->cobs ? 0 : LIBFRAMES_LIM;
+}
+
+#ifndef LIBFRAMES_NO_STATS
+void libframes_stats_snapshot(libframes_ctx_t *ctx, libframes_stats_t *stats, int reset) {
+    *stats = ctx->stats;
+    if (reset) {
+        memset(&ctx->stats, 0, sizeof(ctx->stats));
+    }
+}
+
+// Fold the size of the count-th frame into a min and max.
+static void stats_frame_sz(uint64_t *min, uint64_t *max, uint64_t count, uint32_t sz) {
+    if (count == 1 || sz < *min) {
+        *min = sz;
+    }
+    if (sz > *max) {
+        *max = sz;
+    }
+}
+#endif
 
-static char frame_buffer[LIBFRAMES_MAX_FRAME_SZ];
-static uint32_t frame_buffer_sz;
-static uint32_t frame_buffer_off;
+#ifdef LIBFRAMES_HISTOGRAMS
+static void hist_add(uint64_t *hist, uint32_t v) {
+    int bucket = 0;
+    while (v) {
+        bucket++;
+        v >>= 1;
+    }
+    hist[bucket]++;
+}
+#endif
 
-void libframes_inject_rx_ring(void *p, uint32_t sz) {
+// Move a position in rx_ring on by sz bytes (at most the ring size). Ring
+// sizes that are powers of two wrap with a mask.
+static uint32_t rx_ring_advance(libframes_ctx_t *ctx, uint32_t pos, uint32_t sz) {
+    pos += sz;
+    if (ctx->rx_ring_mask) {
+        return pos & ctx->rx_ring_mask;
+    }
+    return pos >= ctx->rx_ring_sz ? pos - ctx->rx_ring_sz : pos;
+}
+
+#if !defined(LIBFRAMES_CRC32C_HW)
+static const libframes_crc_t crc_table[4][256];
+#endif
+
+// Run the checksum over sz more bytes. The table versions take four bytes
+// per step (slicing-by-4), so consecutive steps don't wait on each other's
+// table lookups.
+static libframes_crc_t libframes_crc_update(libframes_crc_t crc, const uint8_t *p, uint32_t sz) {
+#if LIBFRAMES_CRC == 8
+    for (; sz >= 4; p += 4, sz -= 4) {
+        crc = crc_table[3][crc ^ p[0]] ^ crc_table[2][p[1]] ^
+            crc_table[1][p[2]] ^ crc_table[0][p[3]];
+    }
+    for (; sz > 0; p++, sz--) {
+        crc = crc_table[0][crc ^ *p];
+    }
+#elif LIBFRAMES_CRC == 16
+    for (; sz >= 4; p += 4, sz -= 4) {
+        crc = crc_table[3][(crc >> 8) ^ p[0]] ^ crc_table[2][(crc & 0xff) ^ p[1]] ^
+            crc_table[1][p[2]] ^ crc_table[0][p[3]];
+    }
+    for (; sz > 0; p++, sz--) {
+        crc = (uint16_t)(crc << 8) ^ crc_table[0][(crc >> 8) ^ *p];
+    }
+#elif defined(LIBFRAMES_CRC32C_HW)
+#if defined(__x86_64__)
+    for (; sz >= 8; p += 8, sz -= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        crc = (uint32_t)_mm_crc32_u64(crc, w);
+    }
+#endif
+    for (; sz > 0; p++, sz--) {
+        crc = _mm_crc32_u8(crc, *p);
+    }
+#else
+    for (; sz >= 4; p += 4, sz -= 4) {
+        crc ^= (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+        crc = crc_table[3][crc & 0xff] ^ crc_table[2][(crc >> 8) & 0xff] ^
+            crc_table[1][(crc >> 16) & 0xff] ^ crc_table[0][crc >> 24];
+    }
+    for (; sz > 0; p++, sz--) {
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ *p) & 0xff];
+    }
+#endif
+    return crc;
+}
+
+// Serialize the checksum of a frame for transmission.
+static void libframes_crc_final(libframes_crc_t crc, uint8_t *out) {
+#if LIBFRAMES_CRC == 32
+    crc = ~crc;
+    out[0] = crc & 0xff;
+    out[1] = (crc >> 8) & 0xff;
+    out[2] = (crc >> 16) & 0xff;
+    out[3] = crc >> 24;
+#elif LIBFRAMES_CRC == 16
+    out[0] = crc >> 8;
+    out[1] = crc & 0xff;
+#else
+    out[0] = crc;
+#endif
+}
+
+// Find the first DLE or LIM in p. Returns sz if there is none.
+static uint32_t libframes_find_special(const uint8_t *p, uint32_t sz) {
     uint32_t off = 0;
-    while (rx_ring_unread < LIBFRAMES_RX_RING_SZ && off < sz) {
-        uint32_t rx_ring_head = rx_ring_tail + rx_ring_unread;
-        if (rx_ring_head >= LIBFRAMES_RX_RING_SZ) {
-            rx_ring_head -= LIBFRAMES_RX_RING_SZ;
+#if defined(LIBFRAMES_SIMD_AVX2)
+    const __m256i dle = _mm256_set1_epi8(LIBFRAMES_DLE);
+    const __m256i lim = _mm256_set1_epi8(LIBFRAMES_LIM);
+    for (; off + 32 <= sz; off += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)&p[off]);
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_cmpeq_epi8(v, dle), _mm256_cmpeq_epi8(v, lim)));
+        if (mask) {
+            return off + __builtin_ctz(mask);
         }
-        rx_ring[rx_ring_head] = ((char *)p)[off];
-        rx_ring_unread++;
-        off++;
     }
+#elif defined(LIBFRAMES_SIMD_SSE2)
+    const __m128i dle = _mm_set1_epi8(LIBFRAMES_DLE);
+    const __m128i lim = _mm_set1_epi8(LIBFRAMES_LIM);
+    for (; off + 16 <= sz; off += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)&p[off]);
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(
+            _mm_cmpeq_epi8(v, dle), _mm_cmpeq_epi8(v, lim)));
+        if (mask) {
+            return off + __builtin_ctz(mask);
+        }
+    }
+#else
+    // Eight bytes at a time: a byte of w ^ pattern is zero iff that byte of w
+    // matches. The byte loop below finds out which one it was.
+    const uint64_t ones = 0x0101010101010101ull;
+    const uint64_t highs = 0x8080808080808080ull;
+    for (; off + 8 <= sz; off += 8) {
+        uint64_t w;
+        memcpy(&w, &p[off], 8);
+        uint64_t d = w ^ (ones * LIBFRAMES_DLE);
+        uint64_t l = w ^ (ones * LIBFRAMES_LIM);
+        if (((d - ones) & ~d & highs) | ((l - ones) & ~l & highs)) {
+            break;
+        }
+    }
+#endif
+    for (; off < sz; off++) {
+        if (p[off] == LIBFRAMES_DLE || p[off] == LIBFRAMES_LIM) {
+            break;
+        }
+    }
+    return off;
 }
 
-int libframes_read_begin(uint32_t *p_sz) {
+// How many bytes are in rx_ring, as seen by the consumer.
+static uint32_t rx_ring_unread(libframes_ctx_t *ctx) {
+    return LIBFRAMES_LOAD_ACQUIRE(&ctx->rx_ring_written) - LIBFRAMES_LOAD_RELAXED(&ctx->rx_ring_read);
+}
+
+int libframes_rx_ring_reserve(libframes_ctx_t *ctx, void *p[2], uint32_t sz[2]) {
+    // The consumer only ever frees up more space.
+    uint32_t written = LIBFRAMES_LOAD_RELAXED(&ctx->rx_ring_written);
+    uint32_t free_sz = ctx->rx_ring_sz - (written - LIBFRAMES_LOAD_ACQUIRE(&ctx->rx_ring_read));
+    if (free_sz == 0) {
+        return 0;
+    }
+
+    // Up to the end of the ring, then whatever is left from the start.
+    uint32_t first_sz = ctx->rx_ring_sz - ctx->rx_ring_head;
+    if (first_sz >= free_sz) {
+        p[0] = &ctx->rx_ring[ctx->rx_ring_head];
+        sz[0] = free_sz;
+        return 1;
+    }
+    p[0] = &ctx->rx_ring[ctx->rx_ring_head];
+    sz[0] = first_sz;
+    p[1] = ctx->rx_ring;
+    sz[1] = free_sz - first_sz;
+    return 2;
+}
+
+void libframes_rx_ring_commit(libframes_ctx_t *ctx, uint32_t sz) {
+    ctx->rx_ring_head = rx_ring_advance(ctx, ctx->rx_ring_head, sz);
+    // Publish the bytes.
+    LIBFRAMES_STORE_RELEASE(&ctx->rx_ring_written, LIBFRAMES_LOAD_RELAXED(&ctx->rx_ring_written) + sz);
+}
+
+uint32_t libframes_inject_rx_ring(libframes_ctx_t *ctx, void *p, uint32_t sz) {
+    // Accept as much as fits.
+    void *pieces[2];
+    uint32_t piece_szs[2];
+    int n = libframes_rx_ring_reserve(ctx, pieces, piece_szs);
+    uint32_t copied = 0;
+    for (int i = 0; i < n && copied < sz; i++) {
+        uint32_t piece_sz = sz - copied < piece_szs[i] ? sz - copied : piece_szs[i];
+        memcpy(pieces[i], (char *)p + copied, piece_sz);
+        copied += piece_sz;
+    }
+    libframes_rx_ring_commit(ctx, copied);
+    return copied;
+}
+
+// Drop sz bytes from the tail of rx_ring. Whatever had been scanned past the
+// old tail is either dropped with it or has to be scanned again.
+static void rx_ring_consume(libframes_ctx_t *ctx, uint32_t sz) {
+    ctx->rx_ring_tail = rx_ring_advance(ctx, ctx->rx_ring_tail, sz);
+    ctx->rx_ring_scanned = 0;
+    // Hand the space back to the producer.
+    LIBFRAMES_STORE_RELEASE(&ctx->rx_ring_read, LIBFRAMES_LOAD_RELAXED(&ctx->rx_ring_read) + sz);
+}
+
+// Frames are decoded in place, straight out of rx_ring, for as long as they
+// need no unescaping and don't wrap around the end of the ring. Past that,
+// what has been decoded so far is copied to frame_buffer, and decoding carries
+// on there. COBS frames start with a code byte, so they are always decoded in
+// frame_buffer.
+static void rx_frame_materialize(libframes_ctx_t *ctx) {
+    if (ctx->rx_frame_in_place) {
+        memcpy(ctx->frame_buffer, &ctx->rx_ring[ctx->rx_ring_tail], ctx->frame_buffer_sz);
+        ctx->rx_frame_in_place = 0;
+    }
+}
+
+// Where the decoded current frame is.
+static const char *rx_frame_data(libframes_ctx_t *ctx) {
+    return ctx->rx_frame_in_place ? &ctx->rx_ring[ctx->rx_ring_tail] : ctx->frame_buffer;
+}
+
+// A LIM opened a new frame.
+static void rx_frame_start(libframes_ctx_t *ctx) {
+    ctx->rx_limit_bytes_found = 1;
+    ctx->frame_buffer_sz = 0;
+    ctx->rx_running_crc = LIBFRAMES_CRC_INIT;
+    ctx->rx_prev_was_dle = 0;
+    ctx->rx_cobs_left = 0;
+    ctx->rx_cobs_zero = 0;
+}
+
+// How many of the sz bytes at p are frame contents that can be copied as they
+// are: up to the next DLE or LIM, or with COBS, up to the end of the block or
+// an early zero.
+static uint32_t rx_frame_run(libframes_ctx_t *ctx, const uint8_t *p, uint32_t sz) {
+    if (ctx->cobs) {
+        if (sz > ctx->rx_cobs_left) {
+            sz = ctx->rx_cobs_left;
+        }
+        const uint8_t *zero = memchr(p, 0, sz);
+        uint32_t run = zero ? (uint32_t)(zero - p) : sz;
+        ctx->rx_cobs_left -= run;
+        return run;
+    }
+    return ctx->rx_prev_was_dle ? 0 : libframes_find_special(p, sz);
+}
+
+// Decode a byte of frame contents that rx_frame_run didn't take: a DLE, an
+// escaped byte, or a COBS code byte. The frame has to be in frame_buffer by
+// now. Returns LIBFRAMES_READ_ERROR_TOO_BIG if it doesn't fit there, 0
+// otherwise.
+static int rx_frame_byte(libframes_ctx_t *ctx, uint8_t c) {
+    if (ctx->cobs) {
+        // Still in a block, so the block didn't fit.
+        if (ctx->rx_cobs_left > 0) {
+            return LIBFRAMES_READ_ERROR_TOO_BIG;
+        }
+        // A block that ended short stood for a zero, unless it was the last.
+        if (ctx->rx_cobs_zero) {
+            if (ctx->frame_buffer_sz == ctx->max_frame_sz) {
+                return LIBFRAMES_READ_ERROR_TOO_BIG;
+            }
+            uint8_t zero = 0;
+            ctx->frame_buffer[ctx->frame_buffer_sz++] = zero;
+            ctx->rx_running_crc = libframes_crc_update(ctx->rx_running_crc, &zero, 1);
+        }
+        ctx->rx_cobs_left = c - 1;
+        ctx->rx_cobs_zero = c != LIBFRAMES_COBS_BLOCK_SZ + 1;
+        return 0;
+    }
+
+    if (ctx->frame_buffer_sz == ctx->max_frame_sz) {
+        return LIBFRAMES_READ_ERROR_TOO_BIG;
+    }
+    if (c == LIBFRAMES_DLE) {
+        ctx->rx_prev_was_dle = 1;
+        return 0;
+    }
+    ctx->rx_prev_was_dle = 0;
+    c ^= LIBFRAMES_XOR;
+    ctx->frame_buffer[ctx->frame_buffer_sz++] = c;
+    ctx->rx_running_crc = libframes_crc_update(ctx->rx_running_crc, &c, 1);
+    return 0;
+}
+
+// A LIM closed the current frame. Check it, and count it in the stats
+// whichever way it went. Returns 0 if the frame is good, leaving its checksum
+// out of frame_buffer_sz.
+static int rx_frame_check(libframes_ctx_t *ctx) {
+    ctx->rx_limit_bytes_found = 0;
+    // Was the last byte a DLE, or did the last COBS block end early? Then
+    // the frame was encoded badly.
+    if (ctx->cobs ? ctx->rx_cobs_left > 0 : ctx->rx_prev_was_dle) {
+        LIBFRAMES_STAT(ctx->stats.rx_frame_rejected_encoding_error++);
+        return LIBFRAMES_READ_ERROR_BAD_ENCODING;
+    }
+    // Is it at least the minimum frame? Must at least have the checksum.
+    if (ctx->frame_buffer_sz < LIBFRAMES_CRC_SZ) {
+        LIBFRAMES_STAT(ctx->stats.rx_frame_rejected_too_small++);
+        return LIBFRAMES_READ_ERROR_TOO_SMALL;
+    }
+    // The checksum run over the frame checksum too should have come out as
+    // the residue (0 for crc8).
+    if (ctx->rx_running_crc != LIBFRAMES_CRC_RESIDUE) {
+        LIBFRAMES_STAT(ctx->stats.rx_frame_rejected_bad_crc8++);
+        return LIBFRAMES_READ_ERROR_BAD_CRC8;
+    }
+    ctx->frame_buffer_sz -= LIBFRAMES_CRC_SZ;
+    // Update some more frame statistics.
+#ifndef LIBFRAMES_NO_STATS
+    ctx->stats.rx_frame_count++;
+    stats_frame_sz(&ctx->stats.min_rx_frame_sz, &ctx->stats.max_rx_frame_sz,
+        ctx->stats.rx_frame_count, ctx->frame_buffer_sz);
+#endif
+#ifdef LIBFRAMES_HISTOGRAMS
+    hist_add(ctx->stats.rx_frame_sz_hist, ctx->frame_buffer_sz);
+#endif
+    return 0;
+}
+
+static int read_begin(libframes_ctx_t *ctx, uint32_t *p_sz) {
     // Check that we are not already reading a frame.
-    if (read_state == READING) {
+    if (ctx->read_state == READING) {
         return LIBFRAMES_ERROR_NOT_READY;
     }
 
-    uint32_t original_rx_ring_tail = rx_ring_tail;
-    uint32_t original_rx_ring_unread = rx_ring_unread;
+    // Pick up where the previous call left off.
+    uint32_t rx_ring_pos = rx_ring_advance(ctx, ctx->rx_ring_tail, ctx->rx_ring_scanned);
+    uint8_t limit = lim(ctx);
 
-    int limit_bytes_found = 0;
-    frame_buffer_sz = 0;
-    frame_buffer_off = 0;
-    uint8_t running_crc8 = 0;
-    int prev_was_dle = 0;
-    while (rx_ring_unread > 0) {
-        if (rx_ring[rx_ring_tail] == LIBFRAMES_LIM) {
-            limit_bytes_found++;
-            // If we got a frame begin and a frame end limit byte, we found a
-            // complete frame.
-            if (limit_bytes_found == 2) {
-                // Was the last byte a DLE? Then the frame was encoded badly.
-                if (prev_was_dle) {
-                    libframes_stats.rx_frame_rejected_encoding_error++;
-                    return LIBFRAMES_READ_ERROR_BAD_ENCODING;
-                }
-                // Is it at least the minimum frame? Must at least have crc8.
-                if (frame_buffer_sz < 1) {
-                    libframes_stats.rx_frame_rejected_too_small++;
-                    return LIBFRAMES_READ_ERROR_TOO_SMALL;
-                }
-                // running_crc8 should have been xor'ed with the frame crc8,
-                // thus it should be 0.
-                if (running_crc8 != 0) {
-                    libframes_stats.rx_frame_rejected_bad_crc8++;
-                    return LIBFRAMES_READ_ERROR_BAD_CRC8;
+    uint32_t unread;
+    while (ctx->rx_ring_scanned < (unread = rx_ring_unread(ctx))) {
+        // Look at as much of the ring as is contiguous.
+        uint32_t sz = unread - ctx->rx_ring_scanned;
+        if (sz > ctx->rx_ring_sz - rx_ring_pos) {
+            sz = ctx->rx_ring_sz - rx_ring_pos;
+        }
+
+        if (ctx->rx_limit_bytes_found == 0) {
+            // Skip ahead to the next LIM; everything before it is a false
+            // start.
+            char *found = memchr(&ctx->rx_ring[rx_ring_pos], limit, sz);
+            uint32_t run = found ? (uint32_t)(found - &ctx->rx_ring[rx_ring_pos]) : sz;
+            if (run > 0) {
+                LIBFRAMES_STAT(ctx->stats.rx_false_starts += run);
+                rx_ring_consume(ctx, run);
+                rx_ring_pos = ctx->rx_ring_tail;
+                continue;
+            }
+        } else {
+            // Runs of frame contents need no decoding; copy them as they are,
+            // but no further than what fits in frame_buffer.
+            if (sz > ctx->max_frame_sz - ctx->frame_buffer_sz) {
+                sz = ctx->max_frame_sz - ctx->frame_buffer_sz;
+            }
+            uint8_t *run_start = (uint8_t *)&ctx->rx_ring[rx_ring_pos];
+            uint32_t run = rx_frame_run(ctx, run_start, sz);
+            if (run > 0) {
+                if (rx_ring_pos < ctx->rx_ring_tail) {
+                    rx_frame_materialize(ctx);
                 }
-                frame_buffer_sz--;
-                // Update some more frame statistics.
-                libframes_stats.rx_frame_count++;
-                if (frame_buffer_sz < libframes_stats.min_rx_frame_sz) {
-                    libframes_stats.min_rx_frame_sz = frame_buffer_sz;
+                if (!ctx->rx_frame_in_place) {
+                    memcpy(&ctx->frame_buffer[ctx->frame_buffer_sz], run_start, run);
                 }
-                if (frame_buffer_sz > libframes_stats.max_rx_frame_sz) {
-                    libframes_stats.max_rx_frame_sz = frame_buffer_sz;
+                ctx->rx_running_crc = libframes_crc_update(ctx->rx_running_crc, run_start, run);
+                ctx->frame_buffer_sz += run;
+                ctx->rx_ring_scanned += run;
+                rx_ring_pos = rx_ring_advance(ctx, rx_ring_pos, run);
+                continue;
+            }
+        }
+
+        // One byte at a time for delimiters, escapes, and errors.
+        uint8_t c = ctx->rx_ring[rx_ring_pos];
+        rx_ring_pos = rx_ring_advance(ctx, rx_ring_pos, 1);
+
+        if (c == limit) {
+            // If we got a frame begin and a frame end limit byte, we found a
+            // complete frame.
+            if (ctx->rx_limit_bytes_found == 1) {
+                // The terminating LIM isn't consumed on errors: it becomes
+                // the beginning of the next frame.
+                int ret = rx_frame_check(ctx);
+                if (ret != 0) {
+                    rx_ring_consume(ctx, ctx->rx_ring_scanned);
+                    if (ctx->rx_resync) {
+                        rx_ring_pos = ctx->rx_ring_tail;
+                        continue;
+                    }
+                    return ret;
                 }
-                // Read past the terminating LIM.
-                rx_ring_tail = rx_ring_tail + 1 == LIBFRAMES_RX_RING_SZ ? 0 : rx_ring_tail + 1;
-                rx_ring_unread--;
+                // The frame (and the terminating LIM) stays in the ring until
+                // libframes_read_end, since it might be read in place.
+                ctx->rx_frame_raw_sz = ctx->rx_ring_scanned + 1;
                 // Ready to read frame!
-                read_state = READING;
-                *p_sz = frame_buffer_sz;
+                ctx->read_state = READING;
+                ctx->frame_buffer_off = 0;
+                *p_sz = ctx->frame_buffer_sz;
                 return 0;
             }
-        } else if (limit_bytes_found == 1) {
-            // Is the frame too big yet?
-            if (frame_buffer_sz == LIBFRAMES_MAX_FRAME_SZ) {
-                libframes_stats.rx_frame_rejected_too_big++;
-                return LIBFRAMES_READ_ERROR_TOO_BIG;
-            }
-            // These are frame contents; store in frame_buffer after decoding.
-            if (rx_ring[rx_ring_tail] == LIBFRAMES_DLE) {
-                prev_was_dle = 1;
-            } else {
-                uint8_t b;
-                if (prev_was_dle) {
-                    prev_was_dle = 0;
-                    b = rx_ring[rx_ring_tail] ^ LIBFRAMES_XOR;
-                } else {
-                    b = rx_ring[rx_ring_tail];
+            // This is the beginning of a frame.
+            rx_frame_start(ctx);
+            ctx->rx_frame_in_place = 1;
+            rx_ring_consume(ctx, 1);
+        } else if (ctx->rx_limit_bytes_found == 1) {
+            // These are frame contents; store in frame_buffer after
+            // decoding. Is the frame too big yet? The offending byte is left
+            // in the ring.
+            rx_frame_materialize(ctx);
+            if (rx_frame_byte(ctx, c) != 0) {
+                ctx->rx_limit_bytes_found = 0;
+                rx_ring_consume(ctx, ctx->rx_ring_scanned);
+                LIBFRAMES_STAT(ctx->stats.rx_frame_rejected_too_big++);
+                if (ctx->rx_resync) {
+                    rx_ring_pos = ctx->rx_ring_tail;
+                    continue;
                 }
-                frame_buffer[frame_buffer_sz++] = rx_ring[rx_ring_tail];
-                running_crc8 = crc8_table[running_crc8 ^ b];
+                return LIBFRAMES_READ_ERROR_TOO_BIG;
             }
-        } else if (limit_bytes_found == 0) {
+            // Frame bytes stay in the ring until the frame is complete.
+            ctx->rx_ring_scanned++;
+        } else {
             // We've received a byte, but it's not in a frame and it's not a
             // frame delimiter.
-            libframes_stats.rx_false_starts++;
+            LIBFRAMES_STAT(ctx->stats.rx_false_starts++);
+            rx_ring_consume(ctx, 1);
         }
-
-        rx_ring_tail = rx_ring_tail + 1 == LIBFRAMES_RX_RING_SZ ? 0 : rx_ring_tail + 1;
-        rx_ring_unread--;
     }
 
-    // Tail reached head without finding a complete frame!
-    rx_ring_tail = original_rx_ring_tail;
-    rx_ring_unread = original_rx_ring_unread;
+    // Tail reached head without finding a complete frame! Everything up to
+    // the head has been decoded, so the next call only looks at new bytes.
     return LIBFRAMES_READ_ERROR_NO_FRAME;
 }
 
-int libframes_read(void *p, uint32_t sz, uint32_t *sz_read) {
+int libframes_read_begin(libframes_ctx_t *ctx, uint32_t *p_sz) {
+#ifdef LIBFRAMES_HISTOGRAMS
+    // Bytes are either consumed or scanned as part of the current frame, and
+    // scanned ones are only consumed later; the sum of the two only grows
+    // as bytes are got through.
+    uint32_t before = LIBFRAMES_LOAD_RELAXED(&ctx->rx_ring_read) + ctx->rx_ring_scanned;
+    int ret = read_begin(ctx, p_sz);
+    uint32_t after = LIBFRAMES_LOAD_RELAXED(&ctx->rx_ring_read) + ctx->rx_ring_scanned;
+    hist_add(ctx->stats.read_begin_scanned_hist, after - before);
+    return ret;
+#else
+    return read_begin(ctx, p_sz);
+#endif
+}
+
+int libframes_read(libframes_ctx_t *ctx, void *p, uint32_t sz, uint32_t *sz_read) {
     // Check that we are reading a frame.
-    if (read_state != READING) {
+    if (ctx->read_state != READING) {
         return LIBFRAMES_ERROR_NOT_READY;
     }
 
     // Read up to sz bytes into p, updating sz_read.
-    *sz_read = 0;
-    while (frame_buffer_off < frame_buffer_sz && sz > 0) {
-        ((char *)p)[*sz_read] = frame_buffer[frame_buffer_off];
-        (*sz_read)++;
-        frame_buffer_off++;
-        sz--;
-        libframes_stats.read_byte_count++;
+    uint32_t n = ctx->frame_buffer_sz - ctx->frame_buffer_off;
+    if (n > sz) {
+        n = sz;
     }
+    memcpy(p, rx_frame_data(ctx) + ctx->frame_buffer_off, n);
+    *sz_read = n;
+    ctx->frame_buffer_off += n;
+    LIBFRAMES_STAT(ctx->stats.read_byte_count += n);
 
     // Did we want to read more but there wasn't enough frame data?
-    if (sz > 0) {
-        libframes_stats.read_overreach++;
+    if (sz > n) {
+        LIBFRAMES_STAT(ctx->stats.read_overreach++);
     }
 
     return 0;
 }
 
-int libframes_read_exact(void *p, uint32_t sz) {
+int libframes_read_peek(libframes_ctx_t *ctx, const void **p, uint32_t *sz) {
+    // Check that we are reading a frame.
+    if (ctx->read_state != READING) {
+        return LIBFRAMES_ERROR_NOT_READY;
+    }
+
+    // Hand out the rest of the frame, which counts as read.
+    *p = rx_frame_data(ctx) + ctx->frame_buffer_off;
+    *sz = ctx->frame_buffer_sz - ctx->frame_buffer_off;
+    LIBFRAMES_STAT(ctx->stats.read_byte_count += *sz);
+    ctx->frame_buffer_off = ctx->frame_buffer_sz;
+
+    return 0;
+}
+
+int libframes_read_exact(libframes_ctx_t *ctx, void *p, uint32_t sz) {
     uint32_t sz_read;
     int err;
     // If libframes_read returns an error, pass it on.
-    if ((err = libframes_read(p, sz, &sz_read))) {
+    if ((err = libframes_read(ctx, p, sz, &sz_read))) {
         return err;
     }
     // If we didn't read as much as we wanted, that's an error too.
@@ -163,129 +610,1039 @@ int libframes_read_exact(void *p, uint32_t sz) {
     return 0;
 }
 
-uint32_t libframes_read_end(void) {
+uint32_t libframes_read_end(libframes_ctx_t *ctx) {
     // Check that we are reading a frame.
-    if (read_state == NOT_READING) {
+    if (ctx->read_state == NOT_READING) {
         return LIBFRAMES_ERROR_NOT_READY;
     }
 
     // Update some stats.
-    if (frame_buffer_sz > 0) {
-        libframes_stats.read_discard_frame_count++;
+#ifndef LIBFRAMES_NO_STATS
+    if (ctx->frame_buffer_sz > 0) {
+        ctx->stats.read_discard_frame_count++;
     }
-    uint32_t frame_bytes_remaining = frame_buffer_sz - frame_buffer_off;
-    libframes_stats.read_discard_byte_count += frame_bytes_remaining;
-    libframes_stats.read_byte_count += frame_bytes_remaining;
+    uint32_t frame_bytes_remaining = ctx->frame_buffer_sz - ctx->frame_buffer_off;
+    ctx->stats.read_discard_byte_count += frame_bytes_remaining;
+    ctx->stats.read_byte_count += frame_bytes_remaining;
+#endif
 
-    // Not reading anymore.
-    read_state = NOT_READING;
+    // Not reading anymore; let go of the frame in the ring.
+    rx_ring_consume(ctx, ctx->rx_frame_raw_sz);
+    ctx->read_state = NOT_READING;
 
     return 0;
 }
 
-static enum {
-    NOT_WRITING,
-    WRITING
-} write_state = NOT_WRITING;
-static uint8_t writing_running_crc8;
-static uint32_t writing_frame_sz;
+uint32_t libframes_read_batch(libframes_ctx_t *ctx, void *arena, uint32_t arena_sz, libframes_frame_desc_t *frames, uint32_t max_frames) {
+    uint32_t frame_count = 0;
+    uint32_t arena_off = 0;
+    while (frame_count < max_frames) {
+        // Find the next good frame, unless one was left over from last time.
+        // Bad frames are skipped; libframes_read_begin has counted them.
+        if (ctx->read_state != READING) {
+            uint32_t frame_sz;
+            int ret = libframes_read_begin(ctx, &frame_sz);
+            if (ret == LIBFRAMES_READ_ERROR_NO_FRAME) {
+                break;
+            }
+            if (ret != 0) {
+                continue;
+            }
+        }
+
+        // If the frame doesn't fit, it stays the current frame.
+        uint32_t frame_sz = ctx->frame_buffer_sz - ctx->frame_buffer_off;
+        if (frame_sz > arena_sz - arena_off) {
+            break;
+        }
+        uint32_t sz_read;
+        libframes_read(ctx, (char *)arena + arena_off, frame_sz, &sz_read);
+        libframes_read_end(ctx);
+        frames[frame_count].off = arena_off;
+        frames[frame_count].sz = frame_sz;
+        frame_count++;
+        arena_off += frame_sz;
+    }
+    return frame_count;
+}
+
+uint32_t libframes_feed(libframes_ctx_t *ctx, const void *p, uint32_t sz, libframes_on_frame_t on_frame, void *user) {
+    const uint8_t *bytes = p;
+    uint32_t frame_count = 0;
+    // The current frame's contents, while it is decoded in place in p. A
+    // frame carried over from the previous call is in frame_buffer.
+    const uint8_t *in_place = NULL;
+    uint8_t limit = lim(ctx);
+
+    uint32_t off = 0;
+    while (off < sz) {
+        if (ctx->rx_limit_bytes_found == 0) {
+            // Skip ahead to the next LIM, which begins a frame; everything
+            // before it is a false start.
+            const uint8_t *found = memchr(&bytes[off], limit, sz - off);
+            uint32_t run = found ? (uint32_t)(found - &bytes[off]) : sz - off;
+            LIBFRAMES_STAT(ctx->stats.rx_false_starts += run);
+            off += run;
+            if (found) {
+                rx_frame_start(ctx);
+                off++;
+                in_place = &bytes[off];
+            }
+            continue;
+        }
 
-int libframes_write_begin(void) {
-    if (write_state == WRITING) {
+        // Runs of frame contents need no decoding, but go no further than
+        // what fits in frame_buffer.
+        uint32_t n = sz - off;
+        if (n > ctx->max_frame_sz - ctx->frame_buffer_sz) {
+            n = ctx->max_frame_sz - ctx->frame_buffer_sz;
+        }
+        uint32_t run = rx_frame_run(ctx, &bytes[off], n);
+        if (run > 0) {
+            if (!in_place) {
+                memcpy(&ctx->frame_buffer[ctx->frame_buffer_sz], &bytes[off], run);
+            }
+            ctx->rx_running_crc = libframes_crc_update(ctx->rx_running_crc, &bytes[off], run);
+            ctx->frame_buffer_sz += run;
+            off += run;
+            continue;
+        }
+
+        // One byte at a time for delimiters, escapes, and errors.
+        uint8_t c = bytes[off];
+        if (c == limit) {
+            // The terminating LIM of a bad frame begins the next frame, so
+            // it isn't skipped.
+            if (rx_frame_check(ctx) == 0) {
+                LIBFRAMES_STAT(ctx->stats.read_byte_count += ctx->frame_buffer_sz);
+                on_frame(user, in_place ? (const char *)in_place : ctx->frame_buffer, ctx->frame_buffer_sz);
+                frame_count++;
+                off++;
+            }
+            continue;
+        }
+        // From the first escape on, the frame is decoded into frame_buffer.
+        if (in_place) {
+            memcpy(ctx->frame_buffer, in_place, ctx->frame_buffer_sz);
+            in_place = NULL;
+        }
+        // Is the frame too big yet? The offending byte is looked at again,
+        // as a false start.
+        if (rx_frame_byte(ctx, c) != 0) {
+            ctx->rx_limit_bytes_found = 0;
+            LIBFRAMES_STAT(ctx->stats.rx_frame_rejected_too_big++);
+            continue;
+        }
+        off++;
+    }
+
+    // Carry a partial frame over to the next call.
+    if (ctx->rx_limit_bytes_found && in_place) {
+        memcpy(ctx->frame_buffer, in_place, ctx->frame_buffer_sz);
+    }
+    return frame_count;
+}
+
+// Hand whatever is staged to the platform.
+static void libframes_write_flush(libframes_ctx_t *ctx) {
+#if LIBFRAMES_TX_BUF_SZ > 0
+    if (ctx->tx_buf_sz > 0) {
+        ctx->write_platform(ctx->user, ctx->tx_buf, ctx->tx_buf_sz);
+        LIBFRAMES_STAT(ctx->stats.write_flush_count++);
+        ctx->tx_buf_sz = 0;
+    }
+#endif
+}
+
+// The pieces of a frame on their way to writev_platform, while
+// libframes_write_frame is encoding one. Pieces of the caller's payload are
+// handed over where they are; escapes and the like are copied into bytes.
+struct libframes_tx_gather {
+    libframes_iovec_t iov[LIBFRAMES_WRITEV_IOV_N];
+    uint8_t bytes[LIBFRAMES_WRITEV_IOV_N][2];
+    int n;
+};
+
+static void write_gather_flush(libframes_ctx_t *ctx) {
+    struct libframes_tx_gather *gather = ctx->tx_gather;
+    if (gather->n > 0) {
+        ctx->writev_platform(ctx->user, gather->iov, gather->n);
+        LIBFRAMES_STAT(ctx->stats.write_flush_count++);
+        gather->n = 0;
+    }
+}
+
+static void write_gather(libframes_ctx_t *ctx, void *p, uint32_t sz) {
+    struct libframes_tx_gather *gather = ctx->tx_gather;
+    if (gather->n == LIBFRAMES_WRITEV_IOV_N) {
+        write_gather_flush(ctx);
+    }
+    if (sz <= sizeof(gather->bytes[0])) {
+        memcpy(gather->bytes[gather->n], p, sz);
+        p = gather->bytes[gather->n];
+    }
+    gather->iov[gather->n].p = p;
+    gather->iov[gather->n].sz = sz;
+    gather->n++;
+    // The next COBS block may be collected in tx_cobs_block, so what's there
+    // has to go now.
+    if (p == ctx->tx_cobs_block) {
+        write_gather_flush(ctx);
+    }
+}
+
+// Emit encoded bytes, staging them if there is a tx buffer.
+static void libframes_write_emit(libframes_ctx_t *ctx, void *p, uint32_t sz) {
+    if (ctx->tx_gather) {
+        write_gather(ctx, p, sz);
+        return;
+    }
+#if LIBFRAMES_TX_BUF_SZ > 0
+    while (sz > 0) {
+        uint32_t n = LIBFRAMES_TX_BUF_SZ - ctx->tx_buf_sz;
+        if (n > sz) {
+            n = sz;
+        }
+        memcpy(&ctx->tx_buf[ctx->tx_buf_sz], p, n);
+        ctx->tx_buf_sz += n;
+        p = (char *)p + n;
+        sz -= n;
+        if (ctx->tx_buf_sz == LIBFRAMES_TX_BUF_SZ) {
+            libframes_write_flush(ctx);
+        }
+    }
+#else
+    ctx->write_platform(ctx->user, p, sz);
+    LIBFRAMES_STAT(ctx->stats.write_flush_count++);
+#endif
+}
+
+int libframes_write_begin(libframes_ctx_t *ctx) {
+    if (ctx->write_state == WRITING) {
         return LIBFRAMES_ERROR_NOT_READY;
     }
 
-    write_state = WRITING;
-    writing_running_crc8 = 0;
+    ctx->write_state = WRITING;
+    ctx->writing_running_crc = LIBFRAMES_CRC_INIT;
 
     // Write out the first LIM.
-    uint8_t b = LIBFRAMES_LIM;
-    libframes_write_platform(&b, 1);
-    writing_frame_sz = 1;
+    uint8_t b = lim(ctx);
+    libframes_write_emit(ctx, &b, 1);
+    ctx->writing_frame_sz = 1;
+    ctx->tx_cobs_sz = 0;
+#ifdef LIBFRAMES_HISTOGRAMS
+    ctx->writing_escape_count = 0;
+#endif
 
     return 0;
 }
 
-int libframes_write(void *p, uint32_t sz) {
-    if (write_state == NOT_WRITING) {
-        return LIBFRAMES_ERROR_NOT_READY;
+// Emit a COBS block: its code byte, what is waiting in tx_cobs_block, and
+// then sz more bytes from p.
+static void cobs_write_block(libframes_ctx_t *ctx, const uint8_t *p, uint32_t sz) {
+    uint8_t code = ctx->tx_cobs_sz + sz + 1;
+    libframes_write_emit(ctx, &code, 1);
+    if (ctx->tx_cobs_sz > 0) {
+        libframes_write_emit(ctx, ctx->tx_cobs_block, ctx->tx_cobs_sz);
+    }
+    if (sz > 0) {
+        libframes_write_emit(ctx, (void *)p, sz);
     }
+    ctx->writing_frame_sz += code;
+    ctx->tx_cobs_sz = 0;
+}
 
-    uint32_t off;
-    for (off = 0; off < sz; off++) {
-        char b = ((char *)p)[off];
-        writing_running_crc8 = crc8_table[writing_running_crc8 ^ b];
-        if (b == LIBFRAMES_DLE || b == LIBFRAMES_LIM) {
-            uint8_t escaped[] = {LIBFRAMES_DLE, b ^ LIBFRAMES_XOR};
-            libframes_write_platform(&escaped, sizeof(escaped));
-            writing_frame_sz += 2;
-        } else {
-            libframes_write_platform(&b, 1);
-            writing_frame_sz += 1;
+// COBS blocks can only be emitted once their end is known, so the last one
+// waits in tx_cobs_block until the next zero, until it is full, or until
+// libframes_write_end.
+static void cobs_write(libframes_ctx_t *ctx, const uint8_t *bytes, uint32_t sz) {
+    uint32_t off = 0;
+    while (off < sz) {
+        uint32_t room = LIBFRAMES_COBS_BLOCK_SZ - ctx->tx_cobs_sz;
+        uint32_t n = sz - off < room ? sz - off : room;
+        const uint8_t *zero = memchr(&bytes[off], 0, n);
+        uint32_t run = zero ? (uint32_t)(zero - &bytes[off]) : n;
+        if (!zero && run < room) {
+            memcpy(&ctx->tx_cobs_block[ctx->tx_cobs_sz], &bytes[off], run);
+            ctx->tx_cobs_sz += run;
+            return;
         }
+        // The block ends here, at a zero (which its code byte stands for),
+        // or because it is full (which costs a byte).
+#ifdef LIBFRAMES_HISTOGRAMS
+        if (!zero) {
+            ctx->writing_escape_count++;
+        }
+#endif
+        cobs_write_block(ctx, &bytes[off], run);
+        off += run + (zero ? 1 : 0);
     }
+}
 
-    libframes_stats.write_byte_count += sz;
+// Encode and emit bytes of the frame, leaving the checksum and stats to the
+// caller.
+static void write_encoded(libframes_ctx_t *ctx, const uint8_t *bytes, uint32_t sz) {
+    if (ctx->cobs) {
+        cobs_write(ctx, bytes, sz);
+        return;
+    }
 
-    return 0;
+    // Emit runs of bytes that don't need escaping in one go.
+    uint32_t off = 0;
+    while (off < sz) {
+        uint32_t run = libframes_find_special(&bytes[off], sz - off);
+        if (run > 0) {
+            libframes_write_emit(ctx, (void *)&bytes[off], run);
+            ctx->writing_frame_sz += run;
+            off += run;
+        }
+        if (off < sz) {
+            uint8_t escaped[] = {LIBFRAMES_DLE, bytes[off] ^ LIBFRAMES_XOR};
+            libframes_write_emit(ctx, &escaped, sizeof(escaped));
+            ctx->writing_frame_sz += 2;
+#ifdef LIBFRAMES_HISTOGRAMS
+            ctx->writing_escape_count++;
+#endif
+            off++;
+        }
+    }
 }
 
-int libframes_write_end(void) {
-    if (write_state == NOT_WRITING) {
+int libframes_write(libframes_ctx_t *ctx, void *p, uint32_t sz) {
+    if (ctx->write_state == NOT_WRITING) {
         return LIBFRAMES_ERROR_NOT_READY;
     }
 
-    // Write out the crc8 and the closing LIM.
-    libframes_write(&writing_running_crc8, 1);
-    uint8_t b = LIBFRAMES_LIM;
-    libframes_write_platform(&b, 1);
-    writing_frame_sz++;
-    libframes_stats.write_byte_count++;
+    ctx->writing_running_crc = libframes_crc_update(ctx->writing_running_crc, p, sz);
+    LIBFRAMES_STAT(ctx->stats.write_byte_count += sz);
+    write_encoded(ctx, p, sz);
+
+    return 0;
+}
+
+// Write out the checksum and the closing LIM, and finish the frame. crc is
+// where the checksum is serialized; it has to last until the frame has been
+// handed over.
+static void write_close(libframes_ctx_t *ctx, uint8_t *crc) {
+    libframes_crc_final(ctx->writing_running_crc, crc);
+    write_encoded(ctx, crc, LIBFRAMES_CRC_SZ);
+    LIBFRAMES_STAT(ctx->stats.write_byte_count += LIBFRAMES_CRC_SZ);
+    if (ctx->cobs) {
+        // The last block stands for no zero, so it costs a byte.
+#ifdef LIBFRAMES_HISTOGRAMS
+        ctx->writing_escape_count++;
+#endif
+        cobs_write_block(ctx, NULL, 0);
+    }
+    uint8_t b = lim(ctx);
+    libframes_write_emit(ctx, &b, 1);
+    ctx->writing_frame_sz++;
+    LIBFRAMES_STAT(ctx->stats.write_byte_count++);
+    libframes_write_flush(ctx);
 
     // Update some stats.
-    libframes_stats.write_frame_count++;
-    if (writing_frame_sz < libframes_stats.write_frame_min_sz) {
-        libframes_stats.write_frame_min_sz = writing_frame_sz;
+#ifndef LIBFRAMES_NO_STATS
+    ctx->stats.write_frame_count++;
+    stats_frame_sz(&ctx->stats.write_frame_min_sz, &ctx->stats.write_frame_max_sz,
+        ctx->stats.write_frame_count, ctx->writing_frame_sz);
+#endif
+#ifdef LIBFRAMES_HISTOGRAMS
+    hist_add(ctx->stats.write_frame_sz_hist, ctx->writing_frame_sz);
+    uint32_t unescaped_sz = ctx->writing_frame_sz - ctx->writing_escape_count;
+    hist_add(ctx->stats.write_escape_pct_hist, (uint64_t)ctx->writing_escape_count * 100 / unescaped_sz);
+#endif
+
+    ctx->write_state = NOT_WRITING;
+}
+
+int libframes_write_end(libframes_ctx_t *ctx) {
+    if (ctx->write_state == NOT_WRITING) {
+        return LIBFRAMES_ERROR_NOT_READY;
+    }
+
+    uint8_t crc[LIBFRAMES_CRC_SZ];
+    write_close(ctx, crc);
+    return 0;
+}
+
+int libframes_write_frame(libframes_ctx_t *ctx, const libframes_iovec_t *iov, int iov_n) {
+    if (ctx->write_state == WRITING) {
+        return LIBFRAMES_ERROR_NOT_READY;
+    }
+    // With writev_platform, the frame bypasses the tx buffer altogether.
+    struct libframes_tx_gather gather;
+    if (ctx->writev_platform) {
+        gather.n = 0;
+        ctx->tx_gather = &gather;
     }
-    if (writing_frame_sz > libframes_stats.write_frame_max_sz) {
-        libframes_stats.write_frame_max_sz = writing_frame_sz;
+    libframes_write_begin(ctx);
+
+    uint64_t sz = 0;
+    for (int i = 0; i < iov_n; i++) {
+        ctx->writing_running_crc = libframes_crc_update(ctx->writing_running_crc, iov[i].p, iov[i].sz);
+        write_encoded(ctx, iov[i].p, iov[i].sz);
+        sz += iov[i].sz;
+    }
+    LIBFRAMES_STAT(ctx->stats.write_byte_count += sz);
+
+    uint8_t crc[LIBFRAMES_CRC_SZ];
+    write_close(ctx, crc);
+    if (ctx->tx_gather) {
+        write_gather_flush(ctx);
+        ctx->tx_gather = NULL;
+    }
+    return 0;
+}
+
+int libframes_write_encoded(libframes_ctx_t *ctx, const void *p, uint32_t sz) {
+    if (ctx->write_state == WRITING) {
+        return LIBFRAMES_ERROR_NOT_READY;
     }
 
-    write_state = NOT_WRITING;
+    // Nothing is staged between frames, so it can go straight out.
+    ctx->write_platform(ctx->user, (void *)p, sz);
+#ifndef LIBFRAMES_NO_STATS
+    ctx->stats.write_flush_count++;
+    ctx->stats.write_byte_count += sz;
+    ctx->stats.write_frame_count++;
+    stats_frame_sz(&ctx->stats.write_frame_min_sz, &ctx->stats.write_frame_max_sz,
+        ctx->stats.write_frame_count, sz);
+#endif
+#ifdef LIBFRAMES_HISTOGRAMS
+    hist_add(ctx->stats.write_frame_sz_hist, sz);
+#endif
     return 0;
 }
 
-static uint8_t crc8_table[256] = {
-    0x00, 0x07, 0x0e, 0x09, 0x1c, 0x1b, 0x12, 0x15,
-    0x38, 0x3f, 0x36, 0x31, 0x24, 0x23, 0x2a, 0x2d,
-    0x70, 0x77, 0x7e, 0x79, 0x6c, 0x6b, 0x62, 0x65,
-    0x48, 0x4f, 0x46, 0x41, 0x54, 0x53, 0x5a, 0x5d,
-    0xe0, 0xe7, 0xee, 0xe9, 0xfc, 0xfb, 0xf2, 0xf5,
-    0xd8, 0xdf, 0xd6, 0xd1, 0xc4, 0xc3, 0xca, 0xcd,
-    0x90, 0x97, 0x9e, 0x99, 0x8c, 0x8b, 0x82, 0x85,
-    0xa8, 0xaf, 0xa6, 0xa1, 0xb4, 0xb3, 0xba, 0xbd,
-    0xc7, 0xc0, 0xc9, 0xce, 0xdb, 0xdc, 0xd5, 0xd2,
-    0xff, 0xf8, 0xf1, 0xf6, 0xe3, 0xe4, 0xed, 0xea,
-    0xb7, 0xb0, 0xb9, 0xbe, 0xab, 0xac, 0xa5, 0xa2,
-    0x8f, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9d, 0x9a,
-    0x27, 0x20, 0x29, 0x2e, 0x3b, 0x3c, 0x35, 0x32,
-    0x1f, 0x18, 0x11, 0x16, 0x03, 0x04, 0x0d, 0x0a,
-    0x57, 0x50, 0x59, 0x5e, 0x4b, 0x4c, 0x45, 0x42,
-    0x6f, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7d, 0x7a,
-    0x89, 0x8e, 0x87, 0x80, 0x95, 0x92, 0x9b, 0x9c,
-    0xb1, 0xb6, 0xbf, 0xb8, 0xad, 0xaa, 0xa3, 0xa4,
-    0xf9, 0xfe, 0xf7, 0xf0, 0xe5, 0xe2, 0xeb, 0xec,
-    0xc1, 0xc6, 0xcf, 0xc8, 0xdd, 0xda, 0xd3, 0xd4,
-    0x69, 0x6e, 0x67, 0x60, 0x75, 0x72, 0x7b, 0x7c,
-    0x51, 0x56, 0x5f, 0x58, 0x4d, 0x4a, 0x43, 0x44,
-    0x19, 0x1e, 0x17, 0x10, 0x05, 0x02, 0x0b, 0x0c,
-    0x21, 0x26, 0x2f, 0x28, 0x3d, 0x3a, 0x33, 0x34,
-    0x4e, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5c, 0x5b,
-    0x76, 0x71, 0x78, 0x7f, 0x6a, 0x6d, 0x64, 0x63,
-    0x3e, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2c, 0x2b,
-    0x06, 0x01, 0x08, 0x0f, 0x1a, 0x1d, 0x14, 0x13,
-    0xae, 0xa9, 0xa0, 0xa7, 0xb2, 0xb5, 0xbc, 0xbb,
-    0x96, 0x91, 0x98, 0x9f, 0x8a, 0x8d, 0x84, 0x83,
-    0xde, 0xd9, 0xd0, 0xd7, 0xc2, 0xc5, 0xcc, 0xcb,
-    0xe6, 0xe1, 0xe8, 0xef, 0xfa, 0xfd, 0xf4, 0xf3
+uint32_t libframes_encode(const void *p, uint32_t sz, void *out, uint32_t out_sz) {
+    uint8_t *encoded = out;
+    uint32_t encoded_sz = 0;
+
+    uint8_t crc[LIBFRAMES_CRC_SZ];
+    libframes_crc_final(libframes_crc_update(LIBFRAMES_CRC_INIT, p, sz), crc);
+
+    if (out_sz < 2) {
+        return 0;
+    }
+    encoded[encoded_sz++] = LIBFRAMES_LIM;
+
+    // Escape the payload, then the checksum.
+    const uint8_t *parts[] = {p, crc};
+    uint32_t part_szs[] = {sz, sizeof(crc)};
+    for (int i = 0; i < 2; i++) {
+        const uint8_t *bytes = parts[i];
+        uint32_t off = 0;
+        while (off < part_szs[i]) {
+            uint32_t run = libframes_find_special(&bytes[off], part_szs[i] - off);
+            if (run > out_sz - encoded_sz) {
+                return 0;
+            }
+            memcpy(&encoded[encoded_sz], &bytes[off], run);
+            encoded_sz += run;
+            off += run;
+            if (off < part_szs[i]) {
+                if (out_sz - encoded_sz < 2) {
+                    return 0;
+                }
+                encoded[encoded_sz++] = LIBFRAMES_DLE;
+                encoded[encoded_sz++] = bytes[off] ^ LIBFRAMES_XOR;
+                off++;
+            }
+        }
+    }
+
+    if (encoded_sz == out_sz) {
+        return 0;
+    }
+    encoded[encoded_sz++] = LIBFRAMES_LIM;
+    return encoded_sz;
+}
+
+// The checksum is decoded along with the payload. Whatever doesn't fit in
+// out has to be (part of) the checksum, which only matters to running_crc.
+static int decode_append(const uint8_t *src, uint32_t sz, uint8_t *out, uint32_t out_sz,
+        uint32_t *decoded_sz, libframes_crc_t *running_crc) {
+    if (*decoded_sz + sz > out_sz + LIBFRAMES_CRC_SZ) {
+        return LIBFRAMES_READ_ERROR_TOO_BIG;
+    }
+    *running_crc = libframes_crc_update(*running_crc, src, sz);
+    if (*decoded_sz < out_sz) {
+        memcpy(&out[*decoded_sz], src, out_sz - *decoded_sz < sz ? out_sz - *decoded_sz : sz);
+    }
+    *decoded_sz += sz;
+    return 0;
+}
+
+// Same checks as libframes_read_begin, once the whole frame is decoded.
+static int decode_check(uint32_t decoded_sz, libframes_crc_t running_crc, uint32_t *p_sz) {
+    if (decoded_sz < LIBFRAMES_CRC_SZ) {
+        return LIBFRAMES_READ_ERROR_TOO_SMALL;
+    }
+    if (running_crc != LIBFRAMES_CRC_RESIDUE) {
+        return LIBFRAMES_READ_ERROR_BAD_CRC8;
+    }
+    *p_sz = decoded_sz - LIBFRAMES_CRC_SZ;
+    return 0;
+}
+
+int libframes_decode(const void *in, uint32_t in_sz, void *out, uint32_t out_sz, uint32_t *p_sz) {
+    const uint8_t *bytes = in;
+
+    // A frame starts and ends with a LIM.
+    if (in_sz < 2 || bytes[0] != LIBFRAMES_LIM || bytes[in_sz - 1] != LIBFRAMES_LIM) {
+        return LIBFRAMES_READ_ERROR_BAD_ENCODING;
+    }
+
+    uint32_t decoded_sz = 0;
+    libframes_crc_t running_crc = LIBFRAMES_CRC_INIT;
+    int prev_was_dle = 0;
+    uint32_t off = 1;
+    uint32_t end = in_sz - 1;
+    while (off < end) {
+        uint8_t c = bytes[off];
+        uint32_t run = 1;
+        if (c == LIBFRAMES_LIM) {
+            return LIBFRAMES_READ_ERROR_BAD_ENCODING;
+        } else if (c == LIBFRAMES_DLE) {
+            prev_was_dle = 1;
+            off++;
+            continue;
+        } else if (prev_was_dle) {
+            prev_was_dle = 0;
+            c ^= LIBFRAMES_XOR;
+        } else {
+            run = libframes_find_special(&bytes[off], end - off);
+        }
+
+        int ret = decode_append(run == 1 ? &c : &bytes[off], run, out, out_sz, &decoded_sz, &running_crc);
+        if (ret != 0) {
+            return ret;
+        }
+        off += run;
+    }
+
+    if (prev_was_dle) {
+        return LIBFRAMES_READ_ERROR_BAD_ENCODING;
+    }
+    return decode_check(decoded_sz, running_crc, p_sz);
+}
+
+int libframes_decode_peek(const void *in, uint32_t in_sz, void *out, uint32_t out_sz, const void **p, uint32_t *p_sz) {
+    const uint8_t *bytes = in;
+    if (in_sz >= 2 && bytes[0] == LIBFRAMES_LIM && bytes[in_sz - 1] == LIBFRAMES_LIM
+            && libframes_find_special(&bytes[1], in_sz - 2) == in_sz - 2) {
+        uint32_t decoded_sz = in_sz - 2;
+        if (decoded_sz > out_sz + LIBFRAMES_CRC_SZ) {
+            return LIBFRAMES_READ_ERROR_TOO_BIG;
+        }
+        *p = &bytes[1];
+        return decode_check(decoded_sz, libframes_crc_update(LIBFRAMES_CRC_INIT, &bytes[1], decoded_sz), p_sz);
+    }
+    *p = out;
+    return libframes_decode(in, in_sz, out, out_sz, p_sz);
+}
+
+uint32_t libframes_cobs_encode(const void *p, uint32_t sz, void *out, uint32_t out_sz) {
+    uint8_t *encoded = out;
+
+    uint8_t crc[LIBFRAMES_CRC_SZ];
+    libframes_crc_final(libframes_crc_update(LIBFRAMES_CRC_INIT, p, sz), crc);
+
+    // Room for the zeros and the first code byte.
+    if (out_sz < 3) {
+        return 0;
+    }
+    encoded[0] = 0;
+    // Where the current block's code byte goes, once the block's size is
+    // known.
+    uint32_t code_off = 1;
+    uint32_t encoded_sz = 2;
+
+    // Encode the payload, then the checksum, as one run of blocks.
+    const uint8_t *parts[] = {p, crc};
+    uint32_t part_szs[] = {sz, sizeof(crc)};
+    for (int i = 0; i < 2; i++) {
+        const uint8_t *bytes = parts[i];
+        uint32_t off = 0;
+        while (off < part_szs[i]) {
+            uint32_t room = LIBFRAMES_COBS_BLOCK_SZ - (encoded_sz - code_off - 1);
+            uint32_t n = part_szs[i] - off < room ? part_szs[i] - off : room;
+            const uint8_t *zero = memchr(&bytes[off], 0, n);
+            uint32_t run = zero ? (uint32_t)(zero - &bytes[off]) : n;
+            if (run > out_sz - encoded_sz) {
+                return 0;
+            }
+            memcpy(&encoded[encoded_sz], &bytes[off], run);
+            encoded_sz += run;
+            off += run;
+            if (zero || run == room) {
+                // Close the block, and open the next.
+                if (encoded_sz == out_sz) {
+                    return 0;
+                }
+                encoded[code_off] = encoded_sz - code_off;
+                code_off = encoded_sz++;
+                off += zero ? 1 : 0;
+            }
+        }
+    }
+
+    if (encoded_sz == out_sz) {
+        return 0;
+    }
+    encoded[code_off] = encoded_sz - code_off;
+    encoded[encoded_sz++] = 0;
+    return encoded_sz;
+}
+
+int libframes_cobs_decode(const void *in, uint32_t in_sz, void *out, uint32_t out_sz, uint32_t *p_sz) {
+    const uint8_t *bytes = in;
+
+    // A frame starts and ends with a zero.
+    if (in_sz < 2 || bytes[0] != 0 || bytes[in_sz - 1] != 0) {
+        return LIBFRAMES_READ_ERROR_BAD_ENCODING;
+    }
+
+    uint32_t decoded_sz = 0;
+    libframes_crc_t running_crc = LIBFRAMES_CRC_INIT;
+    uint32_t off = 1;
+    uint32_t end = in_sz - 1;
+    while (off < end) {
+        // A block, and the zero it stands for unless it's full or the last.
+        uint8_t code = bytes[off++];
+        uint32_t run = code - 1u;
+        if (code == 0 || run > end - off || memchr(&bytes[off], 0, run)) {
+            return LIBFRAMES_READ_ERROR_BAD_ENCODING;
+        }
+        int ret = decode_append(&bytes[off], run, out, out_sz, &decoded_sz, &running_crc);
+        off += run;
+        if (ret == 0 && off < end && run < LIBFRAMES_COBS_BLOCK_SZ) {
+            uint8_t zero = 0;
+            ret = decode_append(&zero, 1, out, out_sz, &decoded_sz, &running_crc);
+        }
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
+    return decode_check(decoded_sz, running_crc, p_sz);
+}
+
+#if LIBFRAMES_CRC == 8
+static const uint8_t crc_table[4][256] = {
+    {
+        0x00, 0x07, 0x0e, 0x09, 0x1c, 0x1b, 0x12, 0x15,
+        0x38, 0x3f, 0x36, 0x31, 0x24, 0x23, 0x2a, 0x2d,
+        0x70, 0x77, 0x7e, 0x79, 0x6c, 0x6b, 0x62, 0x65,
+        0x48, 0x4f, 0x46, 0x41, 0x54, 0x53, 0x5a, 0x5d,
+        0xe0, 0xe7, 0xee, 0xe9, 0xfc, 0xfb, 0xf2, 0xf5,
+        0xd8, 0xdf, 0xd6, 0xd1, 0xc4, 0xc3, 0xca, 0xcd,
+        0x90, 0x97, 0x9e, 0x99, 0x8c, 0x8b, 0x82, 0x85,
+        0xa8, 0xaf, 0xa6, 0xa1, 0xb4, 0xb3, 0xba, 0xbd,
+        0xc7, 0xc0, 0xc9, 0xce, 0xdb, 0xdc, 0xd5, 0xd2,
+        0xff, 0xf8, 0xf1, 0xf6, 0xe3, 0xe4, 0xed, 0xea,
+        0xb7, 0xb0, 0xb9, 0xbe, 0xab, 0xac, 0xa5, 0xa2,
+        0x8f, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9d, 0x9a,
+        0x27, 0x20, 0x29, 0x2e, 0x3b, 0x3c, 0x35, 0x32,
+        0x1f, 0x18, 0x11, 0x16, 0x03, 0x04, 0x0d, 0x0a,
+        0x57, 0x50, 0x59, 0x5e, 0x4b, 0x4c, 0x45, 0x42,
+        0x6f, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7d, 0x7a,
+        0x89, 0x8e, 0x87, 0x80, 0x95, 0x92, 0x9b, 0x9c,
+        0xb1, 0xb6, 0xbf, 0xb8, 0xad, 0xaa, 0xa3, 0xa4,
+        0xf9, 0xfe, 0xf7, 0xf0, 0xe5, 0xe2, 0xeb, 0xec,
+        0xc1, 0xc6, 0xcf, 0xc8, 0xdd, 0xda, 0xd3, 0xd4,
+        0x69, 0x6e, 0x67, 0x60, 0x75, 0x72, 0x7b, 0x7c,
+        0x51, 0x56, 0x5f, 0x58, 0x4d, 0x4a, 0x43, 0x44,
+        0x19, 0x1e, 0x17, 0x10, 0x05, 0x02, 0x0b, 0x0c,
+        0x21, 0x26, 0x2f, 0x28, 0x3d, 0x3a, 0x33, 0x34,
+        0x4e, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5c, 0x5b,
+        0x76, 0x71, 0x78, 0x7f, 0x6a, 0x6d, 0x64, 0x63,
+        0x3e, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2c, 0x2b,
+        0x06, 0x01, 0x08, 0x0f, 0x1a, 0x1d, 0x14, 0x13,
+        0xae, 0xa9, 0xa0, 0xa7, 0xb2, 0xb5, 0xbc, 0xbb,
+        0x96, 0x91, 0x98, 0x9f, 0x8a, 0x8d, 0x84, 0x83,
+        0xde, 0xd9, 0xd0, 0xd7, 0xc2, 0xc5, 0xcc, 0xcb,
+        0xe6, 0xe1, 0xe8, 0xef, 0xfa, 0xfd, 0xf4, 0xf3
+    },
+    {
+        0x00, 0x15, 0x2a, 0x3f, 0x54, 0x41, 0x7e, 0x6b,
+        0xa8, 0xbd, 0x82, 0x97, 0xfc, 0xe9, 0xd6, 0xc3,
+        0x57, 0x42, 0x7d, 0x68, 0x03, 0x16, 0x29, 0x3c,
+        0xff, 0xea, 0xd5, 0xc0, 0xab, 0xbe, 0x81, 0x94,
+        0xae, 0xbb, 0x84, 0x91, 0xfa, 0xef, 0xd0, 0xc5,
+        0x06, 0x13, 0x2c, 0x39, 0x52, 0x47, 0x78, 0x6d,
+        0xf9, 0xec, 0xd3, 0xc6, 0xad, 0xb8, 0x87, 0x92,
+        0x51, 0x44, 0x7b, 0x6e, 0x05, 0x10, 0x2f, 0x3a,
+        0x5b, 0x4e, 0x71, 0x64, 0x0f, 0x1a, 0x25, 0x30,
+        0xf3, 0xe6, 0xd9, 0xcc, 0xa7, 0xb2, 0x8d, 0x98,
+        0x0c, 0x19, 0x26, 0x33, 0x58, 0x4d, 0x72, 0x67,
+        0xa4, 0xb1, 0x8e, 0x9b, 0xf0, 0xe5, 0xda, 0xcf,
+        0xf5, 0xe0, 0xdf, 0xca, 0xa1, 0xb4, 0x8b, 0x9e,
+        0x5d, 0x48, 0x77, 0x62, 0x09, 0x1c, 0x23, 0x36,
+        0xa2, 0xb7, 0x88, 0x9d, 0xf6, 0xe3, 0xdc, 0xc9,
+        0x0a, 0x1f, 0x20, 0x35, 0x5e, 0x4b, 0x74, 0x61,
+        0xb6, 0xa3, 0x9c, 0x89, 0xe2, 0xf7, 0xc8, 0xdd,
+        0x1e, 0x0b, 0x34, 0x21, 0x4a, 0x5f, 0x60, 0x75,
+        0xe1, 0xf4, 0xcb, 0xde, 0xb5, 0xa0, 0x9f, 0x8a,
+        0x49, 0x5c, 0x63, 0x76, 0x1d, 0x08, 0x37, 0x22,
+        0x18, 0x0d, 0x32, 0x27, 0x4c, 0x59, 0x66, 0x73,
+        0xb0, 0xa5, 0x9a, 0x8f, 0xe4, 0xf1, 0xce, 0xdb,
+        0x4f, 0x5a, 0x65, 0x70, 0x1b, 0x0e, 0x31, 0x24,
+        0xe7, 0xf2, 0xcd, 0xd8, 0xb3, 0xa6, 0x99, 0x8c,
+        0xed, 0xf8, 0xc7, 0xd2, 0xb9, 0xac, 0x93, 0x86,
+        0x45, 0x50, 0x6f, 0x7a, 0x11, 0x04, 0x3b, 0x2e,
+        0xba, 0xaf, 0x90, 0x85, 0xee, 0xfb, 0xc4, 0xd1,
+        0x12, 0x07, 0x38, 0x2d, 0x46, 0x53, 0x6c, 0x79,
+        0x43, 0x56, 0x69, 0x7c, 0x17, 0x02, 0x3d, 0x28,
+        0xeb, 0xfe, 0xc1, 0xd4, 0xbf, 0xaa, 0x95, 0x80,
+        0x14, 0x01, 0x3e, 0x2b, 0x40, 0x55, 0x6a, 0x7f,
+        0xbc, 0xa9, 0x96, 0x83, 0xe8, 0xfd, 0xc2, 0xd7
+    },
+    {
+        0x00, 0x6b, 0xd6, 0xbd, 0xab, 0xc0, 0x7d, 0x16,
+        0x51, 0x3a, 0x87, 0xec, 0xfa, 0x91, 0x2c, 0x47,
+        0xa2, 0xc9, 0x74, 0x1f, 0x09, 0x62, 0xdf, 0xb4,
+        0xf3, 0x98, 0x25, 0x4e, 0x58, 0x33, 0x8e, 0xe5,
+        0x43, 0x28, 0x95, 0xfe, 0xe8, 0x83, 0x3e, 0x55,
+        0x12, 0x79, 0xc4, 0xaf, 0xb9, 0xd2, 0x6f, 0x04,
+        0xe1, 0x8a, 0x37, 0x5c, 0x4a, 0x21, 0x9c, 0xf7,
+        0xb0, 0xdb, 0x66, 0x0d, 0x1b, 0x70, 0xcd, 0xa6,
+        0x86, 0xed, 0x50, 0x3b, 0x2d, 0x46, 0xfb, 0x90,
+        0xd7, 0xbc, 0x01, 0x6a, 0x7c, 0x17, 0xaa, 0xc1,
+        0x24, 0x4f, 0xf2, 0x99, 0x8f, 0xe4, 0x59, 0x32,
+        0x75, 0x1e, 0xa3, 0xc8, 0xde, 0xb5, 0x08, 0x63,
+        0xc5, 0xae, 0x13, 0x78, 0x6e, 0x05, 0xb8, 0xd3,
+        0x94, 0xff, 0x42, 0x29, 0x3f, 0x54, 0xe9, 0x82,
+        0x67, 0x0c, 0xb1, 0xda, 0xcc, 0xa7, 0x1a, 0x71,
+        0x36, 0x5d, 0xe0, 0x8b, 0x9d, 0xf6, 0x4b, 0x20,
+        0x0b, 0x60, 0xdd, 0xb6, 0xa0, 0xcb, 0x76, 0x1d,
+        0x5a, 0x31, 0x8c, 0xe7, 0xf1, 0x9a, 0x27, 0x4c,
+        0xa9, 0xc2, 0x7f, 0x14, 0x02, 0x69, 0xd4, 0xbf,
+        0xf8, 0x93, 0x2e, 0x45, 0x53, 0x38, 0x85, 0xee,
+        0x48, 0x23, 0x9e, 0xf5, 0xe3, 0x88, 0x35, 0x5e,
+        0x19, 0x72, 0xcf, 0xa4, 0xb2, 0xd9, 0x64, 0x0f,
+        0xea, 0x81, 0x3c, 0x57, 0x41, 0x2a, 0x97, 0xfc,
+        0xbb, 0xd0, 0x6d, 0x06, 0x10, 0x7b, 0xc6, 0xad,
+        0x8d, 0xe6, 0x5b, 0x30, 0x26, 0x4d, 0xf0, 0x9b,
+        0xdc, 0xb7, 0x0a, 0x61, 0x77, 0x1c, 0xa1, 0xca,
+        0x2f, 0x44, 0xf9, 0x92, 0x84, 0xef, 0x52, 0x39,
+        0x7e, 0x15, 0xa8, 0xc3, 0xd5, 0xbe, 0x03, 0x68,
+        0xce, 0xa5, 0x18, 0x73, 0x65, 0x0e, 0xb3, 0xd8,
+        0x9f, 0xf4, 0x49, 0x22, 0x34, 0x5f, 0xe2, 0x89,
+        0x6c, 0x07, 0xba, 0xd1, 0xc7, 0xac, 0x11, 0x7a,
+        0x3d, 0x56, 0xeb, 0x80, 0x96, 0xfd, 0x40, 0x2b
+    },
+    {
+        0x00, 0x16, 0x2c, 0x3a, 0x58, 0x4e, 0x74, 0x62,
+        0xb0, 0xa6, 0x9c, 0x8a, 0xe8, 0xfe, 0xc4, 0xd2,
+        0x67, 0x71, 0x4b, 0x5d, 0x3f, 0x29, 0x13, 0x05,
+        0xd7, 0xc1, 0xfb, 0xed, 0x8f, 0x99, 0xa3, 0xb5,
+        0xce, 0xd8, 0xe2, 0xf4, 0x96, 0x80, 0xba, 0xac,
+        0x7e, 0x68, 0x52, 0x44, 0x26, 0x30, 0x0a, 0x1c,
+        0xa9, 0xbf, 0x85, 0x93, 0xf1, 0xe7, 0xdd, 0xcb,
+        0x19, 0x0f, 0x35, 0x23, 0x41, 0x57, 0x6d, 0x7b,
+        0x9b, 0x8d, 0xb7, 0xa1, 0xc3, 0xd5, 0xef, 0xf9,
+        0x2b, 0x3d, 0x07, 0x11, 0x73, 0x65, 0x5f, 0x49,
+        0xfc, 0xea, 0xd0, 0xc6, 0xa4, 0xb2, 0x88, 0x9e,
+        0x4c, 0x5a, 0x60, 0x76, 0x14, 0x02, 0x38, 0x2e,
+        0x55, 0x43, 0x79, 0x6f, 0x0d, 0x1b, 0x21, 0x37,
+        0xe5, 0xf3, 0xc9, 0xdf, 0xbd, 0xab, 0x91, 0x87,
+        0x32, 0x24, 0x1e, 0x08, 0x6a, 0x7c, 0x46, 0x50,
+        0x82, 0x94, 0xae, 0xb8, 0xda, 0xcc, 0xf6, 0xe0,
+        0x31, 0x27, 0x1d, 0x0b, 0x69, 0x7f, 0x45, 0x53,
+        0x81, 0x97, 0xad, 0xbb, 0xd9, 0xcf, 0xf5, 0xe3,
+        0x56, 0x40, 0x7a, 0x6c, 0x0e, 0x18, 0x22, 0x34,
+        0xe6, 0xf0, 0xca, 0xdc, 0xbe, 0xa8, 0x92, 0x84,
+        0xff, 0xe9, 0xd3, 0xc5, 0xa7, 0xb1, 0x8b, 0x9d,
+        0x4f, 0x59, 0x63, 0x75, 0x17, 0x01, 0x3b, 0x2d,
+        0x98, 0x8e, 0xb4, 0xa2, 0xc0, 0xd6, 0xec, 0xfa,
+        0x28, 0x3e, 0x04, 0x12, 0x70, 0x66, 0x5c, 0x4a,
+        0xaa, 0xbc, 0x86, 0x90, 0xf2, 0xe4, 0xde, 0xc8,
+        0x1a, 0x0c, 0x36, 0x20, 0x42, 0x54, 0x6e, 0x78,
+        0xcd, 0xdb, 0xe1, 0xf7, 0x95, 0x83, 0xb9, 0xaf,
+        0x7d, 0x6b, 0x51, 0x47, 0x25, 0x33, 0x09, 0x1f,
+        0x64, 0x72, 0x48, 0x5e, 0x3c, 0x2a, 0x10, 0x06,
+        0xd4, 0xc2, 0xf8, 0xee, 0x8c, 0x9a, 0xa0, 0xb6,
+        0x03, 0x15, 0x2f, 0x39, 0x5b, 0x4d, 0x77, 0x61,
+        0xb3, 0xa5, 0x9f, 0x89, 0xeb, 0xfd, 0xc7, 0xd1
+    }
+};
+#elif LIBFRAMES_CRC == 16
+static const uint16_t crc_table[4][256] = {
+    {
+        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+        0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+        0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6,
+        0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
+        0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485,
+        0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
+        0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4,
+        0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
+        0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
+        0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
+        0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12,
+        0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
+        0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41,
+        0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
+        0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70,
+        0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
+        0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f,
+        0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
+        0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e,
+        0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
+        0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d,
+        0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+        0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c,
+        0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
+        0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab,
+        0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
+        0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
+        0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
+        0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9,
+        0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
+        0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8,
+        0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0
+    },
+    {
+        0x0000, 0x3331, 0x6662, 0x5553, 0xccc4, 0xfff5, 0xaaa6, 0x9997,
+        0x89a9, 0xba98, 0xefcb, 0xdcfa, 0x456d, 0x765c, 0x230f, 0x103e,
+        0x0373, 0x3042, 0x6511, 0x5620, 0xcfb7, 0xfc86, 0xa9d5, 0x9ae4,
+        0x8ada, 0xb9eb, 0xecb8, 0xdf89, 0x461e, 0x752f, 0x207c, 0x134d,
+        0x06e6, 0x35d7, 0x6084, 0x53b5, 0xca22, 0xf913, 0xac40, 0x9f71,
+        0x8f4f, 0xbc7e, 0xe92d, 0xda1c, 0x438b, 0x70ba, 0x25e9, 0x16d8,
+        0x0595, 0x36a4, 0x63f7, 0x50c6, 0xc951, 0xfa60, 0xaf33, 0x9c02,
+        0x8c3c, 0xbf0d, 0xea5e, 0xd96f, 0x40f8, 0x73c9, 0x269a, 0x15ab,
+        0x0dcc, 0x3efd, 0x6bae, 0x589f, 0xc108, 0xf239, 0xa76a, 0x945b,
+        0x8465, 0xb754, 0xe207, 0xd136, 0x48a1, 0x7b90, 0x2ec3, 0x1df2,
+        0x0ebf, 0x3d8e, 0x68dd, 0x5bec, 0xc27b, 0xf14a, 0xa419, 0x9728,
+        0x8716, 0xb427, 0xe174, 0xd245, 0x4bd2, 0x78e3, 0x2db0, 0x1e81,
+        0x0b2a, 0x381b, 0x6d48, 0x5e79, 0xc7ee, 0xf4df, 0xa18c, 0x92bd,
+        0x8283, 0xb1b2, 0xe4e1, 0xd7d0, 0x4e47, 0x7d76, 0x2825, 0x1b14,
+        0x0859, 0x3b68, 0x6e3b, 0x5d0a, 0xc49d, 0xf7ac, 0xa2ff, 0x91ce,
+        0x81f0, 0xb2c1, 0xe792, 0xd4a3, 0x4d34, 0x7e05, 0x2b56, 0x1867,
+        0x1b98, 0x28a9, 0x7dfa, 0x4ecb, 0xd75c, 0xe46d, 0xb13e, 0x820f,
+        0x9231, 0xa100, 0xf453, 0xc762, 0x5ef5, 0x6dc4, 0x3897, 0x0ba6,
+        0x18eb, 0x2bda, 0x7e89, 0x4db8, 0xd42f, 0xe71e, 0xb24d, 0x817c,
+        0x9142, 0xa273, 0xf720, 0xc411, 0x5d86, 0x6eb7, 0x3be4, 0x08d5,
+        0x1d7e, 0x2e4f, 0x7b1c, 0x482d, 0xd1ba, 0xe28b, 0xb7d8, 0x84e9,
+        0x94d7, 0xa7e6, 0xf2b5, 0xc184, 0x5813, 0x6b22, 0x3e71, 0x0d40,
+        0x1e0d, 0x2d3c, 0x786f, 0x4b5e, 0xd2c9, 0xe1f8, 0xb4ab, 0x879a,
+        0x97a4, 0xa495, 0xf1c6, 0xc2f7, 0x5b60, 0x6851, 0x3d02, 0x0e33,
+        0x1654, 0x2565, 0x7036, 0x4307, 0xda90, 0xe9a1, 0xbcf2, 0x8fc3,
+        0x9ffd, 0xaccc, 0xf99f, 0xcaae, 0x5339, 0x6008, 0x355b, 0x066a,
+        0x1527, 0x2616, 0x7345, 0x4074, 0xd9e3, 0xead2, 0xbf81, 0x8cb0,
+        0x9c8e, 0xafbf, 0xfaec, 0xc9dd, 0x504a, 0x637b, 0x3628, 0x0519,
+        0x10b2, 0x2383, 0x76d0, 0x45e1, 0xdc76, 0xef47, 0xba14, 0x8925,
+        0x991b, 0xaa2a, 0xff79, 0xcc48, 0x55df, 0x66ee, 0x33bd, 0x008c,
+        0x13c1, 0x20f0, 0x75a3, 0x4692, 0xdf05, 0xec34, 0xb967, 0x8a56,
+        0x9a68, 0xa959, 0xfc0a, 0xcf3b, 0x56ac, 0x659d, 0x30ce, 0x03ff
+    },
+    {
+        0x0000, 0x3730, 0x6e60, 0x5950, 0xdcc0, 0xebf0, 0xb2a0, 0x8590,
+        0xa9a1, 0x9e91, 0xc7c1, 0xf0f1, 0x7561, 0x4251, 0x1b01, 0x2c31,
+        0x4363, 0x7453, 0x2d03, 0x1a33, 0x9fa3, 0xa893, 0xf1c3, 0xc6f3,
+        0xeac2, 0xddf2, 0x84a2, 0xb392, 0x3602, 0x0132, 0x5862, 0x6f52,
+        0x86c6, 0xb1f6, 0xe8a6, 0xdf96, 0x5a06, 0x6d36, 0x3466, 0x0356,
+        0x2f67, 0x1857, 0x4107, 0x7637, 0xf3a7, 0xc497, 0x9dc7, 0xaaf7,
+        0xc5a5, 0xf295, 0xabc5, 0x9cf5, 0x1965, 0x2e55, 0x7705, 0x4035,
+        0x6c04, 0x5b34, 0x0264, 0x3554, 0xb0c4, 0x87f4, 0xdea4, 0xe994,
+        0x1dad, 0x2a9d, 0x73cd, 0x44fd, 0xc16d, 0xf65d, 0xaf0d, 0x983d,
+        0xb40c, 0x833c, 0xda6c, 0xed5c, 0x68cc, 0x5ffc, 0x06ac, 0x319c,
+        0x5ece, 0x69fe, 0x30ae, 0x079e, 0x820e, 0xb53e, 0xec6e, 0xdb5e,
+        0xf76f, 0xc05f, 0x990f, 0xae3f, 0x2baf, 0x1c9f, 0x45cf, 0x72ff,
+        0x9b6b, 0xac5b, 0xf50b, 0xc23b, 0x47ab, 0x709b, 0x29cb, 0x1efb,
+        0x32ca, 0x05fa, 0x5caa, 0x6b9a, 0xee0a, 0xd93a, 0x806a, 0xb75a,
+        0xd808, 0xef38, 0xb668, 0x8158, 0x04c8, 0x33f8, 0x6aa8, 0x5d98,
+        0x71a9, 0x4699, 0x1fc9, 0x28f9, 0xad69, 0x9a59, 0xc309, 0xf439,
+        0x3b5a, 0x0c6a, 0x553a, 0x620a, 0xe79a, 0xd0aa, 0x89fa, 0xbeca,
+        0x92fb, 0xa5cb, 0xfc9b, 0xcbab, 0x4e3b, 0x790b, 0x205b, 0x176b,
+        0x7839, 0x4f09, 0x1659, 0x2169, 0xa4f9, 0x93c9, 0xca99, 0xfda9,
+        0xd198, 0xe6a8, 0xbff8, 0x88c8, 0x0d58, 0x3a68, 0x6338, 0x5408,
+        0xbd9c, 0x8aac, 0xd3fc, 0xe4cc, 0x615c, 0x566c, 0x0f3c, 0x380c,
+        0x143d, 0x230d, 0x7a5d, 0x4d6d, 0xc8fd, 0xffcd, 0xa69d, 0x91ad,
+        0xfeff, 0xc9cf, 0x909f, 0xa7af, 0x223f, 0x150f, 0x4c5f, 0x7b6f,
+        0x575e, 0x606e, 0x393e, 0x0e0e, 0x8b9e, 0xbcae, 0xe5fe, 0xd2ce,
+        0x26f7, 0x11c7, 0x4897, 0x7fa7, 0xfa37, 0xcd07, 0x9457, 0xa367,
+        0x8f56, 0xb866, 0xe136, 0xd606, 0x5396, 0x64a6, 0x3df6, 0x0ac6,
+        0x6594, 0x52a4, 0x0bf4, 0x3cc4, 0xb954, 0x8e64, 0xd734, 0xe004,
+        0xcc35, 0xfb05, 0xa255, 0x9565, 0x10f5, 0x27c5, 0x7e95, 0x49a5,
+        0xa031, 0x9701, 0xce51, 0xf961, 0x7cf1, 0x4bc1, 0x1291, 0x25a1,
+        0x0990, 0x3ea0, 0x67f0, 0x50c0, 0xd550, 0xe260, 0xbb30, 0x8c00,
+        0xe352, 0xd462, 0x8d32, 0xba02, 0x3f92, 0x08a2, 0x51f2, 0x66c2,
+        0x4af3, 0x7dc3, 0x2493, 0x13a3, 0x9633, 0xa103, 0xf853, 0xcf63
+    },
+    {
+        0x0000, 0x76b4, 0xed68, 0x9bdc, 0xcaf1, 0xbc45, 0x2799, 0x512d,
+        0x85c3, 0xf377, 0x68ab, 0x1e1f, 0x4f32, 0x3986, 0xa25a, 0xd4ee,
+        0x1ba7, 0x6d13, 0xf6cf, 0x807b, 0xd156, 0xa7e2, 0x3c3e, 0x4a8a,
+        0x9e64, 0xe8d0, 0x730c, 0x05b8, 0x5495, 0x2221, 0xb9fd, 0xcf49,
+        0x374e, 0x41fa, 0xda26, 0xac92, 0xfdbf, 0x8b0b, 0x10d7, 0x6663,
+        0xb28d, 0xc439, 0x5fe5, 0x2951, 0x787c, 0x0ec8, 0x9514, 0xe3a0,
+        0x2ce9, 0x5a5d, 0xc181, 0xb735, 0xe618, 0x90ac, 0x0b70, 0x7dc4,
+        0xa92a, 0xdf9e, 0x4442, 0x32f6, 0x63db, 0x156f, 0x8eb3, 0xf807,
+        0x6e9c, 0x1828, 0x83f4, 0xf540, 0xa46d, 0xd2d9, 0x4905, 0x3fb1,
+        0xeb5f, 0x9deb, 0x0637, 0x7083, 0x21ae, 0x571a, 0xccc6, 0xba72,
+        0x753b, 0x038f, 0x9853, 0xeee7, 0xbfca, 0xc97e, 0x52a2, 0x2416,
+        0xf0f8, 0x864c, 0x1d90, 0x6b24, 0x3a09, 0x4cbd, 0xd761, 0xa1d5,
+        0x59d2, 0x2f66, 0xb4ba, 0xc20e, 0x9323, 0xe597, 0x7e4b, 0x08ff,
+        0xdc11, 0xaaa5, 0x3179, 0x47cd, 0x16e0, 0x6054, 0xfb88, 0x8d3c,
+        0x4275, 0x34c1, 0xaf1d, 0xd9a9, 0x8884, 0xfe30, 0x65ec, 0x1358,
+        0xc7b6, 0xb102, 0x2ade, 0x5c6a, 0x0d47, 0x7bf3, 0xe02f, 0x969b,
+        0xdd38, 0xab8c, 0x3050, 0x46e4, 0x17c9, 0x617d, 0xfaa1, 0x8c15,
+        0x58fb, 0x2e4f, 0xb593, 0xc327, 0x920a, 0xe4be, 0x7f62, 0x09d6,
+        0xc69f, 0xb02b, 0x2bf7, 0x5d43, 0x0c6e, 0x7ada, 0xe106, 0x97b2,
+        0x435c, 0x35e8, 0xae34, 0xd880, 0x89ad, 0xff19, 0x64c5, 0x1271,
+        0xea76, 0x9cc2, 0x071e, 0x71aa, 0x2087, 0x5633, 0xcdef, 0xbb5b,
+        0x6fb5, 0x1901, 0x82dd, 0xf469, 0xa544, 0xd3f0, 0x482c, 0x3e98,
+        0xf1d1, 0x8765, 0x1cb9, 0x6a0d, 0x3b20, 0x4d94, 0xd648, 0xa0fc,
+        0x7412, 0x02a6, 0x997a, 0xefce, 0xbee3, 0xc857, 0x538b, 0x253f,
+        0xb3a4, 0xc510, 0x5ecc, 0x2878, 0x7955, 0x0fe1, 0x943d, 0xe289,
+        0x3667, 0x40d3, 0xdb0f, 0xadbb, 0xfc96, 0x8a22, 0x11fe, 0x674a,
+        0xa803, 0xdeb7, 0x456b, 0x33df, 0x62f2, 0x1446, 0x8f9a, 0xf92e,
+        0x2dc0, 0x5b74, 0xc0a8, 0xb61c, 0xe731, 0x9185, 0x0a59, 0x7ced,
+        0x84ea, 0xf25e, 0x6982, 0x1f36, 0x4e1b, 0x38af, 0xa373, 0xd5c7,
+        0x0129, 0x779d, 0xec41, 0x9af5, 0xcbd8, 0xbd6c, 0x26b0, 0x5004,
+        0x9f4d, 0xe9f9, 0x7225, 0x0491, 0x55bc, 0x2308, 0xb8d4, 0xce60,
+        0x1a8e, 0x6c3a, 0xf7e6, 0x8152, 0xd07f, 0xa6cb, 0x3d17, 0x4ba3
+    }
+};
+#elif !defined(LIBFRAMES_CRC32C_HW)
+static const uint32_t crc_table[4][256] = {
+    {
+        0x00000000, 0xf26b8303, 0xe13b70f7, 0x1350f3f4, 0xc79a971f, 0x35f1141c, 0x26a1e7e8, 0xd4ca64eb,
+        0x8ad958cf, 0x78b2dbcc, 0x6be22838, 0x9989ab3b, 0x4d43cfd0, 0xbf284cd3, 0xac78bf27, 0x5e133c24,
+        0x105ec76f, 0xe235446c, 0xf165b798, 0x030e349b, 0xd7c45070, 0x25afd373, 0x36ff2087, 0xc494a384,
+        0x9a879fa0, 0x68ec1ca3, 0x7bbcef57, 0x89d76c54, 0x5d1d08bf, 0xaf768bbc, 0xbc267848, 0x4e4dfb4b,
+        0x20bd8ede, 0xd2d60ddd, 0xc186fe29, 0x33ed7d2a, 0xe72719c1, 0x154c9ac2, 0x061c6936, 0xf477ea35,
+        0xaa64d611, 0x580f5512, 0x4b5fa6e6, 0xb93425e5, 0x6dfe410e, 0x9f95c20d, 0x8cc531f9, 0x7eaeb2fa,
+        0x30e349b1, 0xc288cab2, 0xd1d83946, 0x23b3ba45, 0xf779deae, 0x05125dad, 0x1642ae59, 0xe4292d5a,
+        0xba3a117e, 0x4851927d, 0x5b016189, 0xa96ae28a, 0x7da08661, 0x8fcb0562, 0x9c9bf696, 0x6ef07595,
+        0x417b1dbc, 0xb3109ebf, 0xa0406d4b, 0x522bee48, 0x86e18aa3, 0x748a09a0, 0x67dafa54, 0x95b17957,
+        0xcba24573, 0x39c9c670, 0x2a993584, 0xd8f2b687, 0x0c38d26c, 0xfe53516f, 0xed03a29b, 0x1f682198,
+        0x5125dad3, 0xa34e59d0, 0xb01eaa24, 0x42752927, 0x96bf4dcc, 0x64d4cecf, 0x77843d3b, 0x85efbe38,
+        0xdbfc821c, 0x2997011f, 0x3ac7f2eb, 0xc8ac71e8, 0x1c661503, 0xee0d9600, 0xfd5d65f4, 0x0f36e6f7,
+        0x61c69362, 0x93ad1061, 0x80fde395, 0x72966096, 0xa65c047d, 0x5437877e, 0x4767748a, 0xb50cf789,
+        0xeb1fcbad, 0x197448ae, 0x0a24bb5a, 0xf84f3859, 0x2c855cb2, 0xdeeedfb1, 0xcdbe2c45, 0x3fd5af46,
+        0x7198540d, 0x83f3d70e, 0x90a324fa, 0x62c8a7f9, 0xb602c312, 0x44694011, 0x5739b3e5, 0xa55230e6,
+        0xfb410cc2, 0x092a8fc1, 0x1a7a7c35, 0xe811ff36, 0x3cdb9bdd, 0xceb018de, 0xdde0eb2a, 0x2f8b6829,
+        0x82f63b78, 0x709db87b, 0x63cd4b8f, 0x91a6c88c, 0x456cac67, 0xb7072f64, 0xa457dc90, 0x563c5f93,
+        0x082f63b7, 0xfa44e0b4, 0xe9141340, 0x1b7f9043, 0xcfb5f4a8, 0x3dde77ab, 0x2e8e845f, 0xdce5075c,
+        0x92a8fc17, 0x60c37f14, 0x73938ce0, 0x81f80fe3, 0x55326b08, 0xa759e80b, 0xb4091bff, 0x466298fc,
+        0x1871a4d8, 0xea1a27db, 0xf94ad42f, 0x0b21572c, 0xdfeb33c7, 0x2d80b0c4, 0x3ed04330, 0xccbbc033,
+        0xa24bb5a6, 0x502036a5, 0x4370c551, 0xb11b4652, 0x65d122b9, 0x97baa1ba, 0x84ea524e, 0x7681d14d,
+        0x2892ed69, 0xdaf96e6a, 0xc9a99d9e, 0x3bc21e9d, 0xef087a76, 0x1d63f975, 0x0e330a81, 0xfc588982,
+        0xb21572c9, 0x407ef1ca, 0x532e023e, 0xa145813d, 0x758fe5d6, 0x87e466d5, 0x94b49521, 0x66df1622,
+        0x38cc2a06, 0xcaa7a905, 0xd9f75af1, 0x2b9cd9f2, 0xff56bd19, 0x0d3d3e1a, 0x1e6dcdee, 0xec064eed,
+        0xc38d26c4, 0x31e6a5c7, 0x22b65633, 0xd0ddd530, 0x0417b1db, 0xf67c32d8, 0xe52cc12c, 0x1747422f,
+        0x49547e0b, 0xbb3ffd08, 0xa86f0efc, 0x5a048dff, 0x8ecee914, 0x7ca56a17, 0x6ff599e3, 0x9d9e1ae0,
+        0xd3d3e1ab, 0x21b862a8, 0x32e8915c, 0xc083125f, 0x144976b4, 0xe622f5b7, 0xf5720643, 0x07198540,
+        0x590ab964, 0xab613a67, 0xb831c993, 0x4a5a4a90, 0x9e902e7b, 0x6cfbad78, 0x7fab5e8c, 0x8dc0dd8f,
+        0xe330a81a, 0x115b2b19, 0x020bd8ed, 0xf0605bee, 0x24aa3f05, 0xd6c1bc06, 0xc5914ff2, 0x37faccf1,
+        0x69e9f0d5, 0x9b8273d6, 0x88d28022, 0x7ab90321, 0xae7367ca, 0x5c18e4c9, 0x4f48173d, 0xbd23943e,
+        0xf36e6f75, 0x0105ec76, 0x12551f82, 0xe03e9c81, 0x34f4f86a, 0xc69f7b69, 0xd5cf889d, 0x27a40b9e,
+        0x79b737ba, 0x8bdcb4b9, 0x988c474d, 0x6ae7c44e, 0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351
+    },
+    {
+        0x00000000, 0x13a29877, 0x274530ee, 0x34e7a899, 0x4e8a61dc, 0x5d28f9ab, 0x69cf5132, 0x7a6dc945,
+        0x9d14c3b8, 0x8eb65bcf, 0xba51f356, 0xa9f36b21, 0xd39ea264, 0xc03c3a13, 0xf4db928a, 0xe7790afd,
+        0x3fc5f181, 0x2c6769f6, 0x1880c16f, 0x0b225918, 0x714f905d, 0x62ed082a, 0x560aa0b3, 0x45a838c4,
+        0xa2d13239, 0xb173aa4e, 0x859402d7, 0x96369aa0, 0xec5b53e5, 0xfff9cb92, 0xcb1e630b, 0xd8bcfb7c,
+        0x7f8be302, 0x6c297b75, 0x58ced3ec, 0x4b6c4b9b, 0x310182de, 0x22a31aa9, 0x1644b230, 0x05e62a47,
+        0xe29f20ba, 0xf13db8cd, 0xc5da1054, 0xd6788823, 0xac154166, 0xbfb7d911, 0x8b507188, 0x98f2e9ff,
+        0x404e1283, 0x53ec8af4, 0x670b226d, 0x74a9ba1a, 0x0ec4735f, 0x1d66eb28, 0x298143b1, 0x3a23dbc6,
+        0xdd5ad13b, 0xcef8494c, 0xfa1fe1d5, 0xe9bd79a2, 0x93d0b0e7, 0x80722890, 0xb4958009, 0xa737187e,
+        0xff17c604, 0xecb55e73, 0xd852f6ea, 0xcbf06e9d, 0xb19da7d8, 0xa23f3faf, 0x96d89736, 0x857a0f41,
+        0x620305bc, 0x71a19dcb, 0x45463552, 0x56e4ad25, 0x2c896460, 0x3f2bfc17, 0x0bcc548e, 0x186eccf9,
+        0xc0d23785, 0xd370aff2, 0xe797076b, 0xf4359f1c, 0x8e585659, 0x9dface2e, 0xa91d66b7, 0xbabffec0,
+        0x5dc6f43d, 0x4e646c4a, 0x7a83c4d3, 0x69215ca4, 0x134c95e1, 0x00ee0d96, 0x3409a50f, 0x27ab3d78,
+        0x809c2506, 0x933ebd71, 0xa7d915e8, 0xb47b8d9f, 0xce1644da, 0xddb4dcad, 0xe9537434, 0xfaf1ec43,
+        0x1d88e6be, 0x0e2a7ec9, 0x3acdd650, 0x296f4e27, 0x53028762, 0x40a01f15, 0x7447b78c, 0x67e52ffb,
+        0xbf59d487, 0xacfb4cf0, 0x981ce469, 0x8bbe7c1e, 0xf1d3b55b, 0xe2712d2c, 0xd69685b5, 0xc5341dc2,
+        0x224d173f, 0x31ef8f48, 0x050827d1, 0x16aabfa6, 0x6cc776e3, 0x7f65ee94, 0x4b82460d, 0x5820de7a,
+        0xfbc3faf9, 0xe861628e, 0xdc86ca17, 0xcf245260, 0xb5499b25, 0xa6eb0352, 0x920cabcb, 0x81ae33bc,
+        0x66d73941, 0x7575a136, 0x419209af, 0x523091d8, 0x285d589d, 0x3bffc0ea, 0x0f186873, 0x1cbaf004,
+        0xc4060b78, 0xd7a4930f, 0xe3433b96, 0xf0e1a3e1, 0x8a8c6aa4, 0x992ef2d3, 0xadc95a4a, 0xbe6bc23d,
+        0x5912c8c0, 0x4ab050b7, 0x7e57f82e, 0x6df56059, 0x1798a91c, 0x043a316b, 0x30dd99f2, 0x237f0185,
+        0x844819fb, 0x97ea818c, 0xa30d2915, 0xb0afb162, 0xcac27827, 0xd960e050, 0xed8748c9, 0xfe25d0be,
+        0x195cda43, 0x0afe4234, 0x3e19eaad, 0x2dbb72da, 0x57d6bb9f, 0x447423e8, 0x70938b71, 0x63311306,
+        0xbb8de87a, 0xa82f700d, 0x9cc8d894, 0x8f6a40e3, 0xf50789a6, 0xe6a511d1, 0xd242b948, 0xc1e0213f,
+        0x26992bc2, 0x353bb3b5, 0x01dc1b2c, 0x127e835b, 0x68134a1e, 0x7bb1d269, 0x4f567af0, 0x5cf4e287,
+        0x04d43cfd, 0x1776a48a, 0x23910c13, 0x30339464, 0x4a5e5d21, 0x59fcc556, 0x6d1b6dcf, 0x7eb9f5b8,
+        0x99c0ff45, 0x8a626732, 0xbe85cfab, 0xad2757dc, 0xd74a9e99, 0xc4e806ee, 0xf00fae77, 0xe3ad3600,
+        0x3b11cd7c, 0x28b3550b, 0x1c54fd92, 0x0ff665e5, 0x759baca0, 0x663934d7, 0x52de9c4e, 0x417c0439,
+        0xa6050ec4, 0xb5a796b3, 0x81403e2a, 0x92e2a65d, 0xe88f6f18, 0xfb2df76f, 0xcfca5ff6, 0xdc68c781,
+        0x7b5fdfff, 0x68fd4788, 0x5c1aef11, 0x4fb87766, 0x35d5be23, 0x26772654, 0x12908ecd, 0x013216ba,
+        0xe64b1c47, 0xf5e98430, 0xc10e2ca9, 0xd2acb4de, 0xa8c17d9b, 0xbb63e5ec, 0x8f844d75, 0x9c26d502,
+        0x449a2e7e, 0x5738b609, 0x63df1e90, 0x707d86e7, 0x0a104fa2, 0x19b2d7d5, 0x2d557f4c, 0x3ef7e73b,
+        0xd98eedc6, 0xca2c75b1, 0xfecbdd28, 0xed69455f, 0x97048c1a, 0x84a6146d, 0xb041bcf4, 0xa3e32483
+    },
+    {
+        0x00000000, 0xa541927e, 0x4f6f520d, 0xea2ec073, 0x9edea41a, 0x3b9f3664, 0xd1b1f617, 0x74f06469,
+        0x38513ec5, 0x9d10acbb, 0x773e6cc8, 0xd27ffeb6, 0xa68f9adf, 0x03ce08a1, 0xe9e0c8d2, 0x4ca15aac,
+        0x70a27d8a, 0xd5e3eff4, 0x3fcd2f87, 0x9a8cbdf9, 0xee7cd990, 0x4b3d4bee, 0xa1138b9d, 0x045219e3,
+        0x48f3434f, 0xedb2d131, 0x079c1142, 0xa2dd833c, 0xd62de755, 0x736c752b, 0x9942b558, 0x3c032726,
+        0xe144fb14, 0x4405696a, 0xae2ba919, 0x0b6a3b67, 0x7f9a5f0e, 0xdadbcd70, 0x30f50d03, 0x95b49f7d,
+        0xd915c5d1, 0x7c5457af, 0x967a97dc, 0x333b05a2, 0x47cb61cb, 0xe28af3b5, 0x08a433c6, 0xade5a1b8,
+        0x91e6869e, 0x34a714e0, 0xde89d493, 0x7bc846ed, 0x0f382284, 0xaa79b0fa, 0x40577089, 0xe516e2f7,
+        0xa9b7b85b, 0x0cf62a25, 0xe6d8ea56, 0x43997828, 0x37691c41, 0x92288e3f, 0x78064e4c, 0xdd47dc32,
+        0xc76580d9, 0x622412a7, 0x880ad2d4, 0x2d4b40aa, 0x59bb24c3, 0xfcfab6bd, 0x16d476ce, 0xb395e4b0,
+        0xff34be1c, 0x5a752c62, 0xb05bec11, 0x151a7e6f, 0x61ea1a06, 0xc4ab8878, 0x2e85480b, 0x8bc4da75,
+        0xb7c7fd53, 0x12866f2d, 0xf8a8af5e, 0x5de93d20, 0x29195949, 0x8c58cb37, 0x66760b44, 0xc337993a,
+        0x8f96c396, 0x2ad751e8, 0xc0f9919b, 0x65b803e5, 0x1148678c, 0xb409f5f2, 0x5e273581, 0xfb66a7ff,
+        0x26217bcd, 0x8360e9b3, 0x694e29c0, 0xcc0fbbbe, 0xb8ffdfd7, 0x1dbe4da9, 0xf7908dda, 0x52d11fa4,
+        0x1e704508, 0xbb31d776, 0x511f1705, 0xf45e857b, 0x80aee112, 0x25ef736c, 0xcfc1b31f, 0x6a802161,
+        0x56830647, 0xf3c29439, 0x19ec544a, 0xbcadc634, 0xc85da25d, 0x6d1c3023, 0x8732f050, 0x2273622e,
+        0x6ed23882, 0xcb93aafc, 0x21bd6a8f, 0x84fcf8f1, 0xf00c9c98, 0x554d0ee6, 0xbf63ce95, 0x1a225ceb,
+        0x8b277743, 0x2e66e53d, 0xc448254e, 0x6109b730, 0x15f9d359, 0xb0b84127, 0x5a968154, 0xffd7132a,
+        0xb3764986, 0x1637dbf8, 0xfc191b8b, 0x595889f5, 0x2da8ed9c, 0x88e97fe2, 0x62c7bf91, 0xc7862def,
+        0xfb850ac9, 0x5ec498b7, 0xb4ea58c4, 0x11abcaba, 0x655baed3, 0xc01a3cad, 0x2a34fcde, 0x8f756ea0,
+        0xc3d4340c, 0x6695a672, 0x8cbb6601, 0x29faf47f, 0x5d0a9016, 0xf84b0268, 0x1265c21b, 0xb7245065,
+        0x6a638c57, 0xcf221e29, 0x250cde5a, 0x804d4c24, 0xf4bd284d, 0x51fcba33, 0xbbd27a40, 0x1e93e83e,
+        0x5232b292, 0xf77320ec, 0x1d5de09f, 0xb81c72e1, 0xccec1688, 0x69ad84f6, 0x83834485, 0x26c2d6fb,
+        0x1ac1f1dd, 0xbf8063a3, 0x55aea3d0, 0xf0ef31ae, 0x841f55c7, 0x215ec7b9, 0xcb7007ca, 0x6e3195b4,
+        0x2290cf18, 0x87d15d66, 0x6dff9d15, 0xc8be0f6b, 0xbc4e6b02, 0x190ff97c, 0xf321390f, 0x5660ab71,
+        0x4c42f79a, 0xe90365e4, 0x032da597, 0xa66c37e9, 0xd29c5380, 0x77ddc1fe, 0x9df3018d, 0x38b293f3,
+        0x7413c95f, 0xd1525b21, 0x3b7c9b52, 0x9e3d092c, 0xeacd6d45, 0x4f8cff3b, 0xa5a23f48, 0x00e3ad36,
+        0x3ce08a10, 0x99a1186e, 0x738fd81d, 0xd6ce4a63, 0xa23e2e0a, 0x077fbc74, 0xed517c07, 0x4810ee79,
+        0x04b1b4d5, 0xa1f026ab, 0x4bdee6d8, 0xee9f74a6, 0x9a6f10cf, 0x3f2e82b1, 0xd50042c2, 0x7041d0bc,
+        0xad060c8e, 0x08479ef0, 0xe2695e83, 0x4728ccfd, 0x33d8a894, 0x96993aea, 0x7cb7fa99, 0xd9f668e7,
+        0x9557324b, 0x3016a035, 0xda386046, 0x7f79f238, 0x0b899651, 0xaec8042f, 0x44e6c45c, 0xe1a75622,
+        0xdda47104, 0x78e5e37a, 0x92cb2309, 0x378ab177, 0x437ad51e, 0xe63b4760, 0x0c158713, 0xa954156d,
+        0xe5f54fc1, 0x40b4ddbf, 0xaa9a1dcc, 0x0fdb8fb2, 0x7b2bebdb, 0xde6a79a5, 0x3444b9d6, 0x91052ba8
+    },
+    {
+        0x00000000, 0xdd45aab8, 0xbf672381, 0x62228939, 0x7b2231f3, 0xa6679b4b, 0xc4451272, 0x1900b8ca,
+        0xf64463e6, 0x2b01c95e, 0x49234067, 0x9466eadf, 0x8d665215, 0x5023f8ad, 0x32017194, 0xef44db2c,
+        0xe964b13d, 0x34211b85, 0x560392bc, 0x8b463804, 0x924680ce, 0x4f032a76, 0x2d21a34f, 0xf06409f7,
+        0x1f20d2db, 0xc2657863, 0xa047f15a, 0x7d025be2, 0x6402e328, 0xb9474990, 0xdb65c0a9, 0x06206a11,
+        0xd725148b, 0x0a60be33, 0x6842370a, 0xb5079db2, 0xac072578, 0x71428fc0, 0x136006f9, 0xce25ac41,
+        0x2161776d, 0xfc24ddd5, 0x9e0654ec, 0x4343fe54, 0x5a43469e, 0x8706ec26, 0xe524651f, 0x3861cfa7,
+        0x3e41a5b6, 0xe3040f0e, 0x81268637, 0x5c632c8f, 0x45639445, 0x98263efd, 0xfa04b7c4, 0x27411d7c,
+        0xc805c650, 0x15406ce8, 0x7762e5d1, 0xaa274f69, 0xb327f7a3, 0x6e625d1b, 0x0c40d422, 0xd1057e9a,
+        0xaba65fe7, 0x76e3f55f, 0x14c17c66, 0xc984d6de, 0xd0846e14, 0x0dc1c4ac, 0x6fe34d95, 0xb2a6e72d,
+        0x5de23c01, 0x80a796b9, 0xe2851f80, 0x3fc0b538, 0x26c00df2, 0xfb85a74a, 0x99a72e73, 0x44e284cb,
+        0x42c2eeda, 0x9f874462, 0xfda5cd5b, 0x20e067e3, 0x39e0df29, 0xe4a57591, 0x8687fca8, 0x5bc25610,
+        0xb4868d3c, 0x69c32784, 0x0be1aebd, 0xd6a40405, 0xcfa4bccf, 0x12e11677, 0x70c39f4e, 0xad8635f6,
+        0x7c834b6c, 0xa1c6e1d4, 0xc3e468ed, 0x1ea1c255, 0x07a17a9f, 0xdae4d027, 0xb8c6591e, 0x6583f3a6,
+        0x8ac7288a, 0x57828232, 0x35a00b0b, 0xe8e5a1b3, 0xf1e51979, 0x2ca0b3c1, 0x4e823af8, 0x93c79040,
+        0x95e7fa51, 0x48a250e9, 0x2a80d9d0, 0xf7c57368, 0xeec5cba2, 0x3380611a, 0x51a2e823, 0x8ce7429b,
+        0x63a399b7, 0xbee6330f, 0xdcc4ba36, 0x0181108e, 0x1881a844, 0xc5c402fc, 0xa7e68bc5, 0x7aa3217d,
+        0x52a0c93f, 0x8fe56387, 0xedc7eabe, 0x30824006, 0x2982f8cc, 0xf4c75274, 0x96e5db4d, 0x4ba071f5,
+        0xa4e4aad9, 0x79a10061, 0x1b838958, 0xc6c623e0, 0xdfc69b2a, 0x02833192, 0x60a1b8ab, 0xbde41213,
+        0xbbc47802, 0x6681d2ba, 0x04a35b83, 0xd9e6f13b, 0xc0e649f1, 0x1da3e349, 0x7f816a70, 0xa2c4c0c8,
+        0x4d801be4, 0x90c5b15c, 0xf2e73865, 0x2fa292dd, 0x36a22a17, 0xebe780af, 0x89c50996, 0x5480a32e,
+        0x8585ddb4, 0x58c0770c, 0x3ae2fe35, 0xe7a7548d, 0xfea7ec47, 0x23e246ff, 0x41c0cfc6, 0x9c85657e,
+        0x73c1be52, 0xae8414ea, 0xcca69dd3, 0x11e3376b, 0x08e38fa1, 0xd5a62519, 0xb784ac20, 0x6ac10698,
+        0x6ce16c89, 0xb1a4c631, 0xd3864f08, 0x0ec3e5b0, 0x17c35d7a, 0xca86f7c2, 0xa8a47efb, 0x75e1d443,
+        0x9aa50f6f, 0x47e0a5d7, 0x25c22cee, 0xf8878656, 0xe1873e9c, 0x3cc29424, 0x5ee01d1d, 0x83a5b7a5,
+        0xf90696d8, 0x24433c60, 0x4661b559, 0x9b241fe1, 0x8224a72b, 0x5f610d93, 0x3d4384aa, 0xe0062e12,
+        0x0f42f53e, 0xd2075f86, 0xb025d6bf, 0x6d607c07, 0x7460c4cd, 0xa9256e75, 0xcb07e74c, 0x16424df4,
+        0x106227e5, 0xcd278d5d, 0xaf050464, 0x7240aedc, 0x6b401616, 0xb605bcae, 0xd4273597, 0x09629f2f,
+        0xe6264403, 0x3b63eebb, 0x59416782, 0x8404cd3a, 0x9d0475f0, 0x4041df48, 0x22635671, 0xff26fcc9,
+        0x2e238253, 0xf36628eb, 0x9144a1d2, 0x4c010b6a, 0x5501b3a0, 0x88441918, 0xea669021, 0x37233a99,
+        0xd867e1b5, 0x05224b0d, 0x6700c234, 0xba45688c, 0xa345d046, 0x7e007afe, 0x1c22f3c7, 0xc167597f,
+        0xc747336e, 0x1a0299d6, 0x782010ef, 0xa565ba57, 0xbc65029d, 0x6120a825, 0x0302211c, 0xde478ba4,
+        0x31035088, 0xec46fa30, 0x8e647309, 0x5321d9b1, 0x4a21617b, 0x9764cbc3, 0xf54642fa, 0x2803e842
+    }
 };
+#endif
@@ -11,21 +11,65 @@
 
 #include <stdint.h>
 
+#ifdef LIBFRAMES_SPSC
+    #include <stdatomic.h>
+    #define LIBFRAMES_ATOMIC(t) _Atomic t
+    // Keeps the producer's and the consumer's fields on their own cache
+    // lines.
+    #define LIBFRAMES_CACHE_ALIGNED _Alignas(64)
+#else
+    #define LIBFRAMES_ATOMIC(t) t
+    #define LIBFRAMES_CACHE_ALIGNED
+#endif
+
+// The frame checksum. LIBFRAMES_CRC selects CRC-8 (poly 0x07, the default),
+// CRC-16/CCITT (poly 0x1021, init 0xffff) or CRC-32C (Castagnoli). The
+// checksum is part of the frame, so a frame carries at most
+// max_frame_sz - LIBFRAMES_CRC_SZ bytes of payload.
+#ifndef LIBFRAMES_CRC
+    #define LIBFRAMES_CRC 8
+#endif
+#if LIBFRAMES_CRC == 8
+    typedef uint8_t libframes_crc_t;
+    #define LIBFRAMES_CRC_SZ 1
+#elif LIBFRAMES_CRC == 16
+    typedef uint16_t libframes_crc_t;
+    #define LIBFRAMES_CRC_SZ 2
+#elif LIBFRAMES_CRC == 32
+    typedef uint32_t libframes_crc_t;
+    #define LIBFRAMES_CRC_SZ 4
+#else
+    #error LIBFRAMES_CRC must be 8, 16 or 32.
+#endif
+
+// Stats are kept per context unless LIBFRAMES_NO_STATS is defined, in which
+// case they, and the code updating them, are left out altogether.
+// LIBFRAMES_HISTOGRAMS adds histograms on top of the counters.
+#if defined(LIBFRAMES_NO_STATS) && defined(LIBFRAMES_HISTOGRAMS)
+    #error LIBFRAMES_HISTOGRAMS needs stats.
+#endif
+
+// Histograms have log2 buckets: bucket 0 counts zeros, and bucket n counts
+// values from 2^(n-1) up to 2^n - 1.
+#define LIBFRAMES_HIST_BUCKETS 33
+
+#ifndef LIBFRAMES_NO_STATS
 typedef struct {
-    uint32_t
+    uint64_t
         // Frame didn't begin immediately after the previous frame ended.
         rx_false_starts,
         // Frame was rejected: it had encoding errors.
         rx_frame_rejected_encoding_error,
-        // Frame was rejected: it was larger than LIBFRAMES_MAX_FRAME_SZ.
+        // Frame was rejected: it was larger than max_frame_sz.
         rx_frame_rejected_too_big,
         // Frame was rejected: it was too small.
         rx_frame_rejected_too_small,
-        // Frame was rejected: bad crc8.
+        // Frame was rejected: bad crc8 (or whichever checksum LIBFRAMES_CRC
+        // selects).
         rx_frame_rejected_bad_crc8,
         // Number of valid frames received.
         rx_frame_count,
-        // The min and max valid received frame sizes.
+        // The min and max valid received frame sizes (0 until there is one).
         min_rx_frame_sz,
         max_rx_frame_sz,
         // Attempted to read past the end of a frame.
@@ -36,18 +80,148 @@ typedef struct {
         read_discard_byte_count,
         // The number of bytes handled (dropped or read).
         read_byte_count,
-        // The min and max sent frame sizes.
+        // The min and max sent frame sizes, encoded (0 until there is one).
         write_frame_min_sz,
         write_frame_max_sz,
         // The number of frames sent.
         write_frame_count,
         // The number of bytes sent.
-        write_byte_count;
+        write_byte_count,
+        // The number of calls to libframes_write_platform.
+        write_flush_count;
+#ifdef LIBFRAMES_HISTOGRAMS
+    // Sizes of valid received frames.
+    uint64_t rx_frame_sz_hist[LIBFRAMES_HIST_BUCKETS];
+    // Sizes of sent frames, encoded.
+    uint64_t write_frame_sz_hist[LIBFRAMES_HIST_BUCKETS];
+    // How many rx ring bytes each libframes_read_begin call got through.
+    uint64_t read_begin_scanned_hist[LIBFRAMES_HIST_BUCKETS];
+    // How much escaping grew each sent frame, in percent.
+    uint64_t write_escape_pct_hist[LIBFRAMES_HIST_BUCKETS];
+#endif
 } libframes_stats_t;
+#endif
+
+// Hands encoded bytes to the link. The first argument is the user pointer
+// given to libframes_init.
+typedef void (*libframes_write_platform_t)(void *, void *, uint32_t);
+
+// A piece of memory, for scatter-gather writes.
+typedef struct {
+    const void *p;
+    uint32_t sz;
+} libframes_iovec_t;
+
+// Hands encoded bytes to the link in pieces, in order, like writev. The
+// pieces are only valid for the duration of the call.
+typedef void (*libframes_writev_platform_t)(void *, const libframes_iovec_t *, int);
+
+// How many pieces libframes_write_frame hands to writev_platform at most at a
+// time. A frame takes a piece per run of bytes that need no escaping and per
+// escape.
+#ifndef LIBFRAMES_WRITEV_IOV_N
+    #define LIBFRAMES_WRITEV_IOV_N 16
+#endif
+
+struct libframes_tx_gather;
+
+// Size of the tx staging buffer. Encoded frames are collected in it and
+// handed to write_platform in one go, at libframes_write_end or when it fills
+// up. 0 disables staging: every encoded chunk goes straight to
+// write_platform.
+#ifndef LIBFRAMES_TX_BUF_SZ
+    #define LIBFRAMES_TX_BUF_SZ 0
+#endif
+
+// The most bytes in a COBS block; a block is preceded by a code byte, which
+// is one more than the block size.
+#define LIBFRAMES_COBS_BLOCK_SZ 254
+
+// Everything about one link. A process can drive as many links as it has
+// contexts; none of the functions below touch any global state.
+typedef struct {
+    libframes_write_platform_t write_platform;
+    libframes_writev_platform_t writev_platform;
+    void *user;
+
+    // Memory given to libframes_init. rx_ring_mask is rx_ring_sz - 1 if that
+    // is a power of two, 0 otherwise.
+    char *rx_ring;
+    uint32_t rx_ring_sz;
+    uint32_t rx_ring_mask;
+    char *frame_buffer;
+    uint32_t max_frame_sz;
+
+    // Producer side of rx_ring, touched only by libframes_inject_rx_ring.
+    // rx_ring_written and rx_ring_read count every byte ever written to and
+    // consumed from the ring, so their difference is the number of unread
+    // bytes.
+    LIBFRAMES_CACHE_ALIGNED uint32_t rx_ring_head;
+    LIBFRAMES_ATOMIC(uint32_t) rx_ring_written;
+
+    // Receive side.
+    LIBFRAMES_CACHE_ALIGNED uint32_t rx_ring_tail;
+    LIBFRAMES_ATOMIC(uint32_t) rx_ring_read;
+    // Incremental decoder state, kept between libframes_read_begin calls so
+    // that every received byte is only examined once. The bytes of an
+    // incomplete frame stay in rx_ring; rx_ring_scanned is how many of them
+    // (past rx_ring_tail) have already been decoded into frame_buffer.
+    uint32_t rx_ring_scanned;
+    int rx_limit_bytes_found;
+    int rx_prev_was_dle;
+    libframes_crc_t rx_running_crc;
+    int read_state;
+    // Whether the current frame is decoded in place in rx_ring, and how many
+    // ring bytes it takes up.
+    int rx_frame_in_place;
+    uint32_t rx_frame_raw_sz;
+    uint32_t frame_buffer_sz;
+    uint32_t frame_buffer_off;
+    // COBS decoder state: how many bytes of the current block are still to
+    // come, and whether a zero is owed before the next block.
+    uint32_t rx_cobs_left;
+    int rx_cobs_zero;
+    // Set by libframes_set_resync and libframes_set_cobs.
+    int rx_resync;
+    int cobs;
+
+    // Transmit side.
+    LIBFRAMES_CACHE_ALIGNED int write_state;
+    libframes_crc_t writing_running_crc;
+    uint32_t writing_frame_sz;
+#if LIBFRAMES_TX_BUF_SZ > 0
+    uint32_t tx_buf_sz;
+#endif
+#ifdef LIBFRAMES_HISTOGRAMS
+    uint32_t writing_escape_count;
+#endif
+    // How much of the current COBS block is waiting in tx_cobs_block.
+    uint32_t tx_cobs_sz;
+    // Where libframes_write_frame collects pieces for writev_platform.
+    struct libframes_tx_gather *tx_gather;
+
+#ifndef LIBFRAMES_NO_STATS
+    libframes_stats_t stats;
+#endif
+
+    // Buffers go last, so that the state above shares as few cache lines
+    // as possible.
+#if LIBFRAMES_TX_BUF_SZ > 0
+    uint8_t tx_buf[LIBFRAMES_TX_BUF_SZ];
+#endif
+    uint8_t tx_cobs_block[LIBFRAMES_COBS_BLOCK_SZ];
+} libframes_ctx_t;
+
+// Where libframes_read_batch put a frame in its arena.
+typedef struct {
+    uint32_t off;
+    uint32_t sz;
+} libframes_frame_desc_t;
 
 #define LIBFRAMES_ERROR_NOT_READY 1
 #define LIBFRAMES_READ_ERROR_NO_FRAME 2
 #define LIBFRAMES_READ_ERROR_NOT_ENOUGH 3
+#define LIBFRAMES_ERROR_BAD_SIZE 4
 
 // Negative return codes can be ignored, and are equivalent (for the caller) to
 // LIBFRAMES_READ_NO_FRAME.
@@ -56,21 +230,117 @@ typedef struct {
 #define LIBFRAMES_READ_ERROR_BAD_CRC8 -3
 #define LIBFRAMES_READ_ERROR_TOO_BIG -4
 
+// Set up a context for a link that writes through write_platform. The caller
+// provides the memory for the rx ring and for decoding frames of up to
+// max_frame_sz bytes (checksum included). The ring needs to be at least
+// 2 * max_frame_sz + 2 bytes; power of two sizes are a little faster.
+int libframes_init(libframes_ctx_t *, libframes_write_platform_t, void *user,
+        void *rx_ring, uint32_t rx_ring_sz, void *frame_buffer, uint32_t max_frame_sz);
+
+// With resync on, libframes_read_begin doesn't return the negative read
+// errors: it counts the bad frame in the stats, picks up again at the next LIM
+// and keeps going until it has a good frame or runs out of bytes. Off after
+// libframes_init.
+void libframes_set_resync(libframes_ctx_t *, int resync);
+
+// With COBS on, frames are encoded with Consistent Overhead Byte Stuffing
+// instead of DLE/XOR escaping: a zero byte takes the place of LIM, and each
+// block of up to LIBFRAMES_COBS_BLOCK_SZ bytes that aren't zero is preceded
+// by a code byte, so a frame never grows by more than 1 byte in 254 however
+// many bytes would have needed escaping. Both ends of a link have to agree.
+// Set it right after libframes_init; off by default.
+void libframes_set_cobs(libframes_ctx_t *, int cobs);
+
+// Give libframes_write_frame a writev_platform to hand frames over with,
+// without copying the payload into the tx buffer; NULL goes back to
+// write_platform. The other write functions always use write_platform.
+void libframes_set_writev(libframes_ctx_t *, libframes_writev_platform_t);
+
+// Copy received bytes into the rx ring. Returns how many bytes were accepted;
+// anything past that didn't fit and should be offered again later.
+uint32_t libframes_inject_rx_ring(libframes_ctx_t *, void *, uint32_t);
+// Or receive straight into the rx ring, e.g. with readv: reserve fills in
+// where the free space is, in up to two pieces, and returns how many; commit
+// then hands over the first sz bytes received there.
+int libframes_rx_ring_reserve(libframes_ctx_t *, void *p[2], uint32_t sz[2]);
+void libframes_rx_ring_commit(libframes_ctx_t *, uint32_t sz);
+
 // Check whether there is a complete and valid frame available, and if there
 // is, make that the "current frame".
-int libframes_read_begin(uint32_t *);
+int libframes_read_begin(libframes_ctx_t *, uint32_t *);
 // Read up to a certain number of bytes out of the current frame.
-int libframes_read(void *, uint32_t, uint32_t *);
+int libframes_read(libframes_ctx_t *, void *, uint32_t, uint32_t *);
 // Read exactly a certain number of bytes out of the current frame.
-int libframes_read_exact(void *p, uint32_t sz);
+int libframes_read_exact(libframes_ctx_t *, void *p, uint32_t sz);
+// Get a pointer to, and the size of, the rest of the current frame without
+// copying it. The pointer is good until libframes_read_end.
+int libframes_read_peek(libframes_ctx_t *, const void **, uint32_t *);
 // We're done reading, and discard the rest of the current frame.
-uint32_t libframes_read_end(void);
+uint32_t libframes_read_end(libframes_ctx_t *);
+// Copy up to max_frames complete and valid frames back to back into an arena,
+// describing each one in frames. Bad frames are skipped (and counted in the
+// stats). Returns the number of frames; stops early at an incomplete frame,
+// or at a frame that doesn't fit in what's left of the arena, which is then
+// left as the current frame.
+uint32_t libframes_read_batch(libframes_ctx_t *, void *arena, uint32_t arena_sz, libframes_frame_desc_t *frames, uint32_t max_frames);
+
+// Called by libframes_feed with each good frame. The frame is only valid for
+// the duration of the call.
+typedef void (*libframes_on_frame_t)(void *user, const void *frame, uint32_t sz);
+
+// Decode received bytes straight out of the caller's buffer, instead of
+// injecting them into the rx ring and reading frames back out. Calls on_frame
+// for each good frame; bad frames are counted in the stats and skipped. A
+// frame that isn't complete by the end of the bytes is carried over, decoded,
+// in frame_buffer. Returns the number of frames. Don't mix with
+// libframes_inject_rx_ring and the read functions on the same context.
+uint32_t libframes_feed(libframes_ctx_t *, const void *, uint32_t, libframes_on_frame_t on_frame, void *user);
 
 // Emit the frame header.
-int libframes_write_begin(void);
+int libframes_write_begin(libframes_ctx_t *);
 // Encodes and emits data.
-int libframes_write(void *, uint32_t);
-// Emits encoded crc8 and footer.
-int libframes_write_end(void);
+int libframes_write(libframes_ctx_t *, void *, uint32_t);
+// Emits encoded checksum and footer.
+int libframes_write_end(libframes_ctx_t *);
+// All three in one: encodes and emits a whole frame made of iov_n pieces, with
+// one pass of the checksum over them.
+int libframes_write_frame(libframes_ctx_t *, const libframes_iovec_t *, int iov_n);
+// Hand a frame that is already encoded (by libframes_encode, say) to
+// write_platform as it is, and count it in the stats (all of its bytes in
+// write_byte_count, escapes included). Returns LIBFRAMES_ERROR_NOT_READY
+// while another frame is being written.
+int libframes_write_encoded(libframes_ctx_t *, const void *, uint32_t);
+
+#ifndef LIBFRAMES_NO_STATS
+// Copy the stats into the second argument and, if reset is nonzero, start
+// them over, so that nothing counted in between is lost. Call it from the
+// thread that reads and writes the link; libframes_inject_rx_ring never
+// touches the stats. For a link in a libframes_pool, that's
+// libframes_pool_stats_snapshot's job.
+void libframes_stats_snapshot(libframes_ctx_t *, libframes_stats_t *, int reset);
+#endif
+
+// The most bytes that encoding a payload of sz bytes can take: the payload and
+// checksum with every byte escaped, and the two LIMs. Good for COBS too.
+#define LIBFRAMES_ENCODED_MAX_SZ(sz) (2 * ((sz) + LIBFRAMES_CRC_SZ) + 2)
+// The same for COBS: the payload and checksum, a code byte per (started)
+// block, and the two zeros.
+#define LIBFRAMES_COBS_ENCODED_MAX_SZ(sz) ((sz) + LIBFRAMES_CRC_SZ + ((sz) + LIBFRAMES_CRC_SZ) / LIBFRAMES_COBS_BLOCK_SZ + 3)
+
+// Encode a whole frame into a buffer. Returns the encoded size, or 0 if it
+// doesn't fit; LIBFRAMES_ENCODED_MAX_SZ bytes always do. Uses no state, so
+// it can be called from any thread.
+uint32_t libframes_encode(const void *, uint32_t, void *out, uint32_t out_sz);
+// Decode one whole encoded frame, LIMs included, into a buffer. Returns 0
+// and the payload size, LIBFRAMES_READ_ERROR_TOO_BIG if the payload doesn't
+// fit, or one of the other read errors. Uses no state, so it can be called
+// from any thread.
+int libframes_decode(const void *, uint32_t, void *out, uint32_t out_sz, uint32_t *);
+// The same, except that a frame that needs no unescaping is left where it is:
+// *p points at the payload, either in the encoded frame or in out.
+int libframes_decode_peek(const void *, uint32_t, void *out, uint32_t out_sz, const void **p, uint32_t *);
+// The same, for COBS.
+uint32_t libframes_cobs_encode(const void *, uint32_t, void *out, uint32_t out_sz);
+int libframes_cobs_decode(const void *, uint32_t, void *out, uint32_t out_sz, uint32_t *);
 
 #endif
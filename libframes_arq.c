@@ -0,0 +1,249 @@
+#include "libframes_arq.h"
+
+#include <string.h>
+
+// Where a frame in a window is.
+enum {
+    ARQ_FREE,
+    // Accepted by libframes_arq_send, but the link wasn't ready for it.
+    ARQ_UNSENT,
+    // Sent, waiting for its ACK.
+    ARQ_SENT,
+    // Acknowledged selectively, so not to be sent again; the slot frees up
+    // once the ones before it are acknowledged too.
+    ARQ_SACKED,
+    // Arrived ahead of a missing frame.
+    ARQ_HELD
+};
+
+static void arq_put16(uint8_t *p, uint16_t x) {
+    p[0] = x;
+    p[1] = x >> 8;
+}
+
+static uint16_t arq_get16(const uint8_t *p) {
+    return p[0] | p[1] << 8;
+}
+
+static void arq_put32(uint8_t *p, uint32_t x) {
+    arq_put16(p, x);
+    arq_put16(p + 2, x >> 16);
+}
+
+static uint32_t arq_get32(const uint8_t *p) {
+    return arq_get16(p) | (uint32_t)arq_get16(p + 2) << 16;
+}
+
+// Which slot frame seq is in. The window is a power of two, so that this
+// carries on the same way when seq wraps around.
+static uint32_t arq_slot(libframes_arq_t *arq, uint32_t seq) {
+    return seq & (arq->window - 1);
+}
+
+// Write a frame, with an ACK for everything received so far, and a payload
+// if data is set. The ACK is no longer owed if it went out.
+static int arq_write(libframes_arq_t *arq, int data, uint32_t seq, const void *p, uint32_t sz) {
+    uint32_t sack = 0;
+    for (uint32_t i = 0; i < 32 && i + 1 < arq->window; i++) {
+        if (arq->rx_slots[arq_slot(arq, arq->rx_next + 1 + i)].state == ARQ_HELD) {
+            sack |= (uint32_t)1 << i;
+        }
+    }
+    uint8_t header[LIBFRAMES_ARQ_HEADER_SZ];
+    header[0] = data ? LIBFRAMES_ARQ_DATA : 0;
+    arq_put16(&header[1], seq);
+    arq_put16(&header[3], arq->rx_next);
+    arq_put32(&header[5], sack);
+
+    libframes_iovec_t iov[2] = {{header, sizeof(header)}, {p, sz}};
+    int ret = libframes_write_frame(arq->ctx, iov, data && sz > 0 ? 2 : 1);
+    if (ret == 0) {
+        arq->ack_owed = 0;
+    }
+    return ret;
+}
+
+// Send frame seq, for the first time or again.
+static int arq_write_slot(libframes_arq_t *arq, uint32_t seq, uint64_t now) {
+    libframes_arq_slot_t *slot = &arq->tx_slots[arq_slot(arq, seq)];
+    int ret = arq_write(arq, 1, seq, &arq->tx_payloads[arq_slot(arq, seq) * arq->max_payload_sz], slot->sz);
+    if (ret == 0) {
+        if (slot->state == ARQ_UNSENT) {
+            arq->stats.data_sent++;
+        } else {
+            arq->stats.retransmits++;
+        }
+        slot->state = ARQ_SENT;
+        slot->sent_ns = now;
+    }
+    return ret;
+}
+
+int libframes_arq_init(libframes_arq_t *arq, libframes_ctx_t *ctx, uint32_t window, uint32_t max_payload_sz,
+        libframes_arq_slot_t *slots, void *payloads, libframes_arq_clock_t clock, void *clock_user,
+        libframes_on_frame_t on_frame, void *user) {
+    if (window == 0 || window > LIBFRAMES_ARQ_MAX_WINDOW || (window & (window - 1)) != 0
+            || (uint64_t)LIBFRAMES_ARQ_HEADER_SZ + max_payload_sz + LIBFRAMES_CRC_SZ > ctx->max_frame_sz) {
+        return LIBFRAMES_ERROR_BAD_SIZE;
+    }
+    memset(arq, 0, sizeof(*arq));
+    arq->ctx = ctx;
+    arq->clock = clock;
+    arq->clock_user = clock_user;
+    arq->on_frame = on_frame;
+    arq->user = user;
+    arq->window = window;
+    arq->max_payload_sz = max_payload_sz;
+    arq->rto_ns = LIBFRAMES_ARQ_RTO_NS;
+    arq->ack_delay_ns = LIBFRAMES_ARQ_ACK_DELAY_NS;
+    arq->tx_slots = slots;
+    arq->tx_payloads = payloads;
+    arq->rx_slots = &slots[window];
+    arq->rx_payloads = (uint8_t *)payloads + window * max_payload_sz;
+    for (uint32_t i = 0; i < 2 * window; i++) {
+        slots[i].state = ARQ_FREE;
+    }
+    return 0;
+}
+
+void libframes_arq_set_timers(libframes_arq_t *arq, uint64_t rto_ns, uint64_t ack_delay_ns) {
+    arq->rto_ns = rto_ns;
+    arq->ack_delay_ns = ack_delay_ns;
+}
+
+int libframes_arq_send(libframes_arq_t *arq, const void *p, uint32_t sz) {
+    if (sz > arq->max_payload_sz) {
+        return LIBFRAMES_ERROR_BAD_SIZE;
+    }
+    if (arq->tx_next - arq->tx_base == arq->window) {
+        return LIBFRAMES_ERROR_NOT_READY;
+    }
+    uint32_t seq = arq->tx_next++;
+    libframes_arq_slot_t *slot = &arq->tx_slots[arq_slot(arq, seq)];
+    memcpy(&arq->tx_payloads[arq_slot(arq, seq) * arq->max_payload_sz], p, sz);
+    slot->sz = sz;
+    slot->state = ARQ_UNSENT;
+    // If the link is busy, libframes_arq_poll will try again.
+    arq_write_slot(arq, seq, arq->clock(arq->clock_user));
+    return 0;
+}
+
+// Free the slots of frames the other end has, and mark the ones it has
+// selectively.
+static void arq_ack(libframes_arq_t *arq, uint16_t ack, uint32_t sack) {
+    uint32_t in_flight = arq->tx_next - arq->tx_base;
+    uint32_t acked = (uint16_t)(ack - arq->tx_base);
+    if (acked > in_flight) {
+        // An old ACK, from before some that have already arrived.
+        return;
+    }
+    for (; acked > 0; acked--) {
+        arq->tx_slots[arq_slot(arq, arq->tx_base++)].state = ARQ_FREE;
+    }
+    for (uint32_t i = 0; i < 32 && i + 1 < arq->tx_next - arq->tx_base; i++) {
+        libframes_arq_slot_t *slot = &arq->tx_slots[arq_slot(arq, arq->tx_base + 1 + i)];
+        if (sack >> i & 1) {
+            slot->state = ARQ_SACKED;
+        }
+    }
+}
+
+void libframes_arq_on_frame(void *user, const void *frame, uint32_t sz) {
+    libframes_arq_t *arq = user;
+    const uint8_t *p = frame;
+    if (sz < LIBFRAMES_ARQ_HEADER_SZ || sz - LIBFRAMES_ARQ_HEADER_SZ > arq->max_payload_sz) {
+        arq->stats.rx_bad++;
+        return;
+    }
+    arq_ack(arq, arq_get16(&p[3]), arq_get32(&p[5]));
+    if (!(p[0] & LIBFRAMES_ARQ_DATA)) {
+        return;
+    }
+
+    // Whatever happens to it, the other end needs to hear about it.
+    if (!arq->ack_owed) {
+        arq->ack_owed = 1;
+        arq->ack_owed_ns = arq->clock(arq->clock_user);
+    }
+    int16_t ahead = arq_get16(&p[1]) - (uint16_t)arq->rx_next;
+    const uint8_t *payload = &p[LIBFRAMES_ARQ_HEADER_SZ];
+    sz -= LIBFRAMES_ARQ_HEADER_SZ;
+    if (ahead < 0) {
+        arq->stats.rx_duplicates++;
+        return;
+    }
+    if ((uint32_t)ahead >= arq->window) {
+        arq->stats.rx_out_of_window++;
+        return;
+    }
+    if (ahead > 0) {
+        uint32_t i = arq_slot(arq, arq->rx_next + ahead);
+        libframes_arq_slot_t *slot = &arq->rx_slots[i];
+        if (slot->state == ARQ_HELD) {
+            arq->stats.rx_duplicates++;
+            return;
+        }
+        memcpy(&arq->rx_payloads[i * arq->max_payload_sz], payload, sz);
+        slot->sz = sz;
+        slot->state = ARQ_HELD;
+        return;
+    }
+
+    // The one that was missing: hand it over, and the ones that were waiting
+    // for it. rx_next moves first so that frames sent from on_frame carry
+    // the ACK for them.
+    arq->rx_next++;
+    arq->stats.rx_delivered++;
+    arq->on_frame(arq->user, payload, sz);
+    for (;;) {
+        uint32_t i = arq_slot(arq, arq->rx_next);
+        libframes_arq_slot_t *slot = &arq->rx_slots[i];
+        if (slot->state != ARQ_HELD) {
+            break;
+        }
+        arq->rx_next++;
+        arq->stats.rx_delivered++;
+        arq->on_frame(arq->user, &arq->rx_payloads[i * arq->max_payload_sz], slot->sz);
+        slot->state = ARQ_FREE;
+    }
+}
+
+uint32_t libframes_arq_receive(libframes_arq_t *arq) {
+    uint32_t frame_count = 0;
+    uint32_t frame_sz;
+    int ret;
+    while ((ret = libframes_read_begin(arq->ctx, &frame_sz)) != LIBFRAMES_READ_ERROR_NO_FRAME) {
+        if (ret == 0) {
+            const void *frame = NULL;
+            libframes_read_peek(arq->ctx, &frame, &frame_sz);
+            libframes_arq_on_frame(arq, frame, frame_sz);
+            libframes_read_end(arq->ctx);
+            frame_count++;
+        }
+    }
+    return frame_count;
+}
+
+uint64_t libframes_arq_poll(libframes_arq_t *arq) {
+    uint64_t now = arq->clock(arq->clock_user);
+    uint64_t next = UINT64_MAX;
+    for (uint32_t seq = arq->tx_base; seq != arq->tx_next; seq++) {
+        libframes_arq_slot_t *slot = &arq->tx_slots[arq_slot(arq, seq)];
+        if (slot->state == ARQ_UNSENT || (slot->state == ARQ_SENT && now - slot->sent_ns >= arq->rto_ns)) {
+            arq_write_slot(arq, seq, now);
+        }
+        if (slot->state == ARQ_UNSENT) {
+            next = now;
+        } else if (slot->state == ARQ_SENT && slot->sent_ns + arq->rto_ns < next) {
+            next = slot->sent_ns + arq->rto_ns;
+        }
+    }
+
+    if (arq->ack_owed && now - arq->ack_owed_ns >= arq->ack_delay_ns && arq_write(arq, 0, 0, NULL, 0) == 0) {
+        arq->stats.acks_sent++;
+    }
+    if (arq->ack_owed && arq->ack_owed_ns + arq->ack_delay_ns < next) {
+        next = arq->ack_owed_ns + arq->ack_delay_ns;
+    }
+    return next;
+}
@@ -0,0 +1,132 @@
+#ifndef __LIBFRAMES_ARQ_H__
+#define __LIBFRAMES_ARQ_H__
+
+// An optional reliable transport on top of a link's frames: a sliding window
+// of numbered data frames, acknowledged cumulatively and selectively, and
+// sent again when they aren't acknowledged in time. Each end both sends and
+// receives. ACKs ride along on data frames going the other way, or, if there
+// are none, go out on their own from libframes_arq_poll, one for all the
+// frames received since the last.
+//
+// Every frame starts with a header: a flags byte (LIBFRAMES_ARQ_DATA if a
+// payload follows), the 16 bit sequence number of the payload, the 16 bit
+// sequence number expected next from the other end (everything before it has
+// arrived), and a 32 bit map of the frames after that one that have arrived
+// anyway: bit i is for sequence number ack + 1 + i. Everything is little
+// endian.
+//
+// Time comes from a clock the caller provides, so the timers can run off
+// whatever clock the application has, or off simulated time.
+
+#include "libframes.h"
+
+// The frame carries a payload.
+#define LIBFRAMES_ARQ_DATA 1
+
+#define LIBFRAMES_ARQ_HEADER_SZ 9
+
+// The most frames in flight. Sequence numbers wrap at 16 bits, and each end
+// has to be able to tell old ones from new. The window is also a power of two,
+// so that the slots line up the same way on either side of a wrap.
+#define LIBFRAMES_ARQ_MAX_WINDOW 32768
+
+// How long a frame waits for its ACK before it is sent again, and how long
+// an ACK waits for a data frame to ride on, until libframes_arq_set_timers.
+#ifndef LIBFRAMES_ARQ_RTO_NS
+    #define LIBFRAMES_ARQ_RTO_NS 200000000ull
+#endif
+#ifndef LIBFRAMES_ARQ_ACK_DELAY_NS
+    #define LIBFRAMES_ARQ_ACK_DELAY_NS 0
+#endif
+
+// Returns the time in ns, from any fixed point. The argument is the
+// clock_user given to libframes_arq_init.
+typedef uint64_t (*libframes_arq_clock_t)(void *);
+
+// A frame in the send or receive window.
+typedef struct {
+    uint64_t sent_ns;
+    uint32_t sz;
+    int state;
+} libframes_arq_slot_t;
+
+typedef struct {
+    uint64_t
+        // Data frames sent for the first time, and sent again.
+        data_sent,
+        retransmits,
+        // Frames with only an ACK in them.
+        acks_sent,
+        // Payloads handed to on_frame.
+        rx_delivered,
+        // Data frames that had already arrived.
+        rx_duplicates,
+        // Data frames too far ahead of the ones still missing.
+        rx_out_of_window,
+        // Frames too small for a header, or with too big a payload.
+        rx_bad;
+} libframes_arq_stats_t;
+
+typedef struct {
+    libframes_ctx_t *ctx;
+    libframes_arq_clock_t clock;
+    void *clock_user;
+    libframes_on_frame_t on_frame;
+    void *user;
+    uint32_t window;
+    uint32_t max_payload_sz;
+    uint64_t rto_ns;
+    uint64_t ack_delay_ns;
+
+    // Send side. Sequence numbers are counted in 32 bits here, and only the
+    // low 16 go in headers. Frame seq is in slot seq & (window - 1).
+    libframes_arq_slot_t *tx_slots;
+    uint8_t *tx_payloads;
+    // The oldest frame not acknowledged yet, and the next one to be sent.
+    uint32_t tx_base;
+    uint32_t tx_next;
+
+    // Receive side: frames that arrived ahead of one that's missing wait in
+    // their slots.
+    libframes_arq_slot_t *rx_slots;
+    uint8_t *rx_payloads;
+    uint32_t rx_next;
+    // Whether data frames arrived since the last ACK went out, and since
+    // when.
+    int ack_owed;
+    uint64_t ack_owed_ns;
+
+    libframes_arq_stats_t stats;
+} libframes_arq_t;
+
+// Run a reliable transport over ctx, with up to window frames in flight each
+// way; both ends have to use the same window. The caller provides the memory
+// for 2 * window slots and 2 * window payloads of max_payload_sz bytes. The
+// payloads arrive in order, each exactly once, at on_frame. Returns
+// LIBFRAMES_ERROR_BAD_SIZE if window isn't a power of two up to
+// LIBFRAMES_ARQ_MAX_WINDOW, or if a payload and its header don't fit in a
+// frame of ctx's.
+int libframes_arq_init(libframes_arq_t *, libframes_ctx_t *, uint32_t window, uint32_t max_payload_sz,
+        libframes_arq_slot_t *slots, void *payloads, libframes_arq_clock_t clock, void *clock_user,
+        libframes_on_frame_t on_frame, void *user);
+void libframes_arq_set_timers(libframes_arq_t *, uint64_t rto_ns, uint64_t ack_delay_ns);
+
+// Send a payload. Returns LIBFRAMES_ERROR_NOT_READY, sending nothing, if the
+// window is full, or LIBFRAMES_ERROR_BAD_SIZE if it is bigger than
+// max_payload_sz. Once it is accepted it is up to libframes_arq_poll to get
+// it there.
+int libframes_arq_send(libframes_arq_t *, const void *, uint32_t);
+
+// Handle a frame received on the link; the first argument is the
+// libframes_arq_t. It is a libframes_on_frame_t, so it can be given to
+// libframes_feed and the drivers.
+void libframes_arq_on_frame(void *, const void *, uint32_t);
+// Or take the frames out of ctx's rx ring. Returns how many there were.
+uint32_t libframes_arq_receive(libframes_arq_t *);
+
+// Send frames whose time is up again, and an ACK if one is owed and nothing
+// else took it along. Returns when it next has something to do, in clock
+// time: UINT64_MAX if only a frame arriving would give it something.
+uint64_t libframes_arq_poll(libframes_arq_t *);
+
+#endif
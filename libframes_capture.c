@@ -0,0 +1,346 @@
+#include "libframes_capture.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CAPTURE_MAGIC "LFCAP001"
+#define CAPTURE_INDEX_MAGIC "LFIDX001"
+#define CAPTURE_HEADER_SZ 16
+#define CAPTURE_RECORD_HEADER_SZ 12
+#define CAPTURE_INDEX_HEADER_SZ 24
+
+static void capture_put32(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = v >> (8 * i);
+    }
+}
+
+static void capture_put64(uint8_t *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = v >> (8 * i);
+    }
+}
+
+static uint32_t capture_get32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t capture_get64(const uint8_t *p) {
+    return capture_get32(p) | (uint64_t)capture_get32(&p[4]) << 32;
+}
+
+// The sidecar index's path. NULL, with errno set, if there's no memory.
+static char *capture_index_path(const char *path) {
+    char *index_path = malloc(strlen(path) + 5);
+    if (index_path) {
+        strcpy(index_path, path);
+        strcat(index_path, ".idx");
+    }
+    return index_path;
+}
+
+int libframes_capture_create(libframes_capture_writer_t *w, const char *path, uint32_t flags) {
+    char *index_path = capture_index_path(path);
+    if (!index_path) {
+        return -1;
+    }
+    w->file = fopen(path, "wb");
+    w->index = w->file ? fopen(index_path, "wb") : NULL;
+    free(index_path);
+    if (!w->index) {
+        if (w->file) {
+            fclose(w->file);
+        }
+        return -1;
+    }
+    w->off = CAPTURE_HEADER_SZ;
+    w->frame_count = 0;
+
+    uint8_t header[CAPTURE_HEADER_SZ];
+    memcpy(header, CAPTURE_MAGIC, 8);
+    capture_put32(&header[8], flags);
+    capture_put32(&header[12], LIBFRAMES_CRC);
+    // libframes_capture_finish fills in the index header. Until then, it
+    // covers nothing, and readers build their own.
+    uint8_t index_header[CAPTURE_INDEX_HEADER_SZ] = {0};
+    if (fwrite(header, sizeof(header), 1, w->file) != 1
+            || fwrite(index_header, sizeof(index_header), 1, w->index) != 1) {
+        fclose(w->file);
+        fclose(w->index);
+        return -1;
+    }
+    return 0;
+}
+
+int libframes_capture_append(libframes_capture_writer_t *w, uint64_t ts_ns, const void *encoded, uint32_t sz) {
+    uint8_t header[CAPTURE_RECORD_HEADER_SZ];
+    capture_put64(header, ts_ns);
+    capture_put32(&header[8], sz);
+    uint8_t off[8];
+    capture_put64(off, w->off);
+    if (fwrite(header, sizeof(header), 1, w->file) != 1
+            || (sz > 0 && fwrite(encoded, sz, 1, w->file) != 1)
+            || fwrite(off, sizeof(off), 1, w->index) != 1) {
+        return -1;
+    }
+    w->off += CAPTURE_RECORD_HEADER_SZ + sz;
+    w->frame_count++;
+    return 0;
+}
+
+int libframes_capture_finish(libframes_capture_writer_t *w) {
+    uint8_t index_header[CAPTURE_INDEX_HEADER_SZ];
+    memcpy(index_header, CAPTURE_INDEX_MAGIC, 8);
+    capture_put64(&index_header[8], w->off);
+    capture_put64(&index_header[16], w->frame_count);
+    int ret = 0;
+    if (fflush(w->file) != 0 || fseek(w->index, 0, SEEK_SET) != 0
+            || fwrite(index_header, sizeof(index_header), 1, w->index) != 1) {
+        ret = -1;
+    }
+    if (fclose(w->file) != 0) {
+        ret = -1;
+    }
+    if (fclose(w->index) != 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+// Map the sidecar index, if it's there and covers the whole capture.
+static int capture_load_index(libframes_capture_t *cap, const char *index_path) {
+    int fd = open(index_path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (uint64_t)st.st_size < CAPTURE_INDEX_HEADER_SZ) {
+        close(fd);
+        return -1;
+    }
+    const uint8_t *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    uint64_t frame_count = capture_get64(&map[16]);
+    if (memcmp(map, CAPTURE_INDEX_MAGIC, 8) != 0 || capture_get64(&map[8]) != cap->map_sz
+            || frame_count != ((uint64_t)st.st_size - CAPTURE_INDEX_HEADER_SZ) / 8) {
+        munmap((void *)map, st.st_size);
+        return -1;
+    }
+    cap->frame_count = frame_count;
+    cap->offs = &map[CAPTURE_INDEX_HEADER_SZ];
+    cap->index_map_sz = st.st_size;
+    return 0;
+}
+
+// Walk the records to find the frames, then try to save what was found for
+// next time.
+static int capture_build_index(libframes_capture_t *cap, const char *index_path) {
+    uint64_t frame_count = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass == 1) {
+            cap->offs_built = malloc(frame_count * 8 + 1);
+            if (!cap->offs_built) {
+                return -1;
+            }
+            cap->offs = cap->offs_built;
+            cap->frame_count = frame_count;
+            frame_count = 0;
+        }
+        uint64_t off = CAPTURE_HEADER_SZ;
+        while (cap->map_sz - off >= CAPTURE_RECORD_HEADER_SZ) {
+            uint32_t sz = capture_get32(&cap->map[off + 8]);
+            if (sz > cap->map_sz - off - CAPTURE_RECORD_HEADER_SZ) {
+                break;
+            }
+            if (pass == 1) {
+                capture_put64(&((uint8_t *)cap->offs_built)[frame_count * 8], off);
+            }
+            frame_count++;
+            off += CAPTURE_RECORD_HEADER_SZ + sz;
+        }
+    }
+
+    // The index is only a cache: if it can't be written out, or only part of
+    // it, it is built again next time.
+    FILE *index = fopen(index_path, "wb");
+    if (index) {
+        uint8_t index_header[CAPTURE_INDEX_HEADER_SZ];
+        memcpy(index_header, CAPTURE_INDEX_MAGIC, 8);
+        capture_put64(&index_header[8], cap->map_sz);
+        capture_put64(&index_header[16], frame_count);
+        fwrite(index_header, sizeof(index_header), 1, index);
+        fwrite(cap->offs, 8, frame_count, index);
+        fclose(index);
+    }
+    return 0;
+}
+
+int libframes_capture_open(libframes_capture_t *cap, const char *path) {
+    memset(cap, 0, sizeof(*cap));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    if ((uint64_t)st.st_size < CAPTURE_HEADER_SZ) {
+        close(fd);
+        return LIBFRAMES_CAPTURE_ERROR_BAD_FORMAT;
+    }
+    const uint8_t *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    cap->map = map;
+    cap->map_sz = st.st_size;
+    if (memcmp(map, CAPTURE_MAGIC, 8) != 0 || capture_get32(&map[12]) != LIBFRAMES_CRC) {
+        libframes_capture_close(cap);
+        return LIBFRAMES_CAPTURE_ERROR_BAD_FORMAT;
+    }
+    cap->flags = capture_get32(&map[8]);
+
+    char *index_path = capture_index_path(path);
+    if (!index_path) {
+        libframes_capture_close(cap);
+        return -1;
+    }
+    int ret = capture_load_index(cap, index_path);
+    if (ret != 0) {
+        ret = capture_build_index(cap, index_path);
+    }
+    free(index_path);
+    if (ret != 0) {
+        libframes_capture_close(cap);
+    }
+    return ret;
+}
+
+void libframes_capture_close(libframes_capture_t *cap) {
+    if (cap->map) {
+        munmap((void *)cap->map, cap->map_sz);
+    }
+    if (cap->index_map_sz > 0) {
+        munmap((void *)(cap->offs - CAPTURE_INDEX_HEADER_SZ), cap->index_map_sz);
+    }
+    free(cap->offs_built);
+    memset(cap, 0, sizeof(*cap));
+}
+
+int libframes_capture_get(libframes_capture_t *cap, uint64_t n, uint64_t *ts_ns, const void **encoded, uint32_t *sz) {
+    if (n >= cap->frame_count) {
+        return LIBFRAMES_ERROR_BAD_SIZE;
+    }
+    // A loaded index is only trusted as far as the mapping goes.
+    uint64_t off = capture_get64(&cap->offs[n * 8]);
+    if (off > cap->map_sz || cap->map_sz - off < CAPTURE_RECORD_HEADER_SZ) {
+        return LIBFRAMES_CAPTURE_ERROR_BAD_FORMAT;
+    }
+    uint32_t record_sz = capture_get32(&cap->map[off + 8]);
+    if (record_sz > cap->map_sz - off - CAPTURE_RECORD_HEADER_SZ) {
+        return LIBFRAMES_CAPTURE_ERROR_BAD_FORMAT;
+    }
+    *ts_ns = capture_get64(&cap->map[off]);
+    *encoded = &cap->map[off + CAPTURE_RECORD_HEADER_SZ];
+    *sz = record_sz;
+    return 0;
+}
+
+int libframes_capture_decode(libframes_capture_t *cap, uint64_t n, void *out, uint32_t out_sz,
+        uint64_t *ts_ns, const void **p, uint32_t *sz) {
+    const void *encoded;
+    uint32_t encoded_sz;
+    int ret = libframes_capture_get(cap, n, ts_ns, &encoded, &encoded_sz);
+    if (ret != 0) {
+        return ret;
+    }
+    if (cap->flags & LIBFRAMES_CAPTURE_COBS) {
+        *p = out;
+        return libframes_cobs_decode(encoded, encoded_sz, out, out_sz, sz);
+    }
+    return libframes_decode_peek(encoded, encoded_sz, out, out_sz, p, sz);
+}
+
+uint64_t libframes_capture_replay(libframes_capture_t *cap, uint64_t first, uint64_t last,
+        void *out, uint32_t out_sz, libframes_capture_on_frame_t on_frame, void *user) {
+    uint64_t frame_count = 0;
+    for (uint64_t n = first; n < last; n++) {
+        uint64_t ts_ns;
+        const void *p;
+        uint32_t sz;
+        if (libframes_capture_decode(cap, n, out, out_sz, &ts_ns, &p, &sz) == 0) {
+            on_frame(user, n, ts_ns, p, sz);
+            frame_count++;
+        }
+    }
+    return frame_count;
+}
+
+// One thread's share of libframes_capture_replay_parallel.
+typedef struct {
+    pthread_t thread;
+    libframes_capture_t *cap;
+    uint64_t first;
+    uint64_t last;
+    uint32_t out_sz;
+    libframes_capture_on_frame_t on_frame;
+    void *user;
+    int64_t frame_count;
+} capture_range_t;
+
+static void *capture_replay_range(void *arg) {
+    capture_range_t *range = arg;
+    void *out = malloc(range->out_sz);
+    if (!out) {
+        range->frame_count = -1;
+        return NULL;
+    }
+    range->frame_count = libframes_capture_replay(range->cap, range->first, range->last,
+        out, range->out_sz, range->on_frame, range->user);
+    free(out);
+    return NULL;
+}
+
+int64_t libframes_capture_replay_parallel(libframes_capture_t *cap, int threads_n, uint32_t out_sz,
+        libframes_capture_on_frame_t on_frame, void *user) {
+    capture_range_t *ranges = malloc(threads_n * sizeof(*ranges));
+    if (!ranges) {
+        return -1;
+    }
+    int started = 0;
+    for (; started < threads_n; started++) {
+        capture_range_t *range = &ranges[started];
+        range->cap = cap;
+        range->first = cap->frame_count * started / threads_n;
+        range->last = cap->frame_count * (started + 1) / threads_n;
+        range->out_sz = out_sz;
+        range->on_frame = on_frame;
+        range->user = user;
+        if (pthread_create(&range->thread, NULL, capture_replay_range, range) != 0) {
+            break;
+        }
+    }
+
+    int64_t frame_count = started == threads_n ? 0 : -1;
+    for (int i = 0; i < started; i++) {
+        pthread_join(ranges[i].thread, NULL);
+        if (frame_count >= 0 && ranges[i].frame_count >= 0) {
+            frame_count += ranges[i].frame_count;
+        } else {
+            frame_count = -1;
+        }
+    }
+    free(ranges);
+    return frame_count;
+}
@@ -0,0 +1,94 @@
+#ifndef __LIBFRAMES_CAPTURE_H__
+#define __LIBFRAMES_CAPTURE_H__
+
+// An optional capture format for POSIX systems: encoded frames are logged to
+// a file with timestamps, and read back by mapping the file into memory and
+// decoding frames straight out of the mapping. A sidecar index of where each
+// frame is (the capture's path with ".idx" appended) gives random access to
+// frame n, and lets disjoint ranges of frames be decoded on many threads.
+//
+// The file starts with an 8 byte magic, then two 32 bit words: flags
+// (LIBFRAMES_CAPTURE_COBS) and the LIBFRAMES_CRC it was written with. Each
+// frame is a record: a 64 bit timestamp, a 32 bit size, and the encoded frame
+// itself. The index is an 8 byte magic, the size of the capture it covers,
+// the number of frames, and a 64 bit offset per frame. Everything is little
+// endian.
+
+#include "libframes.h"
+
+#include <stddef.h>
+#include <stdio.h>
+
+// The frames are COBS encoded.
+#define LIBFRAMES_CAPTURE_COBS 1
+
+// The file isn't a capture (or was written with another LIBFRAMES_CRC), or
+// its index points outside of it. Distinct from the -1 of a failed system
+// call, and from the other error codes.
+#define LIBFRAMES_CAPTURE_ERROR_BAD_FORMAT 5
+
+// Called with each good frame in a replayed range, and its number and
+// timestamp. The frame is only valid for the duration of the call.
+typedef void (*libframes_capture_on_frame_t)(void *user, uint64_t n, uint64_t ts_ns, const void *frame, uint32_t sz);
+
+typedef struct {
+    FILE *file;
+    FILE *index;
+    uint64_t off;
+    uint64_t frame_count;
+} libframes_capture_writer_t;
+
+typedef struct {
+    const uint8_t *map;
+    size_t map_sz;
+    uint32_t flags;
+    uint64_t frame_count;
+    // Where each frame's record is: in the mapped index file, or built in
+    // memory if there wasn't a good one.
+    const uint8_t *offs;
+    size_t index_map_sz;
+    void *offs_built;
+} libframes_capture_t;
+
+// Functions that make system calls return -1 and set errno if one fails.
+
+// Start a capture at path, and its index. flags is 0 or
+// LIBFRAMES_CAPTURE_COBS.
+int libframes_capture_create(libframes_capture_writer_t *, const char *path, uint32_t flags);
+// Log an encoded frame, as libframes_encode makes them or as they came over
+// the link, LIMs included.
+int libframes_capture_append(libframes_capture_writer_t *, uint64_t ts_ns, const void *encoded, uint32_t sz);
+// Finish the capture and its index.
+int libframes_capture_finish(libframes_capture_writer_t *);
+
+// Map a capture. Its index is loaded if it covers the whole capture;
+// otherwise it is rebuilt (by walking the records) and, if possible, written
+// out again. A record cut short at the end of the file is left out.
+// Returns LIBFRAMES_CAPTURE_ERROR_BAD_FORMAT if the file isn't a capture.
+int libframes_capture_open(libframes_capture_t *, const char *path);
+void libframes_capture_close(libframes_capture_t *);
+
+// Find frame n, still encoded, in the mapping. Returns
+// LIBFRAMES_ERROR_BAD_SIZE if there's no frame n, or
+// LIBFRAMES_CAPTURE_ERROR_BAD_FORMAT if the index doesn't agree with the
+// capture.
+int libframes_capture_get(libframes_capture_t *, uint64_t n, uint64_t *ts_ns, const void **encoded, uint32_t *sz);
+// Decode frame n. Frames that need no unescaping are left where they are in
+// the mapping, and *p points there; the others are decoded into out. Returns
+// what libframes_capture_get does, or one of the read errors.
+int libframes_capture_decode(libframes_capture_t *, uint64_t n, void *out, uint32_t out_sz,
+        uint64_t *ts_ns, const void **p, uint32_t *sz);
+
+// Decode frames first up to (not including) last, calling on_frame with each
+// good one. out is where frames that can't be decoded in place go; frames
+// that don't fit count as bad. Returns the number of good frames.
+uint64_t libframes_capture_replay(libframes_capture_t *, uint64_t first, uint64_t last,
+        void *out, uint32_t out_sz, libframes_capture_on_frame_t on_frame, void *user);
+// The same for all frames, split into threads_n ranges that are decoded on
+// as many threads; on_frame is called from all of them at once. Each thread
+// gets out_sz bytes to decode into. Returns the number of good frames, or -1
+// if a thread couldn't be started.
+int64_t libframes_capture_replay_parallel(libframes_capture_t *, int threads_n, uint32_t out_sz,
+        libframes_capture_on_frame_t on_frame, void *user);
+
+#endif
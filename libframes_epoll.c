@@ -0,0 +1,219 @@
+#include "libframes_epoll.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// How many ready links one libframes_epoll_run call takes on.
+#define LIBFRAMES_EPOLL_EVENTS 64
+
+int libframes_epoll_init(libframes_epoll_t *ep) {
+    ep->epfd = epoll_create1(EPOLL_CLOEXEC);
+    ep->batch = NULL;
+    ep->batch_n = 0;
+    return ep->epfd < 0 ? -1 : 0;
+}
+
+void libframes_epoll_close(libframes_epoll_t *ep) {
+    close(ep->epfd);
+}
+
+// The links' write_platform: queue the encoded bytes. libframes_epoll_send
+// has made sure that they fit.
+static void epoll_queue(void *user, void *p, uint32_t sz) {
+    libframes_epoll_link_t *link = user;
+    uint32_t tail = link->tx_queue_head + link->tx_queue_len;
+    if (tail >= link->tx_queue_sz) {
+        tail -= link->tx_queue_sz;
+    }
+    uint32_t first_sz = link->tx_queue_sz - tail;
+    if (first_sz > sz) {
+        first_sz = sz;
+    }
+    memcpy(&link->tx_queue[tail], p, first_sz);
+    memcpy(link->tx_queue, (char *)p + first_sz, sz - first_sz);
+    link->tx_queue_len += sz;
+}
+
+// Wait for the fd to be readable, and writable too if out is set.
+static int epoll_watch(libframes_epoll_t *ep, libframes_epoll_link_t *link, int op, int out) {
+    struct epoll_event ev;
+    ev.events = EPOLLIN | (out ? EPOLLOUT : 0);
+    ev.data.ptr = link;
+    if (epoll_ctl(ep->epfd, op, link->fd, &ev) < 0) {
+        return -1;
+    }
+    link->tx_waiting = out;
+    return 0;
+}
+
+int libframes_epoll_add(libframes_epoll_t *ep, libframes_epoll_link_t *link, int fd,
+        libframes_on_frame_t on_frame, void *user,
+        void *rx_ring, uint32_t rx_ring_sz, void *frame_buffer, uint32_t max_frame_sz,
+        void *tx_queue, uint32_t tx_queue_sz) {
+    int ret = libframes_init(&link->ctx, epoll_queue, link, rx_ring, rx_ring_sz, frame_buffer, max_frame_sz);
+    if (ret != 0) {
+        return ret;
+    }
+    // Bad frames are only counted; there's no one to hand them to anyway.
+    libframes_set_resync(&link->ctx, 1);
+    link->fd = fd;
+    link->on_frame = on_frame;
+    link->user = user;
+    link->tx_queue = tx_queue;
+    link->tx_queue_sz = tx_queue_sz;
+    link->tx_queue_head = 0;
+    link->tx_queue_len = 0;
+
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return -1;
+    }
+    return epoll_watch(ep, link, EPOLL_CTL_ADD, 0);
+}
+
+int libframes_epoll_remove(libframes_epoll_t *ep, libframes_epoll_link_t *link) {
+    // Events of the link that libframes_epoll_run hasn't got to yet, or is in
+    // the middle of, are left for it to skip.
+    struct epoll_event *events = ep->batch;
+    for (int i = 0; i < ep->batch_n; i++) {
+        if (events[i].data.ptr == link) {
+            events[i].data.ptr = NULL;
+        }
+    }
+    return epoll_ctl(ep->epfd, EPOLL_CTL_DEL, link->fd, NULL);
+}
+
+// Write out as much of the tx queue as the fd takes, and have the loop wait
+// for the fd to take the rest.
+static int epoll_flush(libframes_epoll_t *ep, libframes_epoll_link_t *link) {
+    while (link->tx_queue_len > 0) {
+        uint32_t first_sz = link->tx_queue_sz - link->tx_queue_head;
+        if (first_sz > link->tx_queue_len) {
+            first_sz = link->tx_queue_len;
+        }
+        struct iovec iov[2] = {
+            {&link->tx_queue[link->tx_queue_head], first_sz},
+            {link->tx_queue, link->tx_queue_len - first_sz},
+        };
+        ssize_t n = writev(link->fd, iov, link->tx_queue_len > first_sz ? 2 : 1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return -1;
+        }
+        link->tx_queue_head += n;
+        if (link->tx_queue_head >= link->tx_queue_sz) {
+            link->tx_queue_head -= link->tx_queue_sz;
+        }
+        link->tx_queue_len -= n;
+    }
+
+    int out = link->tx_queue_len > 0;
+    if (out != link->tx_waiting) {
+        return epoll_watch(ep, link, EPOLL_CTL_MOD, out);
+    }
+    return 0;
+}
+
+int libframes_epoll_send(libframes_epoll_t *ep, libframes_epoll_link_t *link, const void *p, uint32_t sz) {
+    if (LIBFRAMES_ENCODED_MAX_SZ(sz) > link->tx_queue_sz - link->tx_queue_len) {
+        return LIBFRAMES_ERROR_NOT_READY;
+    }
+    libframes_write_begin(&link->ctx);
+    libframes_write(&link->ctx, (void *)p, sz);
+    libframes_write_end(&link->ctx);
+    // If the loop is already waiting for room, it writes the frame out then.
+    if (link->tx_waiting) {
+        return 0;
+    }
+    return epoll_flush(ep, link);
+}
+
+// Read what the fd has into the rx ring, and hand over the frames in there,
+// until on_frame takes the link out of the loop (and out of ev). Returns the
+// number of frames, or -1 at end of file or on an error.
+static int epoll_receive(libframes_epoll_link_t *link, const struct epoll_event *ev) {
+    // There's always room: the ring is drained down to a partial frame after
+    // every read, and it holds more than the biggest one.
+    void *pieces[2];
+    uint32_t piece_szs[2];
+    int n = libframes_rx_ring_reserve(&link->ctx, pieces, piece_szs);
+    struct iovec iov[2];
+    for (int i = 0; i < n; i++) {
+        iov[i].iov_base = pieces[i];
+        iov[i].iov_len = piece_szs[i];
+    }
+    ssize_t sz;
+    do {
+        sz = readv(link->fd, iov, n);
+    } while (sz < 0 && errno == EINTR);
+    if (sz == 0) {
+        return -1;
+    }
+    if (sz < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    libframes_rx_ring_commit(&link->ctx, sz);
+
+    int frame_count = 0;
+    uint32_t frame_sz;
+    while (libframes_read_begin(&link->ctx, &frame_sz) == 0) {
+        const void *frame = NULL;
+        libframes_read_peek(&link->ctx, &frame, &frame_sz);
+        link->on_frame(link->user, frame, frame_sz);
+        frame_count++;
+        // The frame is on_frame's until it returns, so the read can't be
+        // over before; but if the link has left the loop it might be gone.
+        if (!ev->data.ptr) {
+            break;
+        }
+        libframes_read_end(&link->ctx);
+    }
+    return frame_count;
+}
+
+int libframes_epoll_run(libframes_epoll_t *ep, int timeout_ms) {
+    struct epoll_event events[LIBFRAMES_EPOLL_EVENTS];
+    int n = epoll_wait(ep->epfd, events, LIBFRAMES_EPOLL_EVENTS, timeout_ms);
+    if (n < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    // One read per ready link per call, so that a busy link can't starve
+    // the others; epoll reports it again next time if there's more.
+    ep->batch = events;
+    ep->batch_n = n;
+    int frame_count = 0;
+    for (int i = 0; i < n; i++) {
+        libframes_epoll_link_t *link = events[i].data.ptr;
+        if (!link) {
+            // Taken out of the loop by an earlier link's on_frame.
+            continue;
+        }
+        int ret = 0;
+        if (events[i].events & EPOLLOUT) {
+            ret = epoll_flush(ep, link);
+        }
+        if (ret == 0 && events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+            ret = epoll_receive(link, &events[i]);
+            if (ret > 0) {
+                frame_count += ret;
+            }
+        }
+        if (ret < 0 && events[i].data.ptr) {
+            // The link is done for.
+            libframes_epoll_remove(ep, link);
+            link->on_frame(link->user, NULL, 0);
+        }
+    }
+    ep->batch_n = 0;
+    return frame_count;
+}
@@ -0,0 +1,72 @@
+#ifndef __LIBFRAMES_EPOLL_H__
+#define __LIBFRAMES_EPOLL_H__
+
+// An optional driver for Linux: frames links over file descriptors (ttys,
+// ptys, sockets) from one epoll loop. Received bytes are read straight into
+// each link's rx ring, and encoded frames are queued and written out with
+// writev as the fd takes them.
+
+#include "libframes.h"
+
+// One link. All of it belongs to the driver between libframes_epoll_add and
+// libframes_epoll_remove (or the link being closed), except ctx.stats: that
+// can be looked at, or snapshotted with libframes_stats_snapshot, from the
+// thread that calls libframes_epoll_run, between calls or from on_frame. Not
+// from any other thread, as the loop counts into it.
+typedef struct {
+    libframes_ctx_t ctx;
+    int fd;
+    // Called with each good frame received, and with NULL once the fd has hit
+    // end of file or an error and the link has left the loop.
+    libframes_on_frame_t on_frame;
+    void *user;
+
+    // Encoded frames waiting for the fd to take them, a ring of
+    // tx_queue_sz bytes.
+    char *tx_queue;
+    uint32_t tx_queue_sz;
+    uint32_t tx_queue_head;
+    uint32_t tx_queue_len;
+    // Whether the loop is waiting for the fd to be writable.
+    int tx_waiting;
+} libframes_epoll_link_t;
+
+typedef struct {
+    int epfd;
+    // The events libframes_epoll_run is working through (struct epoll_event),
+    // so that links taken out of the loop meanwhile can be taken out of them
+    // too.
+    void *batch;
+    int batch_n;
+} libframes_epoll_t;
+
+// Functions that make system calls return -1 and set errno if one fails.
+// Writing to a socket or pty whose other end is gone raises SIGPIPE, which
+// callers will usually want to ignore.
+
+int libframes_epoll_init(libframes_epoll_t *);
+void libframes_epoll_close(libframes_epoll_t *);
+
+// Put fd in the loop as a link, and make it nonblocking. The caller provides
+// the memory for the link's rx ring and frame buffer (see libframes_init), and
+// for the tx queue. The fd stays the caller's to close.
+int libframes_epoll_add(libframes_epoll_t *, libframes_epoll_link_t *, int fd,
+        libframes_on_frame_t on_frame, void *user,
+        void *rx_ring, uint32_t rx_ring_sz, void *frame_buffer, uint32_t max_frame_sz,
+        void *tx_queue, uint32_t tx_queue_sz);
+// Take a link out of the loop. It can be done from any link's on_frame: the
+// link's on_frame isn't called again, and the driver doesn't touch it again,
+// even if it was ready in the same libframes_epoll_run call.
+int libframes_epoll_remove(libframes_epoll_t *, libframes_epoll_link_t *);
+
+// Queue a frame and write out as much of the tx queue as the fd takes.
+// Returns LIBFRAMES_ERROR_NOT_READY, queueing nothing, if the tx queue might
+// not have room for it.
+int libframes_epoll_send(libframes_epoll_t *, libframes_epoll_link_t *, const void *, uint32_t);
+
+// Wait up to timeout_ms (-1 for ever) for links to be readable or writable,
+// and service them: receive and hand over frames, and write out tx queues.
+// Returns the number of frames received.
+int libframes_epoll_run(libframes_epoll_t *, int timeout_ms);
+
+#endif
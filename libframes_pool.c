@@ -0,0 +1,260 @@
+#include "libframes_pool.h"
+
+#include <sched.h>
+
+// Where a link is. Only one worker can take a link out of a queue, and a
+// link is only put back in one once it is idle again, or by the worker that
+// has it.
+//
+// Every change of state is a read-modify-write, so each one carries along
+// the bytes committed to the rx ring before every change ahead of it. A
+// plain load in libframes_pool_notify, or a plain store in the worker, would
+// let the two miss each other: the worker could find the ring empty and go
+// idle while the producer, seeing the link queued, leaves it be.
+enum {
+    // Nothing to do.
+    POOL_IDLE,
+    // In a queue.
+    POOL_QUEUED,
+    // In a queue, and notified again since.
+    POOL_QUEUED_NOTIFIED,
+    // A worker has it.
+    POOL_RUNNING,
+    // A worker has it, and there are new bytes it might not have seen.
+    POOL_RUNNING_NOTIFIED
+};
+
+static void pool_push(libframes_pool_t *pool, libframes_pool_worker_t *worker, libframes_pool_link_t *link) {
+    pthread_mutex_lock(&worker->lock);
+    uint32_t tail = worker->queue_head + worker->queue_len;
+    if (tail >= pool->max_links) {
+        tail -= pool->max_links;
+    }
+    worker->queue[tail] = link;
+    worker->queue_len++;
+    pthread_mutex_unlock(&worker->lock);
+
+    // Wake a worker if they're all asleep. A worker going to sleep counts
+    // itself as sleeping before it checks queued one last time, so one of
+    // the two sees the other.
+    atomic_fetch_add(&pool->queued, 1);
+    if (atomic_load(&pool->sleeping) > 0) {
+        pthread_mutex_lock(&pool->idle_lock);
+        pthread_cond_signal(&pool->idle_cond);
+        pthread_mutex_unlock(&pool->idle_lock);
+    }
+}
+
+// Take the link that has waited longest from a worker's own queue, or the one
+// that has waited least from another worker's.
+static libframes_pool_link_t *pool_pop(libframes_pool_t *pool, libframes_pool_worker_t *worker, int steal) {
+    libframes_pool_link_t *link = NULL;
+    pthread_mutex_lock(&worker->lock);
+    if (worker->queue_len > 0) {
+        worker->queue_len--;
+        if (steal) {
+            uint32_t tail = worker->queue_head + worker->queue_len;
+            link = worker->queue[tail >= pool->max_links ? tail - pool->max_links : tail];
+        } else {
+            link = worker->queue[worker->queue_head];
+            worker->queue_head = worker->queue_head + 1 == pool->max_links ? 0 : worker->queue_head + 1;
+        }
+    }
+    pthread_mutex_unlock(&worker->lock);
+    if (link) {
+        atomic_fetch_sub(&pool->queued, 1);
+    }
+    return link;
+}
+
+// Take frames out of a link, then either let it go idle or, if there's more
+// to do, put it at the back of the worker's queue.
+static void pool_run_link(libframes_pool_t *pool, libframes_pool_worker_t *worker, libframes_pool_link_t *link) {
+    atomic_exchange(&link->state, POOL_RUNNING);
+#ifndef LIBFRAMES_NO_STATS
+    int snapshot_req = atomic_load(&link->snapshot_req);
+    if (snapshot_req != 0) {
+        libframes_stats_snapshot(link->ctx, link->snapshot, snapshot_req == 2);
+        atomic_store(&link->snapshot_req, 0);
+    }
+#endif
+
+    uint32_t frame_count = 0;
+    uint32_t frame_sz;
+    int ret;
+    while (frame_count < LIBFRAMES_POOL_BUDGET
+            && (ret = libframes_read_begin(link->ctx, &frame_sz)) != LIBFRAMES_READ_ERROR_NO_FRAME) {
+        if (ret == 0) {
+            const void *frame = NULL;
+            libframes_read_peek(link->ctx, &frame, &frame_sz);
+            link->on_frame(link->user, frame, frame_sz);
+            libframes_read_end(link->ctx);
+            frame_count++;
+        }
+    }
+    worker->frame_count += frame_count;
+
+    int state = POOL_RUNNING;
+    if (frame_count < LIBFRAMES_POOL_BUDGET && atomic_compare_exchange_strong(&link->state, &state, POOL_IDLE)) {
+        return;
+    }
+    atomic_exchange(&link->state, POOL_QUEUED);
+    pool_push(pool, worker, link);
+}
+
+static void *pool_worker(void *arg) {
+    libframes_pool_worker_t *worker = arg;
+    libframes_pool_t *pool = worker->pool;
+    int self = worker - pool->workers;
+
+    while (!atomic_load(&pool->stopping)) {
+        libframes_pool_link_t *link = pool_pop(pool, worker, 0);
+        // Nothing of our own: look through the others' queues, starting
+        // with the next worker's so that thieves spread out.
+        for (int i = 1; !link && i < pool->workers_n; i++) {
+            link = pool_pop(pool, &pool->workers[(self + i) % pool->workers_n], 1);
+            if (link) {
+                worker->steal_count++;
+            }
+        }
+        if (link) {
+            pool_run_link(pool, worker, link);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->idle_lock);
+        atomic_fetch_add(&pool->sleeping, 1);
+        while (atomic_load(&pool->queued) == 0 && !atomic_load(&pool->stopping)) {
+            pthread_cond_wait(&pool->idle_cond, &pool->idle_lock);
+        }
+        atomic_fetch_sub(&pool->sleeping, 1);
+        pthread_mutex_unlock(&pool->idle_lock);
+    }
+    return NULL;
+}
+
+// Stop the first threads_n workers and wait for them to finish.
+static void pool_join(libframes_pool_t *pool, int threads_n) {
+    pthread_mutex_lock(&pool->idle_lock);
+    atomic_store(&pool->stopping, 1);
+    pthread_cond_broadcast(&pool->idle_cond);
+    pthread_mutex_unlock(&pool->idle_lock);
+    for (int i = 0; i < threads_n; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+}
+
+// Destroy the pool's own lock and condition, and the first locks_n workers'
+// locks.
+static void pool_destroy_locks(libframes_pool_t *pool, int locks_n) {
+    for (int i = 0; i < locks_n; i++) {
+        pthread_mutex_destroy(&pool->workers[i].lock);
+    }
+    pthread_cond_destroy(&pool->idle_cond);
+    pthread_mutex_destroy(&pool->idle_lock);
+}
+
+int libframes_pool_init(libframes_pool_t *pool, libframes_pool_worker_t *workers, int workers_n,
+        libframes_pool_link_t **queues, uint32_t max_links) {
+    pool->workers = workers;
+    pool->workers_n = workers_n;
+    pool->max_links = max_links;
+    pool->links_n = 0;
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->sleeping, 0);
+    atomic_init(&pool->stopping, 0);
+    int err = pthread_mutex_init(&pool->idle_lock, NULL);
+    if (err != 0) {
+        return err;
+    }
+    err = pthread_cond_init(&pool->idle_cond, NULL);
+    if (err != 0) {
+        pthread_mutex_destroy(&pool->idle_lock);
+        return err;
+    }
+
+    int locks_n = 0;
+    for (; locks_n < workers_n; locks_n++) {
+        libframes_pool_worker_t *worker = &workers[locks_n];
+        worker->pool = pool;
+        err = pthread_mutex_init(&worker->lock, NULL);
+        if (err != 0) {
+            break;
+        }
+        worker->queue = &queues[locks_n * max_links];
+        worker->queue_head = 0;
+        worker->queue_len = 0;
+        worker->frame_count = 0;
+        worker->steal_count = 0;
+    }
+    int threads_n = 0;
+    for (; err == 0 && threads_n < workers_n; threads_n++) {
+        err = pthread_create(&workers[threads_n].thread, NULL, pool_worker, &workers[threads_n]);
+        if (err != 0) {
+            break;
+        }
+    }
+    if (err != 0) {
+        // Undo whatever got done: the workers that started might already be
+        // waiting on the locks.
+        pool_join(pool, threads_n);
+        pool_destroy_locks(pool, locks_n);
+        return err;
+    }
+    return 0;
+}
+
+int libframes_pool_add(libframes_pool_t *pool, libframes_pool_link_t *link, libframes_ctx_t *ctx,
+        libframes_on_frame_t on_frame, void *user) {
+    if (pool->links_n == pool->max_links) {
+        return LIBFRAMES_ERROR_BAD_SIZE;
+    }
+    link->ctx = ctx;
+    link->on_frame = on_frame;
+    link->user = user;
+    link->home = pool->links_n % pool->workers_n;
+    atomic_init(&link->state, POOL_IDLE);
+#ifndef LIBFRAMES_NO_STATS
+    atomic_init(&link->snapshot_req, 0);
+#endif
+    pool->links_n++;
+    return 0;
+}
+
+void libframes_pool_notify(libframes_pool_t *pool, libframes_pool_link_t *link) {
+    int state = atomic_load(&link->state);
+    for (;;) {
+        // Whoever has the link already will look at the new bytes, as long
+        // as it hears about them.
+        int next = state == POOL_IDLE ? POOL_QUEUED
+            : state == POOL_QUEUED || state == POOL_QUEUED_NOTIFIED ? POOL_QUEUED_NOTIFIED
+            : POOL_RUNNING_NOTIFIED;
+        if (atomic_compare_exchange_weak(&link->state, &state, next)) {
+            if (state == POOL_IDLE) {
+                pool_push(pool, &pool->workers[link->home], link);
+            }
+            return;
+        }
+    }
+}
+
+#ifndef LIBFRAMES_NO_STATS
+void libframes_pool_stats_snapshot(libframes_pool_t *pool, libframes_pool_link_t *link, libframes_stats_t *stats,
+        int reset) {
+    link->snapshot = stats;
+    atomic_store(&link->snapshot_req, reset ? 2 : 1);
+    // Whichever worker gets the link from here on sees the request.
+    libframes_pool_notify(pool, link);
+    while (atomic_load(&link->snapshot_req) != 0) {
+        sched_yield();
+    }
+}
+#endif
+
+void libframes_pool_stop(libframes_pool_t *pool) {
+    pool_join(pool, pool->workers_n);
+}
+
+void libframes_pool_destroy(libframes_pool_t *pool) {
+    pool_destroy_locks(pool, pool->workers_n);
+}
@@ -0,0 +1,105 @@
+#ifndef __LIBFRAMES_POOL_H__
+#define __LIBFRAMES_POOL_H__
+
+// An optional runtime that spreads the decoding of many links over a fixed
+// pool of worker threads. Each worker has a queue of links with received
+// bytes; workers with nothing to do steal links from the others' queues. A
+// link is only ever in one queue, or being processed by one worker, at a
+// time, so its receive side stays single-threaded. Needs LIBFRAMES_SPSC, as
+// bytes are injected into the links' rx rings on other threads.
+
+#include "libframes.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#ifndef LIBFRAMES_SPSC
+    #error libframes_pool needs LIBFRAMES_SPSC.
+#endif
+
+// How many frames a worker takes out of a link before giving the other links
+// in its queue a turn.
+#ifndef LIBFRAMES_POOL_BUDGET
+    #define LIBFRAMES_POOL_BUDGET 64
+#endif
+
+typedef struct {
+    libframes_ctx_t *ctx;
+    // Called, on whichever worker has the link, with each good frame.
+    libframes_on_frame_t on_frame;
+    void *user;
+    // Which worker's queue libframes_pool_notify puts the link in.
+    int home;
+    _Atomic int state;
+#ifndef LIBFRAMES_NO_STATS
+    // A snapshot libframes_pool_stats_snapshot is waiting for: 0 for none, 1,
+    // or 2 to reset the stats as well. The worker that gets the link next
+    // takes it, into snapshot.
+    _Atomic int snapshot_req;
+    libframes_stats_t *snapshot;
+#endif
+} libframes_pool_link_t;
+
+struct libframes_pool;
+
+typedef struct {
+    struct libframes_pool *pool;
+    pthread_t thread;
+    // The queue: a ring of links, with room for all of them.
+    pthread_mutex_t lock;
+    libframes_pool_link_t **queue;
+    uint32_t queue_head;
+    uint32_t queue_len;
+    // Stats, only for the worker itself until libframes_pool_stop.
+    uint64_t frame_count;
+    uint64_t steal_count;
+} libframes_pool_worker_t;
+
+typedef struct libframes_pool {
+    libframes_pool_worker_t *workers;
+    int workers_n;
+    uint32_t max_links;
+    uint32_t links_n;
+    // Links waiting in queues; workers sleep while there are none.
+    _Atomic uint32_t queued;
+    _Atomic int sleeping;
+    _Atomic int stopping;
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+} libframes_pool_t;
+
+// Start workers_n workers, for up to max_links links. The caller provides
+// the memory for the workers and for their queues: workers_n * max_links
+// link pointers. Returns 0, or a pthread error, having undone everything
+// (stopped the workers that started and destroyed the locks).
+int libframes_pool_init(libframes_pool_t *, libframes_pool_worker_t *workers, int workers_n,
+        libframes_pool_link_t **queues, uint32_t max_links);
+
+// Hand a link's context over to the pool. Only libframes_inject_rx_ring (and
+// the pool's workers) may touch it from then on. Returns
+// LIBFRAMES_ERROR_BAD_SIZE if the pool already has max_links links.
+int libframes_pool_add(libframes_pool_t *, libframes_pool_link_t *, libframes_ctx_t *,
+        libframes_on_frame_t on_frame, void *user);
+
+// Tell the pool that there are new bytes in a link's rx ring. Can be called
+// from any thread, on_frame included.
+void libframes_pool_notify(libframes_pool_t *, libframes_pool_link_t *);
+
+#ifndef LIBFRAMES_NO_STATS
+// libframes_stats_snapshot for a link in the pool, from any thread: the
+// worker that has the link takes the snapshot, and this waits for it. The
+// link's ctx.stats mustn't be looked at or snapshotted from outside
+// otherwise. The frames written from other threads than on_frame's are
+// counted in the same stats, so they race with it. One snapshot at a time
+// per link, and only while the workers are running.
+void libframes_pool_stats_snapshot(libframes_pool_t *, libframes_pool_link_t *, libframes_stats_t *, int reset);
+#endif
+
+// Stop the workers and wait for them to finish. Links still queued are left
+// as they are.
+void libframes_pool_stop(libframes_pool_t *);
+// Free the pool's locks, once it is stopped. The workers' stats can still be
+// read afterwards.
+void libframes_pool_destroy(libframes_pool_t *);
+
+#endif
@@ -0,0 +1,148 @@
+#include "libframes_txq.h"
+
+#include <string.h>
+
+// What comes before each frame in a queue.
+typedef struct {
+    uint64_t queued_ns;
+    uint32_t sz;
+} txq_record_t;
+
+void libframes_txq_queue_init(libframes_txq_queue_t *queue, void *buf, uint32_t buf_sz) {
+    queue->buf = buf;
+    queue->buf_sz = buf_sz;
+    queue->head = 0;
+    queue->tail = 0;
+    queue->end = 0;
+    queue->wrapped = 0;
+    memset(&queue->stats, 0, sizeof(queue->stats));
+}
+
+void libframes_txq_init(libframes_txq_t *txq, libframes_ctx_t *ctx, libframes_txq_queue_t *queues, int queues_n,
+        libframes_txq_clock_t clock, void *clock_user) {
+    txq->ctx = ctx;
+    txq->queues = queues;
+    txq->queues_n = queues_n;
+    txq->clock = clock;
+    txq->clock_user = clock_user;
+}
+
+// Find room for a record of up to sz bytes, in one piece. Returns NULL if
+// there isn't any.
+static uint8_t *txq_reserve(libframes_txq_queue_t *queue, uint32_t sz) {
+    if (queue->wrapped) {
+        return queue->head - queue->tail >= sz ? &queue->buf[queue->tail] : NULL;
+    }
+    if (queue->buf_sz - queue->tail >= sz) {
+        return &queue->buf[queue->tail];
+    }
+    if (queue->head >= sz) {
+        queue->end = queue->tail;
+        queue->tail = 0;
+        queue->wrapped = 1;
+        return queue->buf;
+    }
+    return NULL;
+}
+
+// Finish the record at p, whose frame is sz bytes.
+static void txq_commit(libframes_txq_t *txq, libframes_txq_queue_t *queue, uint8_t *p, uint32_t sz) {
+    txq_record_t record = {txq->clock(txq->clock_user), sz};
+    memcpy(p, &record, sizeof(record));
+    queue->tail += sizeof(record) + sz;
+    queue->stats.push_count++;
+    queue->stats.depth++;
+    queue->stats.depth_bytes += sz;
+    if (queue->stats.depth > queue->stats.max_depth) {
+        queue->stats.max_depth = queue->stats.depth;
+    }
+}
+
+int libframes_txq_push(libframes_txq_t *txq, int q, const void *p, uint32_t sz) {
+    if (q < 0 || q >= txq->queues_n || sz > txq->ctx->max_frame_sz - LIBFRAMES_CRC_SZ) {
+        return LIBFRAMES_ERROR_BAD_SIZE;
+    }
+    libframes_txq_queue_t *queue = &txq->queues[q];
+    uint32_t max_sz = txq->ctx->cobs ? LIBFRAMES_COBS_ENCODED_MAX_SZ(sz) : LIBFRAMES_ENCODED_MAX_SZ(sz);
+    uint8_t *record = txq_reserve(queue, sizeof(txq_record_t) + max_sz);
+    if (!record) {
+        queue->stats.full_count++;
+        return LIBFRAMES_ERROR_NOT_READY;
+    }
+    uint8_t *encoded = record + sizeof(txq_record_t);
+    uint32_t encoded_sz = txq->ctx->cobs ? libframes_cobs_encode(p, sz, encoded, max_sz)
+        : libframes_encode(p, sz, encoded, max_sz);
+    txq_commit(txq, queue, record, encoded_sz);
+    return 0;
+}
+
+int libframes_txq_push_encoded(libframes_txq_t *txq, int q, const void *p, uint32_t sz) {
+    if (q < 0 || q >= txq->queues_n) {
+        return LIBFRAMES_ERROR_BAD_SIZE;
+    }
+    libframes_txq_queue_t *queue = &txq->queues[q];
+    uint8_t *record = txq_reserve(queue, sizeof(txq_record_t) + sz);
+    if (!record) {
+        queue->stats.full_count++;
+        return LIBFRAMES_ERROR_NOT_READY;
+    }
+    memcpy(record + sizeof(txq_record_t), p, sz);
+    txq_commit(txq, queue, record, sz);
+    return 0;
+}
+
+uint32_t libframes_txq_drain(libframes_txq_t *txq, uint32_t budget) {
+    uint32_t drained = 0;
+    for (;;) {
+        libframes_txq_queue_t *queue = NULL;
+        for (int q = 0; q < txq->queues_n; q++) {
+            if (txq->queues[q].stats.depth > 0) {
+                queue = &txq->queues[q];
+                break;
+            }
+        }
+        if (!queue) {
+            break;
+        }
+
+        txq_record_t record;
+        memcpy(&record, &queue->buf[queue->head], sizeof(record));
+        if (record.sz > budget - drained
+                || libframes_write_encoded(txq->ctx, &queue->buf[queue->head + sizeof(record)], record.sz) != 0) {
+            break;
+        }
+        drained += record.sz;
+
+        uint64_t latency_ns = txq->clock(txq->clock_user) - record.queued_ns;
+        queue->stats.frame_count++;
+        queue->stats.byte_count += record.sz;
+        queue->stats.latency_total_ns += latency_ns;
+        if (latency_ns > queue->stats.latency_max_ns) {
+            queue->stats.latency_max_ns = latency_ns;
+        }
+        queue->stats.depth--;
+        queue->stats.depth_bytes -= record.sz;
+
+        // Move on to the next record, wherever it is.
+        queue->head += sizeof(record) + record.sz;
+        if (queue->wrapped && queue->head == queue->end) {
+            queue->head = 0;
+            queue->wrapped = 0;
+        } else if (!queue->wrapped && queue->head == queue->tail) {
+            queue->head = 0;
+            queue->tail = 0;
+        }
+    }
+    return drained;
+}
+
+void libframes_txq_stats_snapshot(libframes_txq_t *txq, int q, libframes_txq_stats_t *stats, int reset) {
+    libframes_txq_queue_t *queue = &txq->queues[q];
+    *stats = queue->stats;
+    if (reset) {
+        memset(&queue->stats, 0, sizeof(queue->stats));
+        queue->stats.depth = stats->depth;
+        queue->stats.depth_bytes = stats->depth_bytes;
+        queue->stats.max_depth = stats->depth;
+    }
+}
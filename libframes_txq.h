@@ -0,0 +1,84 @@
+#ifndef __LIBFRAMES_TXQ_H__
+#define __LIBFRAMES_TXQ_H__
+
+// An optional transmit scheduler: frames are encoded when they are queued,
+// in one of several queues, and handed whole to a link's write_platform by
+// libframes_txq_drain, highest priority queue first. A frame is never
+// interrupted, but the next frame to go out is always from the highest
+// priority queue that has one, so an urgent frame only waits for the one
+// going out ahead of it, however much bulk is queued behind.
+
+#include "libframes.h"
+
+// Returns the time in ns, from any fixed point. The argument is the
+// clock_user given to libframes_txq_init.
+typedef uint64_t (*libframes_txq_clock_t)(void *);
+
+typedef struct {
+    uint64_t
+        // Frames queued, and frames turned away because the queue was full.
+        push_count,
+        full_count,
+        // Frames handed to write_platform, and their encoded bytes.
+        frame_count,
+        byte_count,
+        // Frames and encoded bytes waiting now, and the most frames ever
+        // waiting.
+        depth,
+        depth_bytes,
+        max_depth,
+        // How long frames waited between being queued and being handed to
+        // write_platform: in total, and at most.
+        latency_total_ns,
+        latency_max_ns;
+} libframes_txq_stats_t;
+
+// A queue: records of a timestamp, a size and an encoded frame, back to back
+// in buf. A record is never split, so when there isn't room for one at the
+// end of buf it goes at the start, and the queue ends at end for the time
+// being.
+typedef struct {
+    uint8_t *buf;
+    uint32_t buf_sz;
+    uint32_t head;
+    uint32_t tail;
+    uint32_t end;
+    int wrapped;
+    libframes_txq_stats_t stats;
+} libframes_txq_queue_t;
+
+typedef struct {
+    libframes_ctx_t *ctx;
+    libframes_txq_queue_t *queues;
+    int queues_n;
+    libframes_txq_clock_t clock;
+    void *clock_user;
+} libframes_txq_t;
+
+// Set up a queue with buf_sz bytes of buf to keep frames in.
+void libframes_txq_queue_init(libframes_txq_queue_t *, void *buf, uint32_t buf_sz);
+// Schedule frames for ctx from queues_n queues, queue 0 first.
+void libframes_txq_init(libframes_txq_t *, libframes_ctx_t *, libframes_txq_queue_t *queues, int queues_n,
+        libframes_txq_clock_t clock, void *clock_user);
+
+// Encode a frame, for ctx (with COBS if it has it on), into queue q.
+// Returns LIBFRAMES_ERROR_NOT_READY, queueing nothing, if the queue might not
+// have room for it, or LIBFRAMES_ERROR_BAD_SIZE if there's no queue q or the
+// frame is too big for ctx.
+int libframes_txq_push(libframes_txq_t *, int q, const void *, uint32_t);
+// The same for a frame that is already encoded.
+int libframes_txq_push_encoded(libframes_txq_t *, int q, const void *, uint32_t);
+
+// Hand queued frames to ctx's write_platform, in priority order, while they
+// fit in budget bytes (UINT32_MAX for as many as there are). Stops at the
+// first frame that doesn't fit, rather than let one from a lower priority
+// queue go ahead of it, and while ctx is in the middle of another frame.
+// Returns the number of bytes handed over.
+uint32_t libframes_txq_drain(libframes_txq_t *, uint32_t budget);
+
+// Copy queue q's stats into the third argument and, if reset is nonzero,
+// start them over (except for the depths, which are counted from what is
+// waiting).
+void libframes_txq_stats_snapshot(libframes_txq_t *, int q, libframes_txq_stats_t *, int reset);
+
+#endif
@@ -1,8 +1,13 @@
+#define _POSIX_C_SOURCE 200809L
 #define LIBFRAMES_MAX_FRAME_SZ 128
 #define LIBFRAMES_RX_RING_FRAMES 10
+#define LIBFRAMES_RX_RING_SZ (LIBFRAMES_MAX_FRAME_SZ * LIBFRAMES_RX_RING_FRAMES)
 #define LIBFRAMES_DLE 0x7d
 #define LIBFRAMES_XOR 0x20
 #define LIBFRAMES_LIM 0x7e
+#ifndef LIBFRAMES_TX_BUF_SZ
+    #define LIBFRAMES_TX_BUF_SZ 64
+#endif
 #include "libframes.c"
 
 #include <inttypes.h>
@@ -12,24 +17,132 @@
 
 #include "error.h"
 
-void libframes_write_platform(void *p, uint32_t sz) {
-    // This is a loopback.
-    libframes_inject_rx_ring(p, sz);
+#ifdef LIBFRAMES_SPSC
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifdef LIBFRAMES_POOL
+#include "libframes_pool.c"
+#endif
+
+#ifdef LIBFRAMES_CAPTURE
+#include "libframes_capture.c"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+#ifdef LIBFRAMES_ARQ
+#include "libframes_arq.c"
+#endif
+
+#ifdef LIBFRAMES_TXQ
+#include "libframes_txq.c"
+#endif
+
+#ifdef LIBFRAMES_EPOLL
+#include "libframes_epoll.c"
+
+#include <signal.h>
+#include <sys/socket.h>
+#endif
+
+static libframes_ctx_t ctx;
+
+// Set up a context that decodes frames of up to LIBFRAMES_MAX_FRAME_SZ bytes
+// in an rx ring of rx_ring_sz bytes.
+static void test_init(libframes_ctx_t *c, libframes_write_platform_t write_platform, void *user, uint32_t rx_ring_sz) {
+    EXPECT(libframes_init(c, write_platform, user, malloc(rx_ring_sz), rx_ring_sz, malloc(LIBFRAMES_MAX_FRAME_SZ), LIBFRAMES_MAX_FRAME_SZ), 0);
+}
+
+void loopback(void *user, void *p, uint32_t sz) {
+    libframes_inject_rx_ring(user, p, sz);
+}
+
+// A write_platform that collects what's written.
+static char captured[1024];
+static uint32_t captured_sz;
+
+void capture(void *user, void *p, uint32_t sz) {
+    memcpy(&captured[captured_sz], p, sz);
+    captured_sz += sz;
+}
+
+// A writev_platform that collects what's written, like capture.
+static uint32_t captured_calls;
+
+void capture_v(void *user, const libframes_iovec_t *iov, int iov_n) {
+    EXPECT((iov_n >= 1 && iov_n <= LIBFRAMES_WRITEV_IOV_N), 1);
+    for (int i = 0; i < iov_n; i++) {
+        capture(user, (void *)iov[i].p, iov[i].sz);
+    }
+    captured_calls++;
+}
+
+// An on_frame that collects the frames it's given, back to back.
+static char fed[1 << 18];
+static uint32_t fed_sz;
+static const void *fed_last;
+
+void on_fed_frame(void *user, const void *frame, uint32_t sz) {
+    memcpy(&fed[fed_sz], frame, sz);
+    fed_sz += sz;
+    fed_last = frame;
+}
+
+// Read all the frames there are out of a context, back to back into out.
+// Every third frame is only half read, so that discarding is counted too.
+static void read_all(libframes_ctx_t *c, char *out, uint32_t *out_sz) {
+    uint32_t frame_sz;
+    int ret;
+    while ((ret = libframes_read_begin(c, &frame_sz)) != LIBFRAMES_READ_ERROR_NO_FRAME) {
+        if (ret != 0) {
+            continue;
+        }
+        if (c->stats.rx_frame_count % 3 == 0) {
+            frame_sz /= 2;
+        }
+        EXPECT(libframes_read_exact(c, &out[*out_sz], frame_sz), 0);
+        *out_sz += frame_sz;
+        libframes_read_end(c);
+    }
 }
 
 void stress_test(uint32_t);
+#ifdef LIBFRAMES_SPSC
+void spsc_stress_test(void);
+#endif
+#ifdef LIBFRAMES_EPOLL
+void epoll_test(void);
+#endif
+#ifdef LIBFRAMES_POOL
+void pool_test(void);
+#endif
+#ifdef LIBFRAMES_CAPTURE
+void capture_test(void);
+#endif
+#ifdef LIBFRAMES_ARQ
+void arq_test(void);
+#endif
+#ifdef LIBFRAMES_TXQ
+void txq_test(void);
+#endif
 
 int main(void) {
     uint32_t frame_sz;
 
+    test_init(&ctx, loopback, &ctx, LIBFRAMES_RX_RING_SZ);
+
     // Test "frame too small" error.
     // + L L
     //   ---
     {
         char frame[] = {LIBFRAMES_LIM, LIBFRAMES_LIM};
-        libframes_inject_rx_ring(frame, sizeof(frame));
-        EXPECT(libframes_read_begin(&frame_sz), LIBFRAMES_READ_ERROR_TOO_SMALL);
-        EXPECT(libframes_stats.rx_frame_rejected_too_small, 1);
+        libframes_inject_rx_ring(&ctx, frame, sizeof(frame));
+        EXPECT(libframes_read_begin(&ctx, &frame_sz), LIBFRAMES_READ_ERROR_TOO_SMALL);
+        EXPECT(ctx.stats.rx_frame_rejected_too_small, 1);
     }
 
     // Test "bad frame encoding" error.
@@ -38,32 +151,32 @@ int main(void) {
     //     -----
     {
         char frame[] = {LIBFRAMES_LIM, LIBFRAMES_DLE, LIBFRAMES_LIM};
-        libframes_inject_rx_ring(frame, sizeof(frame));
+        libframes_inject_rx_ring(&ctx, frame, sizeof(frame));
         // Walk through remnants of previous bad frame.
-        EXPECT(libframes_read_begin(&frame_sz), LIBFRAMES_READ_ERROR_TOO_SMALL);
-        EXPECT(libframes_stats.rx_frame_rejected_too_small, 2);
+        EXPECT(libframes_read_begin(&ctx, &frame_sz), LIBFRAMES_READ_ERROR_TOO_SMALL);
+        EXPECT(ctx.stats.rx_frame_rejected_too_small, 2);
         // Bad frame encoding.
-        EXPECT(libframes_read_begin(&frame_sz), LIBFRAMES_READ_ERROR_BAD_ENCODING);
-        EXPECT(libframes_stats.rx_frame_rejected_encoding_error, 1);
+        EXPECT(libframes_read_begin(&ctx, &frame_sz), LIBFRAMES_READ_ERROR_BAD_ENCODING);
+        EXPECT(ctx.stats.rx_frame_rejected_encoding_error, 1);
     }
 
     // Test "no frame yet" response.
-    // L + h 0
-    // -------
+    // L + h e l l 0
+    // -------------
     {
-        char frame[] = {'h', 0};
-        libframes_inject_rx_ring(frame, sizeof(frame));
-        EXPECT(libframes_read_begin(&frame_sz), LIBFRAMES_READ_ERROR_NO_FRAME);
+        char frame[] = {'h', 'e', 'l', 'l', 0};
+        libframes_inject_rx_ring(&ctx, frame, sizeof(frame));
+        EXPECT(libframes_read_begin(&ctx, &frame_sz), LIBFRAMES_READ_ERROR_NO_FRAME);
     }
 
     // Test "bad frame crc8" error.
-    // L h 0 + L
-    // ---------
+    // L h e l l 0 + L
+    // ---------------
     {
         char frame[] = {LIBFRAMES_LIM};
-        libframes_inject_rx_ring(frame, sizeof(frame));
-        EXPECT(libframes_read_begin(&frame_sz), LIBFRAMES_READ_ERROR_BAD_CRC8);
-        EXPECT(libframes_stats.rx_frame_rejected_bad_crc8, 1);
+        libframes_inject_rx_ring(&ctx, frame, sizeof(frame));
+        EXPECT(libframes_read_begin(&ctx, &frame_sz), LIBFRAMES_READ_ERROR_BAD_CRC8);
+        EXPECT(ctx.stats.rx_frame_rejected_bad_crc8, 1);
     }
 
     // Test "frame too big" error. Won't use libframes_inject_rx_ring because
@@ -72,49 +185,798 @@ int main(void) {
     // -----
     //     ---------
     {
-        EXPECT(libframes_write_begin(), 0);
+        EXPECT(libframes_write_begin(&ctx), 0);
         char frame[LIBFRAMES_MAX_FRAME_SZ + 1];
-        EXPECT(libframes_write(frame, sizeof(frame)), 0);
-        EXPECT(libframes_write_end(), 0);
+        EXPECT(libframes_write(&ctx, frame, sizeof(frame)), 0);
+        EXPECT(libframes_write_end(&ctx), 0);
         // Walk through remnants of previous bad frame.
-        EXPECT(libframes_read_begin(&frame_sz), LIBFRAMES_READ_ERROR_TOO_SMALL);
-        EXPECT(libframes_stats.rx_frame_rejected_too_small, 3);
+        EXPECT(libframes_read_begin(&ctx, &frame_sz), LIBFRAMES_READ_ERROR_TOO_SMALL);
+        EXPECT(ctx.stats.rx_frame_rejected_too_small, 3);
         // Frame too big.
-        EXPECT(libframes_read_begin(&frame_sz), LIBFRAMES_READ_ERROR_TOO_BIG);
-        EXPECT(libframes_stats.rx_frame_rejected_too_big, 1);
+        EXPECT(libframes_read_begin(&ctx, &frame_sz), LIBFRAMES_READ_ERROR_TOO_BIG);
+        EXPECT(ctx.stats.rx_frame_rejected_too_big, 1);
     }
 
     // Test that after all of this nonsense, we write and receive a 'hello'
     // frame.
     {
-        EXPECT(libframes_write_begin(), 0);
+        EXPECT(libframes_write_begin(&ctx), 0);
         char hello[] = "hell0";
-        EXPECT(libframes_write(hello, sizeof(hello)), 0);
-        EXPECT(libframes_write_end(), 0);
+        EXPECT(libframes_write(&ctx, hello, sizeof(hello)), 0);
+        EXPECT(libframes_write_end(&ctx), 0);
         // Walk through remnants of previous bad frame.
-        EXPECT(libframes_read_begin(&frame_sz), LIBFRAMES_READ_ERROR_TOO_SMALL);
-        EXPECT(libframes_stats.rx_frame_rejected_too_small, 4);
+        EXPECT(libframes_read_begin(&ctx, &frame_sz), LIBFRAMES_READ_ERROR_TOO_SMALL);
+        EXPECT(ctx.stats.rx_frame_rejected_too_small, 4);
         // Now we should find "hell0\x00".
-        EXPECT(libframes_read_begin(&frame_sz), 0);
+        EXPECT(libframes_read_begin(&ctx, &frame_sz), 0);
         EXPECT(frame_sz, sizeof(hello));
         char hello_copy[sizeof(hello)];
         uint32_t hello_copy_sz;
-        EXPECT(libframes_read(hello_copy, sizeof(hello_copy), &hello_copy_sz), 0);
-        EXPECT(libframes_read_end(), 0);
+        EXPECT(libframes_read(&ctx, hello_copy, sizeof(hello_copy), &hello_copy_sz), 0);
+        EXPECT(libframes_read_end(&ctx), 0);
         EXPECT(hello_copy_sz, sizeof(hello));
         EXPECT(strcmp(hello, hello_copy), 0);
     }
 
+    // Test that a frame trickling in one byte at a time is decoded
+    // incrementally, and that escaped bytes are decoded.
+    {
+        EXPECT(libframes_write_begin(&ctx), 0);
+        char escapes[] = {'a', LIBFRAMES_DLE, LIBFRAMES_LIM, 'b'};
+        EXPECT(libframes_write(&ctx, escapes, sizeof(escapes)), 0);
+        EXPECT(libframes_write_end(&ctx), 0);
+        // Take the encoded frame back out of the ring, and trickle it back in.
+        char encoded[2 * (sizeof(escapes) + LIBFRAMES_CRC_SZ) + 2];
+        uint32_t encoded_sz = rx_ring_unread(&ctx);
+        for (uint32_t i = 0; i < encoded_sz; i++) {
+            encoded[i] = ctx.rx_ring[(ctx.rx_ring_tail + i) % LIBFRAMES_RX_RING_SZ];
+        }
+        rx_ring_consume(&ctx, encoded_sz);
+        uint64_t false_starts = ctx.stats.rx_false_starts;
+        for (uint32_t i = 0; i < encoded_sz - 1; i++) {
+            libframes_inject_rx_ring(&ctx, &encoded[i], 1);
+            EXPECT(libframes_read_begin(&ctx, &frame_sz), LIBFRAMES_READ_ERROR_NO_FRAME);
+        }
+        libframes_inject_rx_ring(&ctx, &encoded[encoded_sz - 1], 1);
+        EXPECT(libframes_read_begin(&ctx, &frame_sz), 0);
+        EXPECT(ctx.stats.rx_false_starts, false_starts);
+        EXPECT(frame_sz, sizeof(escapes));
+        char escapes_copy[sizeof(escapes)];
+        EXPECT(libframes_read_exact(&ctx, escapes_copy, sizeof(escapes_copy)), 0);
+        EXPECT(libframes_read_end(&ctx), 0);
+        EXPECT(memcmp(escapes, escapes_copy, sizeof(escapes)), 0);
+    }
+
+    // Test that libframes_inject_rx_ring accepts only what fits, and wraps
+    // around the end of the ring.
+    {
+        static char junk[LIBFRAMES_RX_RING_SZ + 10];
+        for (uint32_t i = 0; i < sizeof(junk); i++) {
+            junk[i] = 'a' + i % 26;
+        }
+        EXPECT(libframes_inject_rx_ring(&ctx, junk, LIBFRAMES_RX_RING_SZ - 3), LIBFRAMES_RX_RING_SZ - 3);
+        EXPECT(libframes_inject_rx_ring(&ctx, &junk[LIBFRAMES_RX_RING_SZ - 3], 10), 3);
+        EXPECT(libframes_inject_rx_ring(&ctx, junk, 1), 0);
+        EXPECT(rx_ring_unread(&ctx), LIBFRAMES_RX_RING_SZ);
+        for (uint32_t i = 0; i < LIBFRAMES_RX_RING_SZ; i++) {
+            EXPECT(ctx.rx_ring[(ctx.rx_ring_tail + i) % LIBFRAMES_RX_RING_SZ], junk[i]);
+        }
+        // It's all false starts.
+        uint64_t false_starts = ctx.stats.rx_false_starts;
+        EXPECT(libframes_read_begin(&ctx, &frame_sz), LIBFRAMES_READ_ERROR_NO_FRAME);
+        EXPECT(ctx.stats.rx_false_starts, false_starts + LIBFRAMES_RX_RING_SZ);
+        EXPECT(rx_ring_unread(&ctx), 0);
+    }
+
+#if LIBFRAMES_TX_BUF_SZ > 0
+    // Test that written frames are staged, and handed to the platform once
+    // per frame, or once per LIBFRAMES_TX_BUF_SZ bytes for big frames.
+    {
+        uint64_t flush_count = ctx.stats.write_flush_count;
+        EXPECT(libframes_write_begin(&ctx), 0);
+        char hello[] = "hell0";
+        EXPECT(libframes_write(&ctx, hello, sizeof(hello)), 0);
+        EXPECT(ctx.stats.write_flush_count, flush_count);
+        EXPECT(rx_ring_unread(&ctx), 0);
+        EXPECT(libframes_write_end(&ctx), 0);
+        EXPECT(ctx.stats.write_flush_count, flush_count + 1);
+        // The checksum may need escaping, whichever it is.
+        char encoded[LIBFRAMES_ENCODED_MAX_SZ(LIBFRAMES_TX_BUF_SZ + 10)];
+        uint32_t hello_sz = libframes_encode(hello, sizeof(hello), encoded, sizeof(encoded));
+        EXPECT(rx_ring_unread(&ctx), hello_sz);
+
+        char big[LIBFRAMES_TX_BUF_SZ + 10];
+        memset(big, 'a', sizeof(big));
+        EXPECT(libframes_write_begin(&ctx), 0);
+        EXPECT(libframes_write(&ctx, big, sizeof(big)), 0);
+        EXPECT(ctx.stats.write_flush_count, flush_count + 2);
+        EXPECT(rx_ring_unread(&ctx), hello_sz + LIBFRAMES_TX_BUF_SZ);
+        EXPECT(libframes_write_end(&ctx), 0);
+        EXPECT(ctx.stats.write_flush_count, flush_count + 3);
+        uint32_t big_sz = libframes_encode(big, sizeof(big), encoded, sizeof(encoded));
+        EXPECT(rx_ring_unread(&ctx), hello_sz + big_sz);
+
+        EXPECT(libframes_read_begin(&ctx, &frame_sz), 0);
+        EXPECT(frame_sz, sizeof(hello));
+        EXPECT(libframes_read_end(&ctx), 0);
+        EXPECT(libframes_read_begin(&ctx, &frame_sz), 0);
+        EXPECT(frame_sz, sizeof(big));
+        EXPECT(libframes_read_end(&ctx), 0);
+    }
+#else
+    // Test that without a tx buffer, written bytes go to the platform as
+    // they are written.
+    {
+        uint64_t flush_count = ctx.stats.write_flush_count;
+        EXPECT(libframes_write_begin(&ctx), 0);
+        EXPECT(rx_ring_unread(&ctx), 1);
+        char hello[] = "hell0";
+        EXPECT(libframes_write(&ctx, hello, sizeof(hello)), 0);
+        EXPECT(rx_ring_unread(&ctx), 1 + sizeof(hello));
+        EXPECT(libframes_write_end(&ctx), 0);
+        char encoded[LIBFRAMES_ENCODED_MAX_SZ(sizeof(hello))];
+        uint32_t hello_sz = libframes_encode(hello, sizeof(hello), encoded, sizeof(encoded));
+        EXPECT(rx_ring_unread(&ctx), hello_sz);
+        EXPECT((ctx.stats.write_flush_count >= flush_count + 3), 1);
+
+        EXPECT(libframes_read_begin(&ctx, &frame_sz), 0);
+        EXPECT(frame_sz, sizeof(hello));
+        EXPECT(libframes_read_end(&ctx), 0);
+    }
+#endif
+
+    // Test that escapes are found wherever they are, including in the
+    // leftovers after the vectorized part.
+    {
+        uint8_t clean[80];
+        memset(clean, 'a', sizeof(clean));
+        for (uint32_t sz = 0; sz <= sizeof(clean); sz++) {
+            EXPECT(libframes_find_special(clean, sz), sz);
+            for (uint32_t i = 0; i < sz; i++) {
+                clean[i] = i % 2 ? LIBFRAMES_DLE : LIBFRAMES_LIM;
+                EXPECT(libframes_find_special(clean, sz), i);
+                clean[i] = 'a';
+            }
+        }
+    }
+
+    // Test the checksum against its check value, the checksum of
+    // "123456789".
+    {
+        uint8_t check[LIBFRAMES_CRC_SZ];
+        libframes_crc_final(libframes_crc_update(LIBFRAMES_CRC_INIT, (uint8_t *)"123456789", 9), check);
+#if LIBFRAMES_CRC == 32
+        uint8_t expected[] = {0x83, 0x92, 0x06, 0xe3};
+#elif LIBFRAMES_CRC == 16
+        uint8_t expected[] = {0x29, 0xb1};
+#else
+        uint8_t expected[] = {0xf4};
+#endif
+        EXPECT(memcmp(check, expected, sizeof(expected)), 0);
+    }
+
+    // Test that two contexts are independent links: a writes into b's ring
+    // and vice versa, and each keeps its own stats.
+    {
+        static libframes_ctx_t a, b;
+        test_init(&a, loopback, &b, LIBFRAMES_RX_RING_SZ);
+        test_init(&b, loopback, &a, LIBFRAMES_RX_RING_SZ);
+        char ping[] = "ping";
+        EXPECT(libframes_write_begin(&a), 0);
+        // b can write at the same time.
+        EXPECT(libframes_write_begin(&b), 0);
+        EXPECT(libframes_write(&a, ping, sizeof(ping)), 0);
+        EXPECT(libframes_write_end(&a), 0);
+        EXPECT(libframes_write_end(&b), 0);
+        EXPECT(a.stats.write_frame_count, 1);
+        EXPECT(b.stats.write_frame_count, 1);
+        EXPECT(libframes_read_begin(&b, &frame_sz), 0);
+        EXPECT(frame_sz, sizeof(ping));
+        char ping_copy[sizeof(ping)];
+        EXPECT(libframes_read_exact(&b, ping_copy, sizeof(ping_copy)), 0);
+        EXPECT(libframes_read_end(&b), 0);
+        EXPECT(memcmp(ping, ping_copy, sizeof(ping)), 0);
+        EXPECT(libframes_read_begin(&a, &frame_sz), 0);
+        EXPECT(frame_sz, 0);
+        EXPECT(libframes_read_end(&a), 0);
+        EXPECT(a.stats.rx_frame_count, 1);
+        EXPECT(b.stats.rx_frame_count, 1);
+    }
+
+    // Test peeking at frames: clean frames are read straight out of the ring,
+    // frames with escapes or that wrap around the ring end in frame_buffer.
+    {
+        char hello[] = "hell0";
+        char escapes[] = {'a', LIBFRAMES_DLE, LIBFRAMES_LIM, 'b'};
+        const void *peeked;
+        uint32_t peeked_sz;
+
+        EXPECT(libframes_read_peek(&ctx, &peeked, &peeked_sz), LIBFRAMES_ERROR_NOT_READY);
+
+        EXPECT(libframes_write_begin(&ctx), 0);
+        EXPECT(libframes_write(&ctx, hello, sizeof(hello)), 0);
+        EXPECT(libframes_write_end(&ctx), 0);
+        EXPECT(libframes_read_begin(&ctx, &frame_sz), 0);
+        uint64_t read_byte_count = ctx.stats.read_byte_count;
+        EXPECT(libframes_read_peek(&ctx, &peeked, &peeked_sz), 0);
+        EXPECT(peeked_sz, sizeof(hello));
+        EXPECT(ctx.stats.read_byte_count, read_byte_count + sizeof(hello));
+        EXPECT((const char *)peeked >= ctx.rx_ring && (const char *)peeked < ctx.rx_ring + LIBFRAMES_RX_RING_SZ, 1);
+        EXPECT(memcmp(peeked, hello, sizeof(hello)), 0);
+        EXPECT(libframes_read_end(&ctx), 0);
+
+        EXPECT(libframes_write_begin(&ctx), 0);
+        EXPECT(libframes_write(&ctx, escapes, sizeof(escapes)), 0);
+        EXPECT(libframes_write_end(&ctx), 0);
+        EXPECT(libframes_read_begin(&ctx, &frame_sz), 0);
+        // Peeking after a partial read gets the rest.
+        char a;
+        EXPECT(libframes_read_exact(&ctx, &a, 1), 0);
+        EXPECT(libframes_read_peek(&ctx, &peeked, &peeked_sz), 0);
+        EXPECT(peeked_sz, sizeof(escapes) - 1);
+        EXPECT((const char *)peeked == ctx.frame_buffer + 1, 1);
+        EXPECT(memcmp(peeked, &escapes[1], sizeof(escapes) - 1), 0);
+        EXPECT(libframes_read_end(&ctx), 0);
+
+        // Hack: move the empty ring's tail close to its end.
+        EXPECT(rx_ring_unread(&ctx), 0);
+        ctx.rx_ring_tail = ctx.rx_ring_head = LIBFRAMES_RX_RING_SZ - 3;
+        EXPECT(libframes_write_begin(&ctx), 0);
+        EXPECT(libframes_write(&ctx, hello, sizeof(hello)), 0);
+        EXPECT(libframes_write_end(&ctx), 0);
+        EXPECT(libframes_read_begin(&ctx, &frame_sz), 0);
+        EXPECT(libframes_read_peek(&ctx, &peeked, &peeked_sz), 0);
+        EXPECT(peeked_sz, sizeof(hello));
+        EXPECT((const char *)peeked == ctx.frame_buffer, 1);
+        EXPECT(memcmp(peeked, hello, sizeof(hello)), 0);
+        EXPECT(libframes_read_end(&ctx), 0);
+        EXPECT(rx_ring_unread(&ctx), 0);
+    }
+
+    // Test draining several frames at once, skipping a bad one in between,
+    // and stopping at an incomplete frame.
+    {
+        char payloads[][6] = {"one", "two", "three", "four"};
+        for (int i = 0; i < 4; i++) {
+            EXPECT(libframes_write_begin(&ctx), 0);
+            EXPECT(libframes_write(&ctx, payloads[i], strlen(payloads[i])), 0);
+            EXPECT(libframes_write_end(&ctx), 0);
+            if (i == 0) {
+                // A frame with a bad checksum.
+                char bad[] = {LIBFRAMES_LIM, 'h', 'e', 'l', 'l', 'o', LIBFRAMES_LIM};
+                libframes_inject_rx_ring(&ctx, bad, sizeof(bad));
+            }
+        }
+        // The start of a frame.
+        char partial[] = {LIBFRAMES_LIM, 'x'};
+        libframes_inject_rx_ring(&ctx, partial, sizeof(partial));
+
+        uint64_t bad_crc8 = ctx.stats.rx_frame_rejected_bad_crc8;
+        char arena[12];
+        libframes_frame_desc_t frames[4];
+        // Only "one" and "two" fit; "three" is left as the current frame.
+        EXPECT(libframes_read_batch(&ctx, arena, sizeof(arena) - 4, frames, 4), 2);
+        EXPECT(ctx.stats.rx_frame_rejected_bad_crc8, bad_crc8 + 1);
+        EXPECT(frames[0].off, 0);
+        EXPECT(frames[0].sz, 3);
+        EXPECT(frames[1].off, 3);
+        EXPECT(frames[1].sz, 3);
+        EXPECT(memcmp(arena, "onetwo", 6), 0);
+        EXPECT(libframes_read_begin(&ctx, &frame_sz), LIBFRAMES_ERROR_NOT_READY);
+        // Only room for one more descriptor.
+        EXPECT(libframes_read_batch(&ctx, arena, sizeof(arena), frames, 1), 1);
+        EXPECT(frames[0].sz, 5);
+        EXPECT(memcmp(arena, "three", 5), 0);
+        EXPECT(libframes_read_batch(&ctx, arena, sizeof(arena), frames, 4), 1);
+        EXPECT(frames[0].sz, 4);
+        EXPECT(memcmp(arena, "four", 4), 0);
+        EXPECT(libframes_read_batch(&ctx, arena, sizeof(arena), frames, 4), 0);
+
+        // Hack: drop the partial frame.
+        rx_ring_consume(&ctx, rx_ring_unread(&ctx));
+        ctx.rx_limit_bytes_found = 0;
+    }
+
+    // Test the one-shot encoder and decoder: they produce and accept the same
+    // bytes as libframes_write and friends.
+    {
+        static libframes_ctx_t capture_ctx;
+        test_init(&capture_ctx, capture, NULL, LIBFRAMES_RX_RING_SZ);
+        char specials[50];
+        memset(specials, LIBFRAMES_LIM, sizeof(specials));
+        char *payloads[] = {"", "hell0", specials};
+        uint32_t payload_szs[] = {0, 5, sizeof(specials)};
+        for (int i = 0; i < 3; i++) {
+            captured_sz = 0;
+            EXPECT(libframes_write_begin(&capture_ctx), 0);
+            EXPECT(libframes_write(&capture_ctx, payloads[i], payload_szs[i]), 0);
+            EXPECT(libframes_write_end(&capture_ctx), 0);
+
+            char encoded[LIBFRAMES_ENCODED_MAX_SZ(sizeof(specials))];
+            uint32_t encoded_sz = libframes_encode(payloads[i], payload_szs[i], encoded, LIBFRAMES_ENCODED_MAX_SZ(payload_szs[i]));
+            EXPECT(encoded_sz, captured_sz);
+            EXPECT(memcmp(encoded, captured, encoded_sz), 0);
+            EXPECT(libframes_encode(payloads[i], payload_szs[i], encoded, encoded_sz - 1), 0);
+
+            char decoded[sizeof(specials)];
+            EXPECT(libframes_decode(encoded, encoded_sz, decoded, payload_szs[i], &frame_sz), 0);
+            EXPECT(frame_sz, payload_szs[i]);
+            EXPECT(memcmp(decoded, payloads[i], frame_sz), 0);
+            if (payload_szs[i] > 0) {
+                EXPECT(libframes_decode(encoded, encoded_sz, decoded, payload_szs[i] - 1, &frame_sz), LIBFRAMES_READ_ERROR_TOO_BIG);
+            }
+            // Damage the payload (well, its first encoded byte).
+            encoded[1] ^= 1;
+            EXPECT_NOT(libframes_decode(encoded, encoded_sz, decoded, sizeof(decoded), &frame_sz), 0);
+            encoded[1] ^= 1;
+            EXPECT(libframes_decode(encoded, encoded_sz - 1, decoded, sizeof(decoded), &frame_sz), LIBFRAMES_READ_ERROR_BAD_ENCODING);
+        }
+
+        char hello[] = {LIBFRAMES_LIM, 'h', 'e', 'l', 'l', 'o', LIBFRAMES_LIM};
+        char decoded[8];
+        EXPECT(libframes_decode(hello, sizeof(hello), decoded, sizeof(decoded), &frame_sz), LIBFRAMES_READ_ERROR_BAD_CRC8);
+        char empty[] = {LIBFRAMES_LIM, LIBFRAMES_LIM};
+        EXPECT(libframes_decode(empty, sizeof(empty), decoded, sizeof(decoded), &frame_sz), LIBFRAMES_READ_ERROR_TOO_SMALL);
+        char dangling_dle[] = {LIBFRAMES_LIM, 'h', LIBFRAMES_DLE, LIBFRAMES_LIM};
+        EXPECT(libframes_decode(dangling_dle, sizeof(dangling_dle), decoded, sizeof(decoded), &frame_sz), LIBFRAMES_READ_ERROR_BAD_ENCODING);
+        char two_frames[] = {LIBFRAMES_LIM, 'h', 'i', LIBFRAMES_LIM, 'h', LIBFRAMES_LIM};
+        EXPECT(libframes_decode(two_frames, sizeof(two_frames), decoded, sizeof(decoded), &frame_sz), LIBFRAMES_READ_ERROR_BAD_ENCODING);
+    }
+
+    // Test writing a frame from pieces: the same bytes and stats as writing
+    // it all at once, through write_platform or in pieces through
+    // writev_platform, with either encoding.
+    {
+        static libframes_ctx_t whole, pieces;
+        char header[] = {'h', LIBFRAMES_DLE, 0};
+        static char payload[600];
+        for (uint32_t i = 0; i < sizeof(payload); i++) {
+            char choices[] = {'a', 'b', LIBFRAMES_DLE, 'c', LIBFRAMES_LIM, 'd', 'e', 0};
+            payload[i] = i < 300 ? 'p' : choices[i % sizeof(choices)];
+        }
+        char trailer[] = {LIBFRAMES_LIM};
+        libframes_iovec_t iov[] = {{header, sizeof(header)}, {NULL, 0}, {payload, sizeof(payload)}, {trailer, sizeof(trailer)}};
+        static char expected[sizeof(captured)];
+        for (int cobs = 0; cobs < 2; cobs++) {
+            for (int writev = 0; writev < 2; writev++) {
+                test_init(&whole, capture, NULL, LIBFRAMES_RX_RING_SZ);
+                test_init(&pieces, capture, NULL, LIBFRAMES_RX_RING_SZ);
+                libframes_set_cobs(&whole, cobs);
+                libframes_set_cobs(&pieces, cobs);
+                libframes_set_writev(&pieces, writev ? capture_v : NULL);
+
+                captured_sz = 0;
+                EXPECT(libframes_write_begin(&whole), 0);
+                EXPECT(libframes_write(&whole, header, sizeof(header)), 0);
+                EXPECT(libframes_write(&whole, payload, sizeof(payload)), 0);
+                EXPECT(libframes_write(&whole, trailer, sizeof(trailer)), 0);
+                EXPECT(libframes_write_end(&whole), 0);
+                uint32_t expected_sz = captured_sz;
+                memcpy(expected, captured, expected_sz);
+
+                captured_sz = 0;
+                captured_calls = 0;
+                EXPECT(libframes_write_frame(&pieces, iov, 4), 0);
+                EXPECT(captured_sz, expected_sz);
+                EXPECT(memcmp(captured, expected, expected_sz), 0);
+                EXPECT(pieces.stats.write_byte_count, whole.stats.write_byte_count);
+                EXPECT(pieces.stats.write_frame_max_sz, whole.stats.write_frame_max_sz);
+                if (writev) {
+                    // Many more pieces than fit in one call.
+                    EXPECT((captured_calls > 2), 1);
+                    EXPECT(pieces.stats.write_flush_count, captured_calls);
+                }
+
+                // Not in the middle of another frame.
+                EXPECT(libframes_write_begin(&pieces), 0);
+                EXPECT(libframes_write_frame(&pieces, iov, 4), LIBFRAMES_ERROR_NOT_READY);
+                EXPECT(libframes_write_end(&pieces), 0);
+            }
+        }
+    }
+
+    // A frame encoded ahead of time goes out as it is, and counts like one
+    // written out by the context.
+    {
+        static libframes_ctx_t c, d;
+        test_init(&c, capture, NULL, LIBFRAMES_RX_RING_SZ);
+        test_init(&d, capture, NULL, LIBFRAMES_RX_RING_SZ);
+        char frame[] = {'a', LIBFRAMES_DLE, 'b', LIBFRAMES_LIM};
+        char encoded[LIBFRAMES_ENCODED_MAX_SZ(sizeof(frame))];
+        uint32_t encoded_sz = libframes_encode(frame, sizeof(frame), encoded, sizeof(encoded));
+        captured_sz = 0;
+        EXPECT(libframes_write_encoded(&c, encoded, encoded_sz), 0);
+        EXPECT(captured_sz, encoded_sz);
+        EXPECT(memcmp(captured, encoded, encoded_sz), 0);
+        EXPECT(libframes_write_begin(&d), 0);
+        EXPECT(libframes_write(&d, frame, sizeof(frame)), 0);
+        EXPECT(libframes_write_end(&d), 0);
+        EXPECT(c.stats.write_frame_count, d.stats.write_frame_count);
+        EXPECT(c.stats.write_byte_count, encoded_sz);
+        EXPECT(c.stats.write_frame_min_sz, d.stats.write_frame_min_sz);
+        EXPECT(c.stats.write_flush_count, 1);
+
+        // Not in the middle of another frame.
+        EXPECT(libframes_write_begin(&c), 0);
+        EXPECT(libframes_write_encoded(&c, encoded, encoded_sz), LIBFRAMES_ERROR_NOT_READY);
+        EXPECT(libframes_write_end(&c), 0);
+    }
+
+    // Test rings of other sizes: too small for the frame size, and a power of
+    // two that many frames of all sizes wrap around.
+    {
+        static libframes_ctx_t c;
+        static char rx_ring[2 * LIBFRAMES_MAX_FRAME_SZ + 2];
+        static char frame_buffer[LIBFRAMES_MAX_FRAME_SZ];
+        EXPECT(libframes_init(&c, loopback, &c, rx_ring, sizeof(rx_ring) - 1, frame_buffer, sizeof(frame_buffer)), LIBFRAMES_ERROR_BAD_SIZE);
+        EXPECT(libframes_init(&c, loopback, &c, rx_ring, sizeof(rx_ring), frame_buffer, sizeof(frame_buffer)), 0);
+        test_init(&c, loopback, &c, 512);
+        EXPECT(c.rx_ring_mask, 511);
+        for (uint32_t i = 0; i < 1000; i++) {
+            char frame[LIBFRAMES_MAX_FRAME_SZ];
+            uint32_t sz = i % (LIBFRAMES_MAX_FRAME_SZ - LIBFRAMES_CRC_SZ + 1);
+            for (uint32_t j = 0; j < sz; j++) {
+                char choices[] = {'a', LIBFRAMES_DLE, 'b', 'c', LIBFRAMES_LIM};
+                frame[j] = choices[(i + j) % sizeof(choices)];
+            }
+            EXPECT(libframes_write_begin(&c), 0);
+            EXPECT(libframes_write(&c, frame, sz), 0);
+            EXPECT(libframes_write_end(&c), 0);
+            EXPECT(libframes_read_begin(&c, &frame_sz), 0);
+            EXPECT(frame_sz, sz);
+            const void *peeked;
+            EXPECT(libframes_read_peek(&c, &peeked, &frame_sz), 0);
+            EXPECT(memcmp(peeked, frame, sz), 0);
+            EXPECT(libframes_read_end(&c), 0);
+        }
+        EXPECT(c.stats.rx_frame_count, 1000);
+    }
+
+    // Test feeding bytes: clean frames are handed over right where they are in
+    // the caller's buffer, the rest from frame_buffer.
+    {
+        static libframes_ctx_t c;
+        test_init(&c, NULL, NULL, LIBFRAMES_RX_RING_SZ);
+        char hello[] = {'h', 'e', 'l', 'l', 'o'};
+        char encoded[LIBFRAMES_ENCODED_MAX_SZ(sizeof(hello))];
+        uint32_t encoded_sz = libframes_encode(hello, sizeof(hello), encoded, sizeof(encoded));
+        fed_sz = 0;
+        EXPECT(libframes_feed(&c, encoded, encoded_sz, on_fed_frame, NULL), 1);
+        EXPECT(fed_sz, sizeof(hello));
+        EXPECT(memcmp(fed, hello, sizeof(hello)), 0);
+        // Unless the checksum needed escaping.
+        EXPECT(fed_last == &encoded[1], (encoded_sz == sizeof(hello) + LIBFRAMES_CRC_SZ + 2));
+
+        // One byte at a time, with escapes.
+        char escapes[] = {'a', LIBFRAMES_DLE, 'b', LIBFRAMES_LIM};
+        char escaped[LIBFRAMES_ENCODED_MAX_SZ(sizeof(escapes))];
+        uint32_t escaped_sz = libframes_encode(escapes, sizeof(escapes), escaped, sizeof(escaped));
+        fed_sz = 0;
+        for (uint32_t i = 0; i < escaped_sz - 1; i++) {
+            EXPECT(libframes_feed(&c, &escaped[i], 1, on_fed_frame, NULL), 0);
+        }
+        EXPECT(libframes_feed(&c, &escaped[escaped_sz - 1], 1, on_fed_frame, NULL), 1);
+        EXPECT(fed_sz, sizeof(escapes));
+        EXPECT(memcmp(fed, escapes, sizeof(escapes)), 0);
+        EXPECT(fed_last == c.frame_buffer, 1);
+
+        // A bad frame is skipped, and its closing LIM opens the next one,
+        // which the next call finishes.
+        char bad[] = {'x', LIBFRAMES_LIM, 'h', 'e', 'l', 'l', '0', LIBFRAMES_LIM, 'h', 'e', 'l', 'l', 'o'};
+        fed_sz = 0;
+        EXPECT(libframes_feed(&c, bad, sizeof(bad), on_fed_frame, NULL), 0);
+        EXPECT(c.stats.rx_false_starts, 1);
+        EXPECT(c.stats.rx_frame_rejected_bad_crc8, 1);
+        EXPECT(libframes_feed(&c, &encoded[1 + sizeof(hello)], encoded_sz - 1 - sizeof(hello), on_fed_frame, NULL), 1);
+        EXPECT(fed_sz, sizeof(hello));
+        EXPECT(memcmp(fed, hello, sizeof(hello)), 0);
+        EXPECT(c.stats.rx_frame_count, 3);
+    }
+
+    // Test that feeding gives the same frames and stats as injecting and
+    // reading, for a stream with frames of all sizes (some too big), garbage,
+    // and damaged frames, in chunks of all sizes, with either encoding.
+    for (int cobs = 0; cobs < 2; cobs++) {
+        static char stream[1 << 18];
+        uint32_t stream_sz = 0;
+        while (stream_sz < sizeof(stream) - 2 * LIBFRAMES_ENCODED_MAX_SZ(LIBFRAMES_MAX_FRAME_SZ)) {
+            char frame[LIBFRAMES_MAX_FRAME_SZ + 8];
+            uint32_t sz = rand() % sizeof(frame);
+            for (uint32_t i = 0; i < sz; i++) {
+                char choices[] = {'a', LIBFRAMES_DLE, 'b', 'c', LIBFRAMES_LIM, 'd', 0};
+                frame[i] = choices[rand() % sizeof(choices)];
+            }
+            uint32_t encoded_sz = cobs ? libframes_cobs_encode(frame, sz, &stream[stream_sz], LIBFRAMES_ENCODED_MAX_SZ(sz))
+                : libframes_encode(frame, sz, &stream[stream_sz], LIBFRAMES_ENCODED_MAX_SZ(sz));
+            switch (rand() % 8) {
+            case 0:
+                stream[stream_sz + rand() % encoded_sz] ^= 1;
+                break;
+            case 1:
+                stream[stream_sz + encoded_sz++] = 'x';
+                break;
+            }
+            stream_sz += encoded_sz;
+        }
+
+        static libframes_ctx_t a, b;
+        test_init(&a, NULL, NULL, LIBFRAMES_RX_RING_SZ);
+        test_init(&b, NULL, NULL, LIBFRAMES_RX_RING_SZ);
+        libframes_set_cobs(&a, cobs);
+        libframes_set_cobs(&b, cobs);
+        static char read[sizeof(stream)];
+        uint32_t read_sz = 0;
+        fed_sz = 0;
+        for (uint32_t off = 0; off < stream_sz;) {
+            uint32_t sz = 1 + rand() % 300;
+            if (sz > stream_sz - off) {
+                sz = stream_sz - off;
+            }
+            libframes_feed(&a, &stream[off], sz, on_fed_frame, NULL);
+            EXPECT(libframes_inject_rx_ring(&b, &stream[off], sz), sz);
+            int ret;
+            while ((ret = libframes_read_begin(&b, &frame_sz)) != LIBFRAMES_READ_ERROR_NO_FRAME) {
+                if (ret == 0) {
+                    EXPECT(libframes_read_exact(&b, &read[read_sz], frame_sz), 0);
+                    read_sz += frame_sz;
+                    EXPECT(libframes_read_end(&b), 0);
+                }
+            }
+            off += sz;
+        }
+        EXPECT(fed_sz, read_sz);
+        EXPECT(memcmp(fed, read, read_sz), 0);
+        EXPECT_NOT(a.stats.rx_frame_count, 0);
+        EXPECT(a.stats.rx_frame_count, b.stats.rx_frame_count);
+        EXPECT(a.stats.rx_false_starts, b.stats.rx_false_starts);
+        EXPECT(a.stats.rx_frame_rejected_encoding_error, b.stats.rx_frame_rejected_encoding_error);
+        EXPECT(a.stats.rx_frame_rejected_too_big, b.stats.rx_frame_rejected_too_big);
+        EXPECT(a.stats.rx_frame_rejected_too_small, b.stats.rx_frame_rejected_too_small);
+        EXPECT(a.stats.rx_frame_rejected_bad_crc8, b.stats.rx_frame_rejected_bad_crc8);
+        EXPECT(a.stats.read_byte_count, b.stats.read_byte_count);
+    }
+
+    // Test that reading a stream out of the ring in runs, as it comes in
+    // chunks of all sizes, gives the same frames and the very same stats as
+    // reading it one byte at a time. The stream has frames of all sizes with
+    // escapes, some too big or damaged, and long stretches of junk, so that
+    // every skip and bulk copy is taken, and it wraps around rings of both
+    // kinds.
+    for (int cobs = 0; cobs < 2; cobs++) {
+        uint32_t ring_szs[] = {LIBFRAMES_RX_RING_SZ, 512};
+        for (int r = 0; r < 2; r++) {
+            static char stream[1 << 18];
+            uint32_t stream_sz = 0;
+            while (stream_sz < sizeof(stream) - 2 * LIBFRAMES_ENCODED_MAX_SZ(LIBFRAMES_MAX_FRAME_SZ) - 600) {
+                if (rand() % 8 == 0) {
+                    for (int i = rand() % 600; i > 0; i--) {
+                        char choices[] = {'x', 'y', LIBFRAMES_DLE, cobs ? 'z' : 0};
+                        stream[stream_sz++] = choices[rand() % sizeof(choices)];
+                    }
+                }
+                char frame[LIBFRAMES_MAX_FRAME_SZ + 8];
+                uint32_t sz = rand() % sizeof(frame);
+                for (uint32_t i = 0; i < sz; i++) {
+                    char choices[] = {'a', LIBFRAMES_DLE, 'b', 'c', LIBFRAMES_LIM, 'd', 0};
+                    frame[i] = choices[rand() % sizeof(choices)];
+                }
+                uint32_t encoded_sz = cobs ? libframes_cobs_encode(frame, sz, &stream[stream_sz], LIBFRAMES_ENCODED_MAX_SZ(sz))
+                    : libframes_encode(frame, sz, &stream[stream_sz], LIBFRAMES_ENCODED_MAX_SZ(sz));
+                if (rand() % 8 == 0) {
+                    stream[stream_sz + rand() % encoded_sz] ^= 1;
+                }
+                stream_sz += encoded_sz;
+            }
+
+            static libframes_ctx_t runs, bytes;
+            static char run_frames[sizeof(stream)], byte_frames[sizeof(stream)];
+            test_init(&runs, NULL, NULL, ring_szs[r]);
+            test_init(&bytes, NULL, NULL, ring_szs[r]);
+            libframes_set_cobs(&runs, cobs);
+            libframes_set_cobs(&bytes, cobs);
+            uint32_t run_frames_sz = 0, byte_frames_sz = 0;
+            for (uint32_t off = 0; off < stream_sz;) {
+                uint32_t sz = 1 + rand() % ring_szs[r];
+                if (sz > stream_sz - off) {
+                    sz = stream_sz - off;
+                }
+                off += libframes_inject_rx_ring(&runs, &stream[off], sz);
+                read_all(&runs, run_frames, &run_frames_sz);
+            }
+            for (uint32_t off = 0; off < stream_sz; off++) {
+                EXPECT(libframes_inject_rx_ring(&bytes, &stream[off], 1), 1);
+                read_all(&bytes, byte_frames, &byte_frames_sz);
+            }
+            EXPECT(run_frames_sz, byte_frames_sz);
+            EXPECT(memcmp(run_frames, byte_frames, run_frames_sz), 0);
+            EXPECT((runs.stats.rx_frame_count > 1000), 1);
+            EXPECT_NOT(runs.stats.rx_frame_rejected_too_big, 0);
+            EXPECT_NOT(runs.stats.rx_false_starts, 0);
+#ifdef LIBFRAMES_HISTOGRAMS
+            // Except for how many bytes each read_begin got through, which
+            // depends on how they came in.
+            memset(runs.stats.read_begin_scanned_hist, 0, sizeof(runs.stats.read_begin_scanned_hist));
+            memset(bytes.stats.read_begin_scanned_hist, 0, sizeof(bytes.stats.read_begin_scanned_hist));
+#endif
+            EXPECT(memcmp(&runs.stats, &bytes.stats, sizeof(runs.stats)), 0);
+        }
+    }
+
+    // Test resync: one call gets past all kinds of bad frames, counting
+    // them, to the good one.
+    {
+        static libframes_ctx_t c;
+        test_init(&c, loopback, &c, LIBFRAMES_RX_RING_SZ);
+        libframes_set_resync(&c, 1);
+        char bad[] = {'x', LIBFRAMES_LIM, LIBFRAMES_LIM, 'h', 'e', 'l', 'l', '0', LIBFRAMES_LIM, 'a', LIBFRAMES_DLE, LIBFRAMES_LIM};
+        EXPECT(libframes_inject_rx_ring(&c, bad, sizeof(bad)), sizeof(bad));
+        char big[LIBFRAMES_MAX_FRAME_SZ + 10];
+        memset(big, 'a', sizeof(big));
+        EXPECT(libframes_inject_rx_ring(&c, big, sizeof(big)), sizeof(big));
+        EXPECT(libframes_read_begin(&c, &frame_sz), LIBFRAMES_READ_ERROR_NO_FRAME);
+
+        EXPECT(libframes_write_begin(&c), 0);
+        EXPECT(libframes_write(&c, "hello", 5), 0);
+        EXPECT(libframes_write_end(&c), 0);
+        EXPECT(libframes_read_begin(&c, &frame_sz), 0);
+        EXPECT(frame_sz, 5);
+        EXPECT(libframes_read_end(&c), 0);
+        EXPECT(libframes_read_begin(&c, &frame_sz), LIBFRAMES_READ_ERROR_NO_FRAME);
+
+        EXPECT(c.stats.rx_false_starts, 1 + sizeof(big) - LIBFRAMES_MAX_FRAME_SZ);
+        EXPECT(c.stats.rx_frame_rejected_too_small, 1);
+        EXPECT(c.stats.rx_frame_rejected_bad_crc8, 1);
+        EXPECT(c.stats.rx_frame_rejected_encoding_error, 1);
+        EXPECT(c.stats.rx_frame_rejected_too_big, 1);
+        EXPECT(c.stats.rx_frame_count, 1);
+    }
+
+    // Test COBS: frames of all sizes, with and without zeros, come through
+    // the ring as written, the one-shot encoder and decoder agree with
+    // libframes_write and friends, and no frame grows by more than 1 byte in
+    // 254 (plus the delimiters).
+    {
+        static libframes_ctx_t c, capture_ctx;
+        static char rx_ring[2 * 1024 + 2];
+        static char frame_buffer[1024];
+        EXPECT(libframes_init(&c, loopback, &c, rx_ring, sizeof(rx_ring), frame_buffer, sizeof(frame_buffer)), 0);
+        libframes_set_cobs(&c, 1);
+        test_init(&capture_ctx, capture, NULL, LIBFRAMES_RX_RING_SZ);
+        libframes_set_cobs(&capture_ctx, 1);
+        for (uint32_t i = 0; i < 2000; i++) {
+            static char frame[900];
+            uint32_t sz = i % 4 == 0 ? rand() % sizeof(frame) : i % 600;
+            for (uint32_t j = 0; j < sz; j++) {
+                // Every other frame has no zeros at all, so only full blocks.
+                frame[j] = i % 2 ? 1 + j % 255 : (rand() % 8 ? 'a' : 0);
+            }
+            EXPECT(libframes_write_begin(&c), 0);
+            EXPECT(libframes_write(&c, frame, sz), 0);
+            EXPECT(libframes_write_end(&c), 0);
+            EXPECT(libframes_read_begin(&c, &frame_sz), 0);
+            EXPECT(frame_sz, sz);
+            const void *peeked;
+            EXPECT(libframes_read_peek(&c, &peeked, &frame_sz), 0);
+            EXPECT(memcmp(peeked, frame, sz), 0);
+            EXPECT(libframes_read_end(&c), 0);
+
+            captured_sz = 0;
+            EXPECT(libframes_write_begin(&capture_ctx), 0);
+            EXPECT(libframes_write(&capture_ctx, frame, sz), 0);
+            EXPECT(libframes_write_end(&capture_ctx), 0);
+            EXPECT((captured_sz <= LIBFRAMES_COBS_ENCODED_MAX_SZ(sz)), 1);
+            EXPECT(memchr(&captured[1], 0, captured_sz - 2) == NULL, 1);
+            static char encoded[LIBFRAMES_COBS_ENCODED_MAX_SZ(sizeof(frame))];
+            uint32_t encoded_sz = libframes_cobs_encode(frame, sz, encoded, sizeof(encoded));
+            EXPECT(encoded_sz, captured_sz);
+            EXPECT(memcmp(encoded, captured, encoded_sz), 0);
+            EXPECT(libframes_cobs_encode(frame, sz, encoded, encoded_sz - 1), 0);
+            static char decoded[sizeof(frame)];
+            EXPECT(libframes_cobs_decode(encoded, encoded_sz, decoded, sz, &frame_sz), 0);
+            EXPECT(frame_sz, sz);
+            EXPECT(memcmp(decoded, frame, sz), 0);
+        }
+        EXPECT(c.stats.rx_frame_count, 2000);
+
+        // A block that runs past the frame's end, a frame with nothing in
+        // it, and one bigger than frame_buffer.
+        char truncated[] = {0, 5, 'a', 0};
+        EXPECT(libframes_inject_rx_ring(&c, truncated, sizeof(truncated)), sizeof(truncated));
+        EXPECT(libframes_read_begin(&c, &frame_sz), LIBFRAMES_READ_ERROR_BAD_ENCODING);
+        char out[8];
+        EXPECT(libframes_cobs_decode(truncated, sizeof(truncated), out, sizeof(out), &frame_sz), LIBFRAMES_READ_ERROR_BAD_ENCODING);
+        EXPECT(libframes_read_begin(&c, &frame_sz), LIBFRAMES_READ_ERROR_NO_FRAME);
+        char empty[] = {0};
+        EXPECT(libframes_inject_rx_ring(&c, empty, sizeof(empty)), sizeof(empty));
+        EXPECT(libframes_read_begin(&c, &frame_sz), LIBFRAMES_READ_ERROR_TOO_SMALL);
+        static char big[1100];
+        memset(big, 'a', sizeof(big));
+        EXPECT(libframes_write_begin(&c), 0);
+        EXPECT(libframes_write(&c, big, sizeof(big)), 0);
+        EXPECT(libframes_write_end(&c), 0);
+        // Walk through remnants of the empty frame.
+        EXPECT(libframes_read_begin(&c, &frame_sz), LIBFRAMES_READ_ERROR_TOO_SMALL);
+        EXPECT(libframes_read_begin(&c, &frame_sz), LIBFRAMES_READ_ERROR_TOO_BIG);
+        EXPECT(c.stats.rx_frame_rejected_encoding_error, 1);
+        EXPECT(c.stats.rx_frame_rejected_too_small, 2);
+        EXPECT(c.stats.rx_frame_rejected_too_big, 1);
+    }
+
+    // Test stats: min sizes are 0 until there is a frame, and a snapshot can
+    // start the stats over.
+    {
+        static libframes_ctx_t c;
+        test_init(&c, loopback, &c, LIBFRAMES_RX_RING_SZ);
+        EXPECT(c.stats.min_rx_frame_sz, 0);
+        EXPECT(c.stats.write_frame_min_sz, 0);
+        char hello[] = {'h', 'e', 'l', 'l', 'o'};
+        EXPECT(libframes_write_begin(&c), 0);
+        EXPECT(libframes_write(&c, hello, sizeof(hello)), 0);
+        EXPECT(libframes_write_end(&c), 0);
+        EXPECT(libframes_read_begin(&c, &frame_sz), 0);
+        EXPECT(libframes_read_end(&c), 0);
+
+        libframes_stats_t stats;
+        libframes_stats_snapshot(&c, &stats, 0);
+        EXPECT(stats.rx_frame_count, 1);
+        EXPECT(stats.min_rx_frame_sz, sizeof(hello));
+        EXPECT(stats.max_rx_frame_sz, sizeof(hello));
+        EXPECT_NOT(stats.write_frame_min_sz, 0);
+        EXPECT(stats.write_frame_min_sz, stats.write_frame_max_sz);
+        EXPECT(c.stats.rx_frame_count, 1);
+#ifdef LIBFRAMES_HISTOGRAMS
+        // 5 bytes of payload, and 8 encoded bytes, with no escapes, of which
+        // libframes_read_begin got through all but the closing LIM.
+        EXPECT(stats.rx_frame_sz_hist[3], 1);
+        EXPECT(stats.write_frame_sz_hist[4], 1);
+        EXPECT(stats.write_escape_pct_hist[0], 1);
+        EXPECT(stats.read_begin_scanned_hist[3], 1);
+#endif
+
+        libframes_stats_snapshot(&c, &stats, 1);
+        EXPECT(stats.rx_frame_count, 1);
+        EXPECT(c.stats.rx_frame_count, 0);
+        EXPECT(c.stats.min_rx_frame_sz, 0);
+        EXPECT(c.stats.max_rx_frame_sz, 0);
+#ifdef LIBFRAMES_HISTOGRAMS
+        EXPECT(c.stats.rx_frame_sz_hist[3], 0);
+#endif
+
+        // Escaping every byte doubles the payload.
+        char escapes[] = {LIBFRAMES_DLE, LIBFRAMES_LIM, LIBFRAMES_DLE, LIBFRAMES_LIM};
+        EXPECT(libframes_write_begin(&c), 0);
+        EXPECT(libframes_write(&c, escapes, sizeof(escapes)), 0);
+        EXPECT(libframes_write_end(&c), 0);
+        EXPECT(c.stats.write_frame_count, 1);
+        EXPECT(c.stats.write_frame_min_sz, c.stats.write_frame_max_sz);
+    }
+
+#ifdef LIBFRAMES_EPOLL
+    epoll_test();
+#endif
+#ifdef LIBFRAMES_POOL
+    pool_test();
+#endif
+#ifdef LIBFRAMES_CAPTURE
+    capture_test();
+#endif
+#ifdef LIBFRAMES_ARQ
+    arq_test();
+#endif
+#ifdef LIBFRAMES_TXQ
+    txq_test();
+#endif
+
     puts("handwritten tests all done!");
 
     // 5s of stress test, where we repeatedly overfill the rx buffer.
     puts("stress test, overfilling rx buffer");
     stress_test(LIBFRAMES_RX_RING_SZ);
-    libframes_stats_t libframes_stats_copy = libframes_stats;
+    libframes_stats_t libframes_stats_copy = ctx.stats;
 
     // Hack: reset.
-    rx_ring_tail = 0;
-    rx_ring_unread = 0;
+    rx_ring_consume(&ctx, rx_ring_unread(&ctx));
+    ctx.rx_limit_bytes_found = 0;
 
     // 5s of testing that there are *no* errors when we don't overfill the rx
     // buffer.
@@ -123,11 +985,18 @@ int main(void) {
 
     // Between this stress test and the last one, we should have handled a lot
     // more frames and bytes. But the error stats should not have increased!
-    EXPECT(libframes_stats.rx_false_starts, libframes_stats_copy.rx_false_starts);
-    EXPECT(libframes_stats.rx_frame_rejected_encoding_error, libframes_stats_copy.rx_frame_rejected_encoding_error);
-    EXPECT(libframes_stats.rx_frame_rejected_too_big, libframes_stats_copy.rx_frame_rejected_too_big);
-    EXPECT(libframes_stats.rx_frame_rejected_too_small, libframes_stats_copy.rx_frame_rejected_too_small);
-    EXPECT(libframes_stats.rx_frame_rejected_bad_crc8, libframes_stats_copy.rx_frame_rejected_bad_crc8);
+    EXPECT(ctx.stats.rx_false_starts, libframes_stats_copy.rx_false_starts);
+    EXPECT(ctx.stats.rx_frame_rejected_encoding_error, libframes_stats_copy.rx_frame_rejected_encoding_error);
+    EXPECT(ctx.stats.rx_frame_rejected_too_big, libframes_stats_copy.rx_frame_rejected_too_big);
+    EXPECT(ctx.stats.rx_frame_rejected_too_small, libframes_stats_copy.rx_frame_rejected_too_small);
+    EXPECT(ctx.stats.rx_frame_rejected_bad_crc8, libframes_stats_copy.rx_frame_rejected_bad_crc8);
+
+#ifdef LIBFRAMES_SPSC
+    // 5s of a producer thread writing frames while a consumer thread reads
+    // them.
+    puts("stress test, producer and consumer threads");
+    spsc_stress_test();
+#endif
     return 0;
 }
 
@@ -136,26 +1005,27 @@ void stress_test(uint32_t fill_amount) {
     srand(start_time);
     while (time(NULL) - start_time < 5) {
         // Fill up a certain amount of the rx buffer.
-        while (rx_ring_unread < fill_amount) {
-            // Send a frame of size between 0 and LIBFRAMES_MAX_FRAME_SZ - 1.
-            // The frame will actually be much larger because of encoding.
-            int frame_sz = rand() % LIBFRAMES_MAX_FRAME_SZ;
+        while (rx_ring_unread(&ctx) < fill_amount) {
+            // Send a frame of size between 0 and the biggest payload that
+            // fits. The frame will actually be much larger because of
+            // encoding.
+            int frame_sz = rand() % (LIBFRAMES_MAX_FRAME_SZ - LIBFRAMES_CRC_SZ + 1);
             char frame[LIBFRAMES_MAX_FRAME_SZ];
             for (int i = 0; i < frame_sz; i++) {
                 // Fill up the frames with a, b, DLE, and LIM.
                 char choices[] = {'a', 'b', LIBFRAMES_DLE, LIBFRAMES_LIM};
                 frame[i] = choices[rand() % sizeof(choices)];
             }
-            EXPECT(libframes_write_begin(), 0);
-            EXPECT(libframes_write(frame, frame_sz), 0);
-            EXPECT(libframes_write_end(), 0);
+            EXPECT(libframes_write_begin(&ctx), 0);
+            EXPECT(libframes_write(&ctx, frame, frame_sz), 0);
+            EXPECT(libframes_write_end(&ctx), 0);
         }
 
         // Read as many frames out as we can.
         int frame_count;
         for (frame_count = 0; ; frame_count++) {
             uint32_t frame_sz;
-            int ret = libframes_read_begin(&frame_sz);
+            int ret = libframes_read_begin(&ctx, &frame_sz);
             if (ret == LIBFRAMES_READ_ERROR_NO_FRAME) {
                 // Nothing left to do.
                 break;
@@ -171,28 +1041,1072 @@ void stress_test(uint32_t fill_amount) {
             }
             if (ret == 0) {
                 // Everything went well and we got a frame.
-                EXPECT(libframes_read_end(), 0);
+                EXPECT(libframes_read_end(&ctx), 0);
             }
         }
     }
     
     // Print stats.
-    printf("    rx_false_starts = %" PRIu32 "\n", libframes_stats.rx_false_starts);
-    printf("    rx_frame_rejected_encoding_error = %" PRIu32 "\n", libframes_stats.rx_frame_rejected_encoding_error);
+    printf("    rx_false_starts = %" PRIu64 "\n", ctx.stats.rx_false_starts);
+    printf("    rx_frame_rejected_encoding_error = %" PRIu64 "\n", ctx.stats.rx_frame_rejected_encoding_error);
     // Will never increase because the frames are all below LIBFRAMES_MAX_FRAME_SZ:
-    printf("    rx_frame_rejected_too_big = %" PRIu32 "\n", libframes_stats.rx_frame_rejected_too_big);
-    printf("    rx_frame_rejected_too_small = %" PRIu32 "\n", libframes_stats.rx_frame_rejected_too_small);
-    printf("    rx_frame_rejected_bad_crc8 = %" PRIu32 "\n", libframes_stats.rx_frame_rejected_bad_crc8);
-    printf("    rx_frame_count = %" PRIu32 "\n", libframes_stats.rx_frame_count);
-    printf("    min_rx_frame_sz = %" PRIu32 "\n", libframes_stats.min_rx_frame_sz);
-    printf("    max_rx_frame_sz = %" PRIu32 "\n", libframes_stats.max_rx_frame_sz);
+    printf("    rx_frame_rejected_too_big = %" PRIu64 "\n", ctx.stats.rx_frame_rejected_too_big);
+    printf("    rx_frame_rejected_too_small = %" PRIu64 "\n", ctx.stats.rx_frame_rejected_too_small);
+    printf("    rx_frame_rejected_bad_crc8 = %" PRIu64 "\n", ctx.stats.rx_frame_rejected_bad_crc8);
+    printf("    rx_frame_count = %" PRIu64 "\n", ctx.stats.rx_frame_count);
+    printf("    min_rx_frame_sz = %" PRIu64 "\n", ctx.stats.min_rx_frame_sz);
+    printf("    max_rx_frame_sz = %" PRIu64 "\n", ctx.stats.max_rx_frame_sz);
     // Will never increase.
-    printf("    read_overreach = %" PRIu32 "\n", libframes_stats.read_overreach);
-    printf("    read_discard_frame_count = %" PRIu32 "\n", libframes_stats.read_discard_frame_count);
-    printf("    read_discard_byte_count = %" PRIu32 "\n", libframes_stats.read_discard_byte_count);
-    printf("    read_byte_count = %" PRIu32 "\n", libframes_stats.read_byte_count);
-    printf("    write_frame_min_sz = %" PRIu32 "\n", libframes_stats.write_frame_min_sz);
-    printf("    write_frame_max_sz = %" PRIu32 "\n", libframes_stats.write_frame_max_sz);
-    printf("    write_frame_count = %" PRIu32 "\n", libframes_stats.write_frame_count);
-    printf("    write_byte_count = %" PRIu32 "\n", libframes_stats.write_byte_count);
+    printf("    read_overreach = %" PRIu64 "\n", ctx.stats.read_overreach);
+    printf("    read_discard_frame_count = %" PRIu64 "\n", ctx.stats.read_discard_frame_count);
+    printf("    read_discard_byte_count = %" PRIu64 "\n", ctx.stats.read_discard_byte_count);
+    printf("    read_byte_count = %" PRIu64 "\n", ctx.stats.read_byte_count);
+    printf("    write_frame_min_sz = %" PRIu64 "\n", ctx.stats.write_frame_min_sz);
+    printf("    write_frame_max_sz = %" PRIu64 "\n", ctx.stats.write_frame_max_sz);
+    printf("    write_frame_count = %" PRIu64 "\n", ctx.stats.write_frame_count);
+    printf("    write_byte_count = %" PRIu64 "\n", ctx.stats.write_byte_count);
+    printf("    write_flush_count = %" PRIu64 "\n", ctx.stats.write_flush_count);
+}
+
+#if defined(LIBFRAMES_SPSC) || defined(LIBFRAMES_EPOLL) || defined(LIBFRAMES_POOL) || defined(LIBFRAMES_CAPTURE)
+// Make up the contents of frame number seq, so that the consumer can check
+// them. Returns the frame size.
+static uint32_t seq_frame(uint32_t seq, char *frame) {
+    uint32_t x = seq * 2654435761u + 1;
+    uint32_t frame_sz = sizeof(seq) + x % (LIBFRAMES_MAX_FRAME_SZ - LIBFRAMES_CRC_SZ - sizeof(seq) + 1);
+    memcpy(frame, &seq, sizeof(seq));
+    for (uint32_t i = sizeof(seq); i < frame_sz; i++) {
+        char choices[] = {'a', 'b', LIBFRAMES_DLE, LIBFRAMES_LIM};
+        x = x * 1103515245 + 12345;
+        frame[i] = choices[(x >> 16) % sizeof(choices)];
+    }
+    return frame_sz;
+}
+#endif
+
+#ifdef LIBFRAMES_SPSC
+// The producer thread's write_platform: a loopback that waits for room in
+// the rx ring instead of dropping bytes.
+static void blocking_loopback(void *user, void *p, uint32_t sz) {
+    while (sz > 0) {
+        uint32_t n = libframes_inject_rx_ring(user, p, sz);
+        if (n == 0) {
+            sched_yield();
+        }
+        p = (char *)p + n;
+        sz -= n;
+    }
+}
+
+
+static atomic_int spsc_done;
+static uint32_t spsc_frame_count;
+
+static void *spsc_producer(void *p) {
+    libframes_ctx_t *spsc_ctx = p;
+    time_t start_time = time(NULL);
+    uint32_t seq;
+    for (seq = 0; time(NULL) - start_time < 5; seq++) {
+        char frame[LIBFRAMES_MAX_FRAME_SZ];
+        uint32_t frame_sz = seq_frame(seq, frame);
+        EXPECT(libframes_write_begin(spsc_ctx), 0);
+        EXPECT(libframes_write(spsc_ctx, frame, frame_sz), 0);
+        EXPECT(libframes_write_end(spsc_ctx), 0);
+    }
+    spsc_frame_count = seq;
+    atomic_store(&spsc_done, 1);
+    return NULL;
+}
+
+void spsc_stress_test(void) {
+    static libframes_ctx_t spsc_ctx;
+    // A power of two sized ring.
+    test_init(&spsc_ctx, blocking_loopback, &spsc_ctx, 1024);
+
+    pthread_t producer;
+    EXPECT(pthread_create(&producer, NULL, spsc_producer, &spsc_ctx), 0);
+
+    uint32_t seq = 0;
+    for (;;) {
+        // Once the producer is done, everything it wrote is in the ring.
+        int done = atomic_load(&spsc_done);
+        uint32_t frame_sz;
+        int ret = libframes_read_begin(&spsc_ctx, &frame_sz);
+        if (ret == LIBFRAMES_READ_ERROR_NO_FRAME) {
+            if (done) {
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+        // Nothing is ever dropped, so every frame has to arrive, intact and
+        // in order.
+        EXPECT(ret, 0);
+        char expected[LIBFRAMES_MAX_FRAME_SZ];
+        EXPECT(frame_sz, seq_frame(seq, expected));
+        const void *frame;
+        EXPECT(libframes_read_peek(&spsc_ctx, &frame, &frame_sz), 0);
+        EXPECT(memcmp(frame, expected, frame_sz), 0);
+        EXPECT(libframes_read_end(&spsc_ctx), 0);
+        seq++;
+    }
+    EXPECT(pthread_join(producer, NULL), 0);
+
+    EXPECT(seq, spsc_frame_count);
+    EXPECT(spsc_ctx.stats.rx_false_starts, 0);
+    EXPECT(spsc_ctx.stats.rx_frame_rejected_encoding_error, 0);
+    EXPECT(spsc_ctx.stats.rx_frame_rejected_too_big, 0);
+    EXPECT(spsc_ctx.stats.rx_frame_rejected_too_small, 0);
+    EXPECT(spsc_ctx.stats.rx_frame_rejected_bad_crc8, 0);
+    printf("    rx_frame_count = %" PRIu64 "\n", spsc_ctx.stats.rx_frame_count);
+}
+#endif
+
+#ifdef LIBFRAMES_EPOLL
+#define EPOLL_TEST_PAIRS 100
+#define EPOLL_TEST_FRAMES 200
+
+// A link of the epoll test, which sends numbered frames to its peer and
+// checks that the peer's come in order.
+typedef struct {
+    libframes_epoll_link_t link;
+    uint32_t sent;
+    uint32_t received;
+    int closed;
+    char rx_ring[LIBFRAMES_RX_RING_SZ];
+    char frame_buffer[LIBFRAMES_MAX_FRAME_SZ];
+    char tx_queue[1024];
+} epoll_test_link_t;
+
+static void epoll_test_on_frame(void *user, const void *frame, uint32_t sz) {
+    epoll_test_link_t *l = user;
+    if (frame == NULL) {
+        l->closed = 1;
+        return;
+    }
+    char expected[LIBFRAMES_MAX_FRAME_SZ];
+    EXPECT(sz, seq_frame(l->received, expected));
+    EXPECT(memcmp(frame, expected, sz), 0);
+    l->received++;
+}
+
+static void epoll_test_add(libframes_epoll_t *ep, epoll_test_link_t *l, int fd) {
+    memset(l, 0, sizeof(*l));
+    EXPECT(libframes_epoll_add(ep, &l->link, fd, epoll_test_on_frame, l,
+        l->rx_ring, sizeof(l->rx_ring), l->frame_buffer, sizeof(l->frame_buffer),
+        l->tx_queue, sizeof(l->tx_queue)), 0);
+}
+
+// Two links, each of which takes the other out of the loop as soon as it gets
+// a frame.
+static libframes_epoll_t epoll_test_remove_ep;
+static epoll_test_link_t epoll_test_removers[2];
+
+static void epoll_test_remove_other(void *user, const void *frame, uint32_t sz) {
+    epoll_test_link_t *l = user;
+    epoll_test_on_frame(user, frame, sz);
+    epoll_test_link_t *other = &epoll_test_removers[l == &epoll_test_removers[0]];
+    EXPECT(libframes_epoll_remove(&epoll_test_remove_ep, &other->link), 0);
+}
+
+static uint32_t epoll_test_self_removed;
+
+// Take the link out of the loop, and scribble over it, as if it was freed.
+static void epoll_test_remove_self(void *user, const void *frame, uint32_t sz) {
+    epoll_test_link_t *l = user;
+    epoll_test_self_removed++;
+    EXPECT(libframes_epoll_remove(&epoll_test_remove_ep, &l->link), 0);
+    memset(l, 0xa5, sizeof(*l));
+}
+
+// Pairs of links over socketpairs with small buffers, all in one loop, so
+// that sends back up into the tx queues and wait for the fds.
+void epoll_test(void) {
+    static epoll_test_link_t links[2 * EPOLL_TEST_PAIRS];
+    static int fds[2 * EPOLL_TEST_PAIRS];
+    libframes_epoll_t ep;
+    signal(SIGPIPE, SIG_IGN);
+    EXPECT(libframes_epoll_init(&ep), 0);
+    for (int i = 0; i < EPOLL_TEST_PAIRS; i++) {
+        EXPECT(socketpair(AF_UNIX, SOCK_STREAM, 0, &fds[2 * i]), 0);
+        for (int j = 2 * i; j < 2 * i + 2; j++) {
+            int sz = 1024;
+            EXPECT(setsockopt(fds[j], SOL_SOCKET, SO_SNDBUF, &sz, sizeof(sz)), 0);
+            epoll_test_add(&ep, &links[j], fds[j]);
+        }
+    }
+
+    // How often a tx queue was full.
+    uint32_t backed_up = 0;
+    int done = 0;
+    while (!done) {
+        for (int i = 0; i < 2 * EPOLL_TEST_PAIRS; i++) {
+            epoll_test_link_t *l = &links[i];
+            char frame[LIBFRAMES_MAX_FRAME_SZ];
+            while (l->sent < EPOLL_TEST_FRAMES) {
+                int ret = libframes_epoll_send(&ep, &l->link, frame, seq_frame(l->sent, frame));
+                if (ret == LIBFRAMES_ERROR_NOT_READY) {
+                    backed_up++;
+                    break;
+                }
+                EXPECT(ret, 0);
+                l->sent++;
+            }
+        }
+        EXPECT_NOT(libframes_epoll_run(&ep, 1000), -1);
+        done = 1;
+        for (int i = 0; i < 2 * EPOLL_TEST_PAIRS; i++) {
+            if (links[i].received < EPOLL_TEST_FRAMES) {
+                done = 0;
+            }
+        }
+    }
+    EXPECT_NOT(backed_up, 0);
+    for (int i = 0; i < 2 * EPOLL_TEST_PAIRS; i++) {
+        EXPECT(links[i].received, EPOLL_TEST_FRAMES);
+        EXPECT(links[i].closed, 0);
+        EXPECT(links[i].link.ctx.stats.rx_false_starts, 0);
+    }
+
+    // Garbage before a frame is skipped.
+    char garbage[] = {'x', 'y', LIBFRAMES_DLE};
+    EXPECT(write(fds[1], garbage, sizeof(garbage)), sizeof(garbage));
+    char frame[LIBFRAMES_MAX_FRAME_SZ];
+    char encoded[LIBFRAMES_ENCODED_MAX_SZ(LIBFRAMES_MAX_FRAME_SZ)];
+    uint32_t encoded_sz = libframes_encode(frame, seq_frame(EPOLL_TEST_FRAMES, frame), encoded, sizeof(encoded));
+    EXPECT(write(fds[1], encoded, encoded_sz), encoded_sz);
+    while (links[0].received == EPOLL_TEST_FRAMES) {
+        EXPECT_NOT(libframes_epoll_run(&ep, 1000), -1);
+    }
+    EXPECT(links[0].link.ctx.stats.rx_false_starts, sizeof(garbage));
+
+    // Closing one end closes the link at the other.
+    EXPECT(libframes_epoll_remove(&ep, &links[1].link), 0);
+    close(fds[1]);
+    while (!links[0].closed) {
+        EXPECT_NOT(libframes_epoll_run(&ep, 1000), -1);
+    }
+
+    for (int i = 2; i < 2 * EPOLL_TEST_PAIRS; i++) {
+        close(fds[i]);
+    }
+    close(fds[0]);
+    libframes_epoll_close(&ep);
+
+    // A link taken out of the loop by another's on_frame is left alone, even
+    // though it was ready in the same batch.
+    EXPECT(libframes_epoll_init(&epoll_test_remove_ep), 0);
+    int remove_fds[4];
+    for (int i = 0; i < 2; i++) {
+        EXPECT(socketpair(AF_UNIX, SOCK_STREAM, 0, &remove_fds[2 * i]), 0);
+        epoll_test_add(&epoll_test_remove_ep, &epoll_test_removers[i], remove_fds[2 * i]);
+        epoll_test_removers[i].link.on_frame = epoll_test_remove_other;
+        encoded_sz = libframes_encode(frame, seq_frame(0, frame), encoded, sizeof(encoded));
+        EXPECT(write(remove_fds[2 * i + 1], encoded, encoded_sz), encoded_sz);
+    }
+    EXPECT(libframes_epoll_run(&epoll_test_remove_ep, 1000), 1);
+    EXPECT(epoll_test_removers[0].received + epoll_test_removers[1].received, 1);
+    EXPECT(epoll_test_removers[0].closed + epoll_test_removers[1].closed, 0);
+    // The one that was taken out didn't even read its frame.
+    epoll_test_link_t *removed = &epoll_test_removers[epoll_test_removers[0].received == 1];
+    EXPECT(removed->link.ctx.stats.rx_frame_count, 0);
+    EXPECT(libframes_epoll_run(&epoll_test_remove_ep, 0), 0);
+
+    // A link that takes itself out from its on_frame isn't touched again,
+    // with more frames behind the one it was given.
+    epoll_test_link_t *survivor = &epoll_test_removers[epoll_test_removers[0].received == 0];
+    survivor->link.on_frame = epoll_test_remove_self;
+    for (uint32_t i = 0; i < 2; i++) {
+        encoded_sz = libframes_encode(frame, seq_frame(1 + i, frame), encoded, sizeof(encoded));
+        EXPECT(write(remove_fds[2 * (survivor - epoll_test_removers) + 1], encoded, encoded_sz), encoded_sz);
+    }
+    EXPECT(libframes_epoll_run(&epoll_test_remove_ep, 1000), 1);
+    EXPECT(epoll_test_self_removed, 1);
+    for (size_t i = 0; i < sizeof(*survivor); i++) {
+        EXPECT(((unsigned char *)survivor)[i], 0xa5);
+    }
+    for (int i = 0; i < 4; i++) {
+        close(remove_fds[i]);
+    }
+    libframes_epoll_close(&epoll_test_remove_ep);
+}
+#endif
+
+#ifdef LIBFRAMES_POOL
+#define POOL_TEST_LINKS 64
+#define POOL_TEST_WORKERS 4
+#define POOL_TEST_FRAMES 2000
+// Frames each link keeps in flight.
+#define POOL_TEST_WINDOW 2
+
+// A link of the pool test, which loops numbered frames back to itself.
+typedef struct {
+    libframes_ctx_t ctx;
+    libframes_pool_link_t link;
+    libframes_pool_t *pool;
+    uint32_t sent;
+    uint32_t received;
+    // Set while a worker is in on_frame, to catch two at once.
+    atomic_int busy;
+    char rx_ring[LIBFRAMES_RX_RING_SZ];
+    char frame_buffer[LIBFRAMES_MAX_FRAME_SZ];
+} pool_test_link_t;
+
+static atomic_int pool_test_done;
+
+static void pool_test_loopback(void *user, void *p, uint32_t sz) {
+    pool_test_link_t *l = user;
+    EXPECT(libframes_inject_rx_ring(&l->ctx, p, sz), sz);
+    if (l->pool) {
+        libframes_pool_notify(l->pool, &l->link);
+    }
+}
+
+static void pool_test_send(pool_test_link_t *l) {
+    char frame[LIBFRAMES_MAX_FRAME_SZ];
+    uint32_t frame_sz = seq_frame(l->sent++, frame);
+    EXPECT(libframes_write_begin(&l->ctx), 0);
+    EXPECT(libframes_write(&l->ctx, frame, frame_sz), 0);
+    EXPECT(libframes_write_end(&l->ctx), 0);
+}
+
+static void pool_test_on_frame(void *user, const void *frame, uint32_t sz) {
+    pool_test_link_t *l = user;
+    EXPECT(atomic_exchange(&l->busy, 1), 0);
+    char expected[LIBFRAMES_MAX_FRAME_SZ];
+    EXPECT(sz, seq_frame(l->received, expected));
+    EXPECT(memcmp(frame, expected, sz), 0);
+    if (++l->received == POOL_TEST_FRAMES) {
+        atomic_fetch_add(&pool_test_done, 1);
+    }
+    if (l->sent < POOL_TEST_FRAMES) {
+        pool_test_send(l);
+    }
+    atomic_store(&l->busy, 0);
+}
+
+#define POOL_BURST_TEST_LINKS 16
+#define POOL_BURST_TEST_PRODUCERS 4
+#define POOL_BURST_TEST_FRAMES 5000
+// The most frames of a link's in its rx ring: they have to fit.
+#define POOL_BURST_TEST_WINDOW 4
+
+// A link of the burst test, fed by a producer thread that isn't a worker.
+typedef struct {
+    libframes_ctx_t ctx;
+    libframes_pool_link_t link;
+    uint32_t sent;
+    atomic_uint received;
+    char rx_ring[LIBFRAMES_RX_RING_SZ];
+    char frame_buffer[LIBFRAMES_MAX_FRAME_SZ];
+} pool_burst_link_t;
+
+static libframes_pool_t pool_burst_pool;
+static pool_burst_link_t pool_burst_links[POOL_BURST_TEST_LINKS];
+
+static void pool_burst_inject(void *user, void *p, uint32_t sz) {
+    EXPECT(libframes_inject_rx_ring(user, p, sz), sz);
+}
+
+static void pool_burst_on_frame(void *user, const void *frame, uint32_t sz) {
+    pool_burst_link_t *l = user;
+    char expected[LIBFRAMES_MAX_FRAME_SZ];
+    EXPECT(sz, seq_frame(atomic_load(&l->received), expected));
+    EXPECT(memcmp(frame, expected, sz), 0);
+    atomic_fetch_add(&l->received, 1);
+}
+
+// Send frames to the producer's share of the links in bursts, as they fit,
+// notifying once per burst. Gives up after 10 seconds.
+static void *pool_burst_producer(void *arg) {
+    int first = (pool_burst_link_t *)arg - pool_burst_links;
+    time_t start_time = time(NULL);
+    int done = 0;
+    while (!done && time(NULL) - start_time < 10) {
+        // Let the workers catch up, on a machine with fewer cores than
+        // threads.
+        sched_yield();
+        done = 1;
+        for (int i = first; i < first + POOL_BURST_TEST_LINKS / POOL_BURST_TEST_PRODUCERS; i++) {
+            pool_burst_link_t *l = &pool_burst_links[i];
+            uint32_t burst = 0;
+            while (l->sent < POOL_BURST_TEST_FRAMES && l->sent - atomic_load(&l->received) < POOL_BURST_TEST_WINDOW) {
+                char frame[LIBFRAMES_MAX_FRAME_SZ];
+                uint32_t frame_sz = seq_frame(l->sent++, frame);
+                EXPECT(libframes_write_begin(&l->ctx), 0);
+                EXPECT(libframes_write(&l->ctx, frame, frame_sz), 0);
+                EXPECT(libframes_write_end(&l->ctx), 0);
+                burst++;
+            }
+            if (burst > 0) {
+                libframes_pool_notify(&pool_burst_pool, &l->link);
+            }
+            if (l->sent < POOL_BURST_TEST_FRAMES) {
+                done = 0;
+            }
+        }
+    }
+    return NULL;
+}
+
+// Producers that stop after a last burst, so a notify that a worker going
+// idle misses isn't covered for by a later one: every frame has to arrive
+// anyway.
+static void pool_burst_test(void) {
+    static libframes_pool_worker_t workers[POOL_TEST_WORKERS];
+    static libframes_pool_link_t *queues[POOL_TEST_WORKERS * POOL_BURST_TEST_LINKS];
+    EXPECT(libframes_pool_init(&pool_burst_pool, workers, POOL_TEST_WORKERS, queues, POOL_BURST_TEST_LINKS), 0);
+    for (int i = 0; i < POOL_BURST_TEST_LINKS; i++) {
+        pool_burst_link_t *l = &pool_burst_links[i];
+        EXPECT(libframes_init(&l->ctx, pool_burst_inject, &l->ctx, l->rx_ring, sizeof(l->rx_ring), l->frame_buffer, sizeof(l->frame_buffer)), 0);
+        EXPECT(libframes_pool_add(&pool_burst_pool, &l->link, &l->ctx, pool_burst_on_frame, l), 0);
+        l->sent = 0;
+        atomic_init(&l->received, 0);
+    }
+    pthread_t producers[POOL_BURST_TEST_PRODUCERS];
+    for (int i = 0; i < POOL_BURST_TEST_PRODUCERS; i++) {
+        EXPECT(pthread_create(&producers[i], NULL, pool_burst_producer,
+                &pool_burst_links[i * (POOL_BURST_TEST_LINKS / POOL_BURST_TEST_PRODUCERS)]), 0);
+    }
+    for (int i = 0; i < POOL_BURST_TEST_PRODUCERS; i++) {
+        EXPECT(pthread_join(producers[i], NULL), 0);
+    }
+
+    // Nobody notifies any more: what's left is up to the workers. Give them
+    // a second.
+    time_t start_time = time(NULL);
+    for (int i = 0; i < POOL_BURST_TEST_LINKS; i++) {
+        while (atomic_load(&pool_burst_links[i].received) < POOL_BURST_TEST_FRAMES && time(NULL) - start_time < 2) {
+            sched_yield();
+        }
+    }
+    libframes_pool_stop(&pool_burst_pool);
+    libframes_pool_destroy(&pool_burst_pool);
+    for (int i = 0; i < POOL_BURST_TEST_LINKS; i++) {
+        EXPECT(pool_burst_links[i].sent, POOL_BURST_TEST_FRAMES);
+        EXPECT(atomic_load(&pool_burst_links[i].received), POOL_BURST_TEST_FRAMES);
+    }
+}
+
+// Links that keep sending themselves frames, all of them notified to the
+// first worker, so that the others only get work by stealing it.
+void pool_test(void) {
+    static pool_test_link_t links[POOL_TEST_LINKS];
+    static libframes_pool_worker_t workers[POOL_TEST_WORKERS];
+    static libframes_pool_link_t *queues[POOL_TEST_WORKERS * POOL_TEST_LINKS];
+    static libframes_pool_t pool;
+    EXPECT(libframes_pool_init(&pool, workers, POOL_TEST_WORKERS, queues, POOL_TEST_LINKS), 0);
+    for (int i = 0; i < POOL_TEST_LINKS; i++) {
+        pool_test_link_t *l = &links[i];
+        EXPECT(libframes_init(&l->ctx, pool_test_loopback, l, l->rx_ring, sizeof(l->rx_ring), l->frame_buffer, sizeof(l->frame_buffer)), 0);
+        EXPECT(libframes_pool_add(&pool, &l->link, &l->ctx, pool_test_on_frame, l), 0);
+        // Hack: everything goes to the first worker.
+        l->link.home = 0;
+        // Get frames going before any worker can see the link.
+        for (int j = 0; j < POOL_TEST_WINDOW; j++) {
+            pool_test_send(l);
+        }
+    }
+    libframes_pool_link_t extra;
+    EXPECT(libframes_pool_add(&pool, &extra, NULL, NULL, NULL), LIBFRAMES_ERROR_BAD_SIZE);
+    for (int i = 0; i < POOL_TEST_LINKS; i++) {
+        links[i].pool = &pool;
+        libframes_pool_notify(&pool, &links[i].link);
+    }
+
+    // Meanwhile, take the first link's stats a piece at a time, from a thread
+    // that isn't a worker.
+    uint64_t snapshot_frame_count = 0;
+    while (atomic_load(&pool_test_done) < POOL_TEST_LINKS) {
+        libframes_stats_t stats;
+        libframes_pool_stats_snapshot(&pool, &links[0].link, &stats, 1);
+        snapshot_frame_count += stats.rx_frame_count;
+        sched_yield();
+    }
+    libframes_pool_stop(&pool);
+    libframes_pool_destroy(&pool);
+    EXPECT(snapshot_frame_count + links[0].ctx.stats.rx_frame_count, POOL_TEST_FRAMES);
+
+    uint64_t frame_count = 0;
+    uint64_t steal_count = 0;
+    for (int i = 0; i < POOL_TEST_WORKERS; i++) {
+        frame_count += workers[i].frame_count;
+        steal_count += workers[i].steal_count;
+    }
+    EXPECT(frame_count, POOL_TEST_LINKS * POOL_TEST_FRAMES);
+    EXPECT_NOT(steal_count, 0);
+    for (int i = 0; i < POOL_TEST_LINKS; i++) {
+        EXPECT(links[i].received, POOL_TEST_FRAMES);
+        EXPECT(links[i].ctx.stats.rx_false_starts, 0);
+    }
+
+    pool_burst_test();
+}
+#endif
+
+#ifdef LIBFRAMES_CAPTURE
+#define CAPTURE_TEST_FRAMES 10000
+
+// Which frames on_frame has been called with; each is only ever looked at by
+// one thread.
+static char capture_test_seen[CAPTURE_TEST_FRAMES];
+
+static void capture_test_on_frame(void *user, uint64_t n, uint64_t ts_ns, const void *frame, uint32_t sz) {
+    char expected[LIBFRAMES_MAX_FRAME_SZ];
+    EXPECT(sz, seq_frame(n, expected));
+    EXPECT(memcmp(frame, expected, sz), 0);
+    EXPECT(ts_ns == n * 1000, 1);
+    capture_test_seen[n]++;
+}
+
+// Write a capture of CAPTURE_TEST_FRAMES frames, every 100th damaged.
+static void capture_test_write(const char *path, int cobs) {
+    libframes_capture_writer_t w;
+    EXPECT(libframes_capture_create(&w, path, cobs ? LIBFRAMES_CAPTURE_COBS : 0), 0);
+    for (uint32_t n = 0; n < CAPTURE_TEST_FRAMES; n++) {
+        char frame[LIBFRAMES_MAX_FRAME_SZ];
+        uint32_t frame_sz = seq_frame(n, frame);
+        char encoded[LIBFRAMES_ENCODED_MAX_SZ(LIBFRAMES_MAX_FRAME_SZ)];
+        uint32_t encoded_sz = cobs ? libframes_cobs_encode(frame, frame_sz, encoded, sizeof(encoded))
+            : libframes_encode(frame, frame_sz, encoded, sizeof(encoded));
+        if (n % 100 == 0) {
+            encoded[encoded_sz / 2] ^= 1;
+        }
+        EXPECT(libframes_capture_append(&w, n * 1000, encoded, encoded_sz), 0);
+    }
+    EXPECT(libframes_capture_finish(&w), 0);
+}
+
+void capture_test(void) {
+    char path[] = "/tmp/libframes_capture_XXXXXX";
+    int fd = mkstemp(path);
+    EXPECT_NOT(fd, -1);
+    close(fd);
+    char index_path[sizeof(path) + 4];
+    strcpy(index_path, path);
+    strcat(index_path, ".idx");
+    uint32_t good_frames = CAPTURE_TEST_FRAMES - CAPTURE_TEST_FRAMES / 100;
+
+    for (int cobs = 0; cobs < 2; cobs++) {
+        capture_test_write(path, cobs);
+        libframes_capture_t cap;
+        EXPECT(libframes_capture_open(&cap, path), 0);
+        // The writer's index was good.
+        EXPECT(cap.offs_built == NULL, 1);
+        EXPECT(cap.frame_count, CAPTURE_TEST_FRAMES);
+
+        // Random access, to good frames and bad.
+        for (int i = 0; i < 1000; i++) {
+            uint32_t n = rand() % CAPTURE_TEST_FRAMES;
+            char out[LIBFRAMES_MAX_FRAME_SZ];
+            uint64_t ts_ns;
+            const void *p;
+            uint32_t sz;
+            int ret = libframes_capture_decode(&cap, n, out, sizeof(out), &ts_ns, &p, &sz);
+            if (n % 100 == 0) {
+                EXPECT_NOT(ret, 0);
+                continue;
+            }
+            EXPECT(ret, 0);
+            capture_test_on_frame(NULL, n, ts_ns, p, sz);
+            // Frames that need no unescaping aren't copied.
+            const void *encoded;
+            uint32_t encoded_sz;
+            EXPECT(libframes_capture_get(&cap, n, &ts_ns, &encoded, &encoded_sz), 0);
+            EXPECT(p == (const char *)encoded + 1, (!cobs && encoded_sz == sz + LIBFRAMES_CRC_SZ + 2));
+        }
+        uint64_t ts_ns;
+        const void *p;
+        uint32_t sz;
+        EXPECT(libframes_capture_get(&cap, CAPTURE_TEST_FRAMES, &ts_ns, &p, &sz), LIBFRAMES_ERROR_BAD_SIZE);
+
+        // All of it, on several threads.
+        memset(capture_test_seen, 0, sizeof(capture_test_seen));
+        EXPECT(libframes_capture_replay_parallel(&cap, 4, LIBFRAMES_MAX_FRAME_SZ, capture_test_on_frame, NULL), good_frames);
+        for (uint32_t n = 0; n < CAPTURE_TEST_FRAMES; n++) {
+            int good = n % 100 != 0;
+            EXPECT(capture_test_seen[n], good);
+        }
+        libframes_capture_close(&cap);
+    }
+
+    // Without its index, a capture is indexed again, and the index is saved.
+    EXPECT(unlink(index_path), 0);
+    libframes_capture_t cap;
+    EXPECT(libframes_capture_open(&cap, path), 0);
+    EXPECT(cap.offs_built != NULL, 1);
+    EXPECT(cap.frame_count, CAPTURE_TEST_FRAMES);
+    libframes_capture_close(&cap);
+    EXPECT(libframes_capture_open(&cap, path), 0);
+    EXPECT(cap.offs_built == NULL, 1);
+    libframes_capture_close(&cap);
+
+    // An index that points outside the capture is caught.
+    int index_fd = open(index_path, O_WRONLY);
+    EXPECT_NOT(index_fd, -1);
+    uint8_t bad_off[8] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x7f};
+    EXPECT(pwrite(index_fd, bad_off, sizeof(bad_off), 24), sizeof(bad_off));
+    close(index_fd);
+    EXPECT(libframes_capture_open(&cap, path), 0);
+    EXPECT(cap.offs_built == NULL, 1);
+    uint64_t ts_ns;
+    const void *p;
+    uint32_t sz;
+    EXPECT(libframes_capture_get(&cap, 0, &ts_ns, &p, &sz), LIBFRAMES_CAPTURE_ERROR_BAD_FORMAT);
+    char out[LIBFRAMES_MAX_FRAME_SZ];
+    EXPECT(libframes_capture_decode(&cap, 0, out, sizeof(out), &ts_ns, &p, &sz), LIBFRAMES_CAPTURE_ERROR_BAD_FORMAT);
+    EXPECT(libframes_capture_get(&cap, 1, &ts_ns, &p, &sz), 0);
+    libframes_capture_close(&cap);
+
+    // A capture cut short loses its last frame, and the index no longer
+    // covers it.
+    struct stat st;
+    EXPECT(stat(path, &st), 0);
+    EXPECT(truncate(path, st.st_size - 3), 0);
+    EXPECT(libframes_capture_open(&cap, path), 0);
+    EXPECT(cap.offs_built != NULL, 1);
+    EXPECT(cap.frame_count, CAPTURE_TEST_FRAMES - 1);
+    EXPECT(libframes_capture_replay(&cap, 0, cap.frame_count, NULL, 0, capture_test_on_frame, NULL), 0);
+    libframes_capture_close(&cap);
+
+    // Files that aren't captures are told apart from failing system calls.
+    EXPECT(libframes_capture_open(&cap, index_path), LIBFRAMES_CAPTURE_ERROR_BAD_FORMAT);
+    EXPECT(truncate(path, 5), 0);
+    EXPECT(libframes_capture_open(&cap, path), LIBFRAMES_CAPTURE_ERROR_BAD_FORMAT);
+    EXPECT(unlink(path), 0);
+    errno = 0;
+    EXPECT(libframes_capture_open(&cap, path), -1);
+    EXPECT(errno, ENOENT);
+
+    unlink(index_path);
+}
+#endif
+
+#ifdef LIBFRAMES_ARQ
+#define ARQ_TEST_MESSAGES 500
+#define ARQ_TEST_PAYLOAD_SZ 100
+#define ARQ_TEST_MAX_WINDOW 32
+// The link: 115200 baud (8 bits a byte, plus start and stop bits), 50ms
+// each way.
+#define ARQ_TEST_NS_PER_BYTE 86806
+#define ARQ_TEST_DELAY_NS 50000000ull
+#define ARQ_TEST_RTO_NS 1000000000ull
+// Long enough for about two frames to arrive, so ACKs are batched, or ride
+// along on data.
+#define ARQ_TEST_ACK_DELAY_NS 30000000ull
+#define ARQ_TEST_TICK_NS 1000000ull
+#define ARQ_TEST_IN_FLIGHT 256
+
+// Simulated time.
+static uint64_t arq_test_now;
+
+static uint64_t arq_test_clock(void *user) {
+    return arq_test_now;
+}
+
+// One way of a lossy radio link, as a write_platform: what's written is cut
+// into frames, each frame is lost with a chance of loss_pct percent, and the
+// rest arrive in the other end's rx ring once they've been sent at the
+// link's speed and have travelled for ARQ_TEST_DELAY_NS.
+typedef struct {
+    libframes_ctx_t *to;
+    uint32_t loss_pct;
+    char frame[LIBFRAMES_ENCODED_MAX_SZ(LIBFRAMES_MAX_FRAME_SZ)];
+    uint32_t frame_sz;
+    int lims;
+    // When the link is done sending what it has been given.
+    uint64_t busy_until_ns;
+    // Frames on their way, a ring.
+    struct {
+        uint64_t arrive_ns;
+        uint32_t sz;
+        char bytes[LIBFRAMES_ENCODED_MAX_SZ(LIBFRAMES_MAX_FRAME_SZ)];
+    } in_flight[ARQ_TEST_IN_FLIGHT];
+    uint32_t in_flight_head;
+    uint32_t in_flight_len;
+} arq_test_link_t;
+
+static void arq_test_write(void *user, void *p, uint32_t sz) {
+    arq_test_link_t *l = user;
+    for (uint32_t i = 0; i < sz; i++) {
+        char c = ((char *)p)[i];
+        l->frame[l->frame_sz++] = c;
+        if (c != LIBFRAMES_LIM || ++l->lims < 2) {
+            continue;
+        }
+        uint64_t start_ns = l->busy_until_ns > arq_test_now ? l->busy_until_ns : arq_test_now;
+        l->busy_until_ns = start_ns + l->frame_sz * ARQ_TEST_NS_PER_BYTE;
+        if ((uint32_t)rand() % 100 >= l->loss_pct) {
+            EXPECT((l->in_flight_len < ARQ_TEST_IN_FLIGHT), 1);
+            uint32_t tail = (l->in_flight_head + l->in_flight_len++) % ARQ_TEST_IN_FLIGHT;
+            l->in_flight[tail].arrive_ns = l->busy_until_ns + ARQ_TEST_DELAY_NS;
+            l->in_flight[tail].sz = l->frame_sz;
+            memcpy(l->in_flight[tail].bytes, l->frame, l->frame_sz);
+        }
+        l->frame_sz = 0;
+        l->lims = 0;
+    }
+}
+
+static void arq_test_deliver(arq_test_link_t *l) {
+    while (l->in_flight_len > 0 && l->in_flight[l->in_flight_head].arrive_ns <= arq_test_now) {
+        uint32_t sz = l->in_flight[l->in_flight_head].sz;
+        EXPECT(libframes_inject_rx_ring(l->to, l->in_flight[l->in_flight_head].bytes, sz), sz);
+        l->in_flight_head = (l->in_flight_head + 1) % ARQ_TEST_IN_FLIGHT;
+        l->in_flight_len--;
+    }
+}
+
+// Message n, for the receiving end to check.
+static void arq_test_message(uint32_t n, char *message) {
+    uint32_t x = n * 2654435761u + 1;
+    memcpy(message, &n, sizeof(n));
+    for (uint32_t i = sizeof(n); i < ARQ_TEST_PAYLOAD_SZ; i++) {
+        char choices[] = {'a', 'b', LIBFRAMES_DLE, LIBFRAMES_LIM};
+        x = x * 1103515245 + 12345;
+        message[i] = choices[(x >> 16) % sizeof(choices)];
+    }
+}
+
+// Each end counts the messages it gets, in the uint32_t its user points to.
+static void arq_test_on_message(void *user, const void *message, uint32_t sz) {
+    uint32_t *received = user;
+    char expected[ARQ_TEST_PAYLOAD_SZ];
+    arq_test_message((*received)++, expected);
+    EXPECT(sz, ARQ_TEST_PAYLOAD_SZ);
+    EXPECT(memcmp(message, expected, sz), 0);
+}
+
+// Send as many of the messages as the window takes.
+static void arq_test_fill(libframes_arq_t *arq, uint32_t *sent) {
+    for (; *sent < ARQ_TEST_MESSAGES; (*sent)++) {
+        char message[ARQ_TEST_PAYLOAD_SZ];
+        arq_test_message(*sent, message);
+        int ret = libframes_arq_send(arq, message, sizeof(message));
+        if (ret == LIBFRAMES_ERROR_NOT_READY) {
+            break;
+        }
+        EXPECT(ret, 0);
+    }
+}
+
+// Send ARQ_TEST_MESSAGES messages from one end to the other, and as many back
+// if both_ways is set, over a link losing loss_pct percent of frames each
+// way. Both ends count sequence numbers from first_seq. Returns how long it
+// took, in simulated time; each end's stats go in stats.
+static uint64_t arq_test_run(uint32_t window, uint32_t loss_pct, int both_ways, uint32_t first_seq,
+        libframes_arq_stats_t stats[2]) {
+    static libframes_ctx_t a, b;
+    static arq_test_link_t ab, ba;
+    static libframes_arq_slot_t a_slots[2 * ARQ_TEST_MAX_WINDOW], b_slots[2 * ARQ_TEST_MAX_WINDOW];
+    static char a_payloads[2 * ARQ_TEST_MAX_WINDOW * ARQ_TEST_PAYLOAD_SZ], b_payloads[2 * ARQ_TEST_MAX_WINDOW * ARQ_TEST_PAYLOAD_SZ];
+    memset(&ab, 0, sizeof(ab));
+    memset(&ba, 0, sizeof(ba));
+    ab.to = &b;
+    ab.loss_pct = loss_pct;
+    ba.to = &a;
+    ba.loss_pct = loss_pct;
+    test_init(&a, arq_test_write, &ab, LIBFRAMES_RX_RING_SZ);
+    test_init(&b, arq_test_write, &ba, LIBFRAMES_RX_RING_SZ);
+    libframes_arq_t arq_a, arq_b;
+    uint32_t a_sent = 0, b_sent = both_ways ? 0 : ARQ_TEST_MESSAGES;
+    uint32_t a_received = 0, b_received = 0;
+    EXPECT(libframes_arq_init(&arq_a, &a, window, ARQ_TEST_PAYLOAD_SZ, a_slots, a_payloads, arq_test_clock, NULL,
+            arq_test_on_message, &a_received), 0);
+    EXPECT(libframes_arq_init(&arq_b, &b, window, ARQ_TEST_PAYLOAD_SZ, b_slots, b_payloads, arq_test_clock, NULL,
+            arq_test_on_message, &b_received), 0);
+    libframes_arq_set_timers(&arq_a, ARQ_TEST_RTO_NS, ARQ_TEST_ACK_DELAY_NS);
+    libframes_arq_set_timers(&arq_b, ARQ_TEST_RTO_NS, ARQ_TEST_ACK_DELAY_NS);
+    arq_a.tx_base = arq_a.tx_next = arq_a.rx_next = first_seq;
+    arq_b.tx_base = arq_b.tx_next = arq_b.rx_next = first_seq;
+
+    arq_test_now = 0;
+    while (b_received < ARQ_TEST_MESSAGES || (both_ways && a_received < ARQ_TEST_MESSAGES)) {
+        arq_test_fill(&arq_a, &a_sent);
+        arq_test_fill(&arq_b, &b_sent);
+        // The window fills up before anything could have been acknowledged.
+        if (arq_test_now == 0) {
+            EXPECT(a_sent, window);
+        }
+        libframes_arq_poll(&arq_a);
+        libframes_arq_poll(&arq_b);
+        arq_test_now += ARQ_TEST_TICK_NS;
+        arq_test_deliver(&ab);
+        libframes_arq_receive(&arq_b);
+        arq_test_deliver(&ba);
+        libframes_arq_receive(&arq_a);
+        // Give up after an hour.
+        EXPECT((arq_test_now < 3600000000000ull), 1);
+    }
+    EXPECT(arq_b.stats.rx_delivered, ARQ_TEST_MESSAGES);
+    EXPECT(arq_a.stats.rx_delivered, (both_ways ? ARQ_TEST_MESSAGES : 0));
+    EXPECT(arq_a.stats.data_sent + arq_b.stats.data_sent, ((both_ways ? 2 : 1) * ARQ_TEST_MESSAGES));
+    EXPECT(arq_a.stats.rx_out_of_window + arq_b.stats.rx_out_of_window, 0);
+    EXPECT(arq_a.stats.rx_bad + arq_b.stats.rx_bad, 0);
+    stats[0] = arq_a.stats;
+    stats[1] = arq_b.stats;
+    return arq_test_now;
+}
+
+void arq_test(void) {
+    libframes_ctx_t c;
+    test_init(&c, capture, NULL, LIBFRAMES_RX_RING_SZ);
+    libframes_arq_t arq;
+    libframes_arq_slot_t slots[2];
+    char payloads[2 * ARQ_TEST_PAYLOAD_SZ];
+    EXPECT(libframes_arq_init(&arq, &c, 0, ARQ_TEST_PAYLOAD_SZ, slots, payloads, arq_test_clock, NULL,
+            arq_test_on_message, NULL), LIBFRAMES_ERROR_BAD_SIZE);
+    // Slots are picked by masking the sequence number, which only carries on
+    // the same way across a wrap for a power of two.
+    EXPECT(libframes_arq_init(&arq, &c, 3, ARQ_TEST_PAYLOAD_SZ, slots, payloads, arq_test_clock, NULL,
+            arq_test_on_message, NULL), LIBFRAMES_ERROR_BAD_SIZE);
+    EXPECT(libframes_arq_init(&arq, &c, 1, LIBFRAMES_MAX_FRAME_SZ, slots, payloads, arq_test_clock, NULL,
+            arq_test_on_message, NULL), LIBFRAMES_ERROR_BAD_SIZE);
+    EXPECT(libframes_arq_init(&arq, &c, 1, ARQ_TEST_PAYLOAD_SZ, slots, payloads, arq_test_clock, NULL,
+            arq_test_on_message, NULL), 0);
+    EXPECT(libframes_arq_send(&arq, payloads, ARQ_TEST_PAYLOAD_SZ + 1), LIBFRAMES_ERROR_BAD_SIZE);
+    // Frames too small for a header are counted, and otherwise ignored.
+    libframes_arq_on_frame(&arq, payloads, LIBFRAMES_ARQ_HEADER_SZ - 1);
+    EXPECT(arq.stats.rx_bad, 1);
+    // Nothing to do, and no ACK owed.
+    EXPECT((libframes_arq_poll(&arq) == UINT64_MAX), 1);
+    EXPECT(c.stats.write_frame_count, 0);
+
+    srand(1);
+    puts("ARQ goodput over a lossy 115200 baud link, 50ms each way");
+    uint32_t loss_pcts[] = {0, 1, 5, 10, 20, 30};
+    for (size_t i = 0; i < sizeof(loss_pcts) / sizeof(loss_pcts[0]); i++) {
+        // Stop-and-wait, a window, and a window each way, where the ACKs
+        // mostly ride along on data frames. Goodput is for one way.
+        double goodput[3];
+        uint64_t acks_sent[3];
+        uint32_t windows[] = {1, ARQ_TEST_MAX_WINDOW, ARQ_TEST_MAX_WINDOW};
+        for (int j = 0; j < 3; j++) {
+            libframes_arq_stats_t stats[2];
+            uint64_t ns = arq_test_run(windows[j], loss_pcts[i], j == 2, 0, stats);
+            goodput[j] = (double)ARQ_TEST_MESSAGES * ARQ_TEST_PAYLOAD_SZ * 1e9 / ns;
+            acks_sent[j] = stats[0].acks_sent + stats[1].acks_sent;
+            printf("    loss %" PRIu32 "%%, window %" PRIu32 "%s: %.0f bytes/s, %" PRIu64 " retransmits, %" PRIu64 " acks\n",
+                    loss_pcts[i], windows[j], j == 2 ? " both ways" : "", goodput[j],
+                    stats[0].retransmits + stats[1].retransmits, acks_sent[j]);
+            if (loss_pcts[i] == 0) {
+                EXPECT(stats[0].retransmits + stats[1].retransmits, 0);
+                EXPECT(stats[0].rx_duplicates + stats[1].rx_duplicates, 0);
+            }
+        }
+        // Keeping the link busy beats stop-and-wait.
+        EXPECT((goodput[1] > 2 * goodput[0]), 1);
+        // Going both ways, twice the messages take fewer than twice the
+        // ACKs.
+        EXPECT((acks_sent[2] < 2 * acks_sent[1]), 1);
+    }
+
+    // The 32 bit sequence numbers wrap around halfway through, each way,
+    // with frames held and sent again on either side of the wrap.
+    libframes_arq_stats_t stats[2];
+    arq_test_run(ARQ_TEST_MAX_WINDOW, 10, 1, UINT32_MAX - ARQ_TEST_MESSAGES / 2, stats);
+    EXPECT((stats[0].retransmits > 0 && stats[1].retransmits > 0), 1);
+}
+#endif
+
+#ifdef LIBFRAMES_TXQ
+#define TXQ_TEST_QUEUES 3
+#define TXQ_TEST_TICK_NS 1000000ull
+
+// Simulated time.
+static uint64_t txq_test_now;
+
+static uint64_t txq_test_clock(void *user) {
+    return txq_test_now;
+}
+
+// A loopback that makes sure nothing is lost.
+static void txq_test_loopback(void *user, void *p, uint32_t sz) {
+    EXPECT(libframes_inject_rx_ring(user, p, sz), sz);
+}
+
+// Frame n of queue q: the queue, the number and filler, seq_frame style.
+static uint32_t txq_test_frame(int q, uint32_t n, char *frame) {
+    uint32_t x = (n + q * 1000003u) * 2654435761u + 1;
+    uint32_t frame_sz = 1 + sizeof(n) + x % (LIBFRAMES_MAX_FRAME_SZ - LIBFRAMES_CRC_SZ - sizeof(n));
+    frame[0] = q;
+    memcpy(&frame[1], &n, sizeof(n));
+    for (uint32_t i = 1 + sizeof(n); i < frame_sz; i++) {
+        char choices[] = {'a', 0, LIBFRAMES_DLE, LIBFRAMES_LIM};
+        x = x * 1103515245 + 12345;
+        frame[i] = choices[(x >> 16) % sizeof(choices)];
+    }
+    return frame_sz;
+}
+
+// A link shared by bulk frames, 16 always queued, and a small control frame
+// every 50ms, at 16 bytes per ms. Control frames go in queue 0 and bulk in
+// queue queues_n - 1: with one queue, they take their turn. Returns the most
+// a control frame waited, in ns.
+static uint64_t txq_test_link(int queues_n) {
+    static libframes_ctx_t c;
+    static libframes_txq_queue_t queues[2];
+    static char bufs[2][8192];
+    test_init(&c, capture, NULL, LIBFRAMES_RX_RING_SZ);
+    for (int q = 0; q < queues_n; q++) {
+        libframes_txq_queue_init(&queues[q], bufs[q], sizeof(bufs[q]));
+    }
+    libframes_txq_t txq;
+    libframes_txq_init(&txq, &c, queues, queues_n, txq_test_clock, NULL);
+
+    char bulk[LIBFRAMES_MAX_FRAME_SZ - LIBFRAMES_CRC_SZ];
+    memset(bulk, LIBFRAMES_LIM, sizeof(bulk));
+    char control[8] = "control";
+    uint64_t credit = 0;
+    uint64_t drained = 0;
+    uint32_t ticks = 10000;
+    txq_test_now = 0;
+    for (uint32_t tick = 0; tick < ticks; tick++) {
+        while (queues[queues_n - 1].stats.depth < 16) {
+            EXPECT(libframes_txq_push(&txq, queues_n - 1, bulk, sizeof(bulk)), 0);
+        }
+        if (tick % 50 == 0) {
+            EXPECT(libframes_txq_push(&txq, 0, control, sizeof(control)), 0);
+        }
+        credit += 16;
+        uint32_t sz = libframes_txq_drain(&txq, credit);
+        credit -= sz;
+        drained += sz;
+        captured_sz = 0;
+        txq_test_now += TXQ_TEST_TICK_NS;
+    }
+    // The link is never idle.
+    EXPECT((drained + sizeof(captured) > 16ull * ticks), 1);
+
+    uint64_t control_max_ns = 0;
+    for (int q = 0; q < queues_n; q++) {
+        libframes_txq_stats_t stats;
+        libframes_txq_stats_snapshot(&txq, q, &stats, 1);
+        if (q == 0) {
+            control_max_ns = stats.latency_max_ns;
+        }
+        printf("    %d queue%s, queue %d: %" PRIu64 " frames, depth %" PRIu64 " (at most %" PRIu64 "), "
+                "latency %" PRIu64 "us (at most %" PRIu64 "us)\n",
+                queues_n, queues_n > 1 ? "s" : "", q, stats.frame_count, stats.depth, stats.max_depth,
+                stats.latency_total_ns / stats.frame_count / 1000, stats.latency_max_ns / 1000);
+        EXPECT(queues[q].stats.frame_count, 0);
+        EXPECT(queues[q].stats.depth, stats.depth);
+        EXPECT(queues[q].stats.max_depth, stats.depth);
+    }
+    return control_max_ns;
+}
+
+void txq_test(void) {
+    static libframes_ctx_t c, d;
+    static libframes_txq_queue_t queues[TXQ_TEST_QUEUES];
+    static char bufs[TXQ_TEST_QUEUES][1024];
+    libframes_txq_t txq;
+
+    // Higher priority frames go first, and frames don't go out while the
+    // context is writing one, or when they don't fit.
+    test_init(&c, capture, NULL, LIBFRAMES_RX_RING_SZ);
+    for (int q = 0; q < 2; q++) {
+        libframes_txq_queue_init(&queues[q], bufs[q], sizeof(bufs[q]));
+    }
+    libframes_txq_init(&txq, &c, queues, 2, txq_test_clock, NULL);
+    txq_test_now = 0;
+    char frames[3][LIBFRAMES_MAX_FRAME_SZ];
+    uint32_t frame_szs[3];
+    for (int i = 0; i < 3; i++) {
+        frame_szs[i] = txq_test_frame(i < 2, i, frames[i]);
+    }
+    EXPECT(libframes_txq_push(&txq, 1, frames[0], frame_szs[0]), 0);
+    EXPECT(libframes_txq_push(&txq, 1, frames[1], frame_szs[1]), 0);
+    txq_test_now += TXQ_TEST_TICK_NS;
+    char encoded[LIBFRAMES_ENCODED_MAX_SZ(LIBFRAMES_MAX_FRAME_SZ)];
+    uint32_t encoded_sz = libframes_encode(frames[2], frame_szs[2], encoded, sizeof(encoded));
+    EXPECT(libframes_txq_push_encoded(&txq, 0, encoded, encoded_sz), 0);
+    EXPECT(queues[1].stats.depth, 2);
+    EXPECT(libframes_write_begin(&c), 0);
+    EXPECT(libframes_txq_drain(&txq, UINT32_MAX), 0);
+    EXPECT(libframes_write_end(&c), 0);
+    captured_sz = 0;
+    EXPECT(libframes_txq_drain(&txq, encoded_sz - 1), 0);
+    txq_test_now += TXQ_TEST_TICK_NS;
+    EXPECT(libframes_txq_drain(&txq, encoded_sz), encoded_sz);
+    EXPECT(memcmp(captured, encoded, encoded_sz), 0);
+    uint32_t drained = libframes_txq_drain(&txq, UINT32_MAX);
+    EXPECT(drained, captured_sz - encoded_sz);
+    uint32_t off = encoded_sz;
+    for (int i = 0; i < 2; i++) {
+        encoded_sz = libframes_encode(frames[i], frame_szs[i], encoded, sizeof(encoded));
+        EXPECT(memcmp(&captured[off], encoded, encoded_sz), 0);
+        off += encoded_sz;
+    }
+    // And the empty frame written while they waited.
+    EXPECT(c.stats.write_frame_count, 4);
+    EXPECT(queues[0].stats.latency_max_ns, TXQ_TEST_TICK_NS);
+    EXPECT(queues[1].stats.latency_total_ns, 4 * TXQ_TEST_TICK_NS);
+    EXPECT(queues[1].stats.max_depth, 2);
+    EXPECT(queues[1].stats.depth, 0);
+    EXPECT(queues[1].stats.depth_bytes, 0);
+
+    EXPECT(libframes_txq_push(&txq, 2, frames[0], frame_szs[0]), LIBFRAMES_ERROR_BAD_SIZE);
+    EXPECT(libframes_txq_push(&txq, -1, frames[0], frame_szs[0]), LIBFRAMES_ERROR_BAD_SIZE);
+    EXPECT(libframes_txq_push(&txq, 0, frames[0], LIBFRAMES_MAX_FRAME_SZ), LIBFRAMES_ERROR_BAD_SIZE);
+    while (libframes_txq_push(&txq, 0, frames[0], frame_szs[0]) == 0) {
+    }
+    EXPECT(queues[0].stats.full_count, 1);
+
+    // Frames from many queues, in both encodings, wrapping around their
+    // queues: each queue's come out in order, and none are lost.
+    for (int cobs = 0; cobs < 2; cobs++) {
+        test_init(&c, txq_test_loopback, &d, LIBFRAMES_RX_RING_SZ);
+        test_init(&d, loopback, &d, LIBFRAMES_RX_RING_SZ);
+        libframes_set_cobs(&c, cobs);
+        libframes_set_cobs(&d, cobs);
+        for (int q = 0; q < TXQ_TEST_QUEUES; q++) {
+            libframes_txq_queue_init(&queues[q], bufs[q], sizeof(bufs[q]));
+        }
+        libframes_txq_init(&txq, &c, queues, TXQ_TEST_QUEUES, txq_test_clock, NULL);
+        uint32_t pushed[TXQ_TEST_QUEUES] = {0};
+        uint32_t received[TXQ_TEST_QUEUES] = {0};
+        uint32_t wrapped[TXQ_TEST_QUEUES] = {0};
+        for (int round = 0; round < 20000; round++) {
+            for (int i = rand() % 5; i > 0; i--) {
+                int q = rand() % TXQ_TEST_QUEUES;
+                char frame[LIBFRAMES_MAX_FRAME_SZ];
+                uint32_t frame_sz = txq_test_frame(q, pushed[q], frame);
+                if (libframes_txq_push(&txq, q, frame, frame_sz) == 0) {
+                    pushed[q]++;
+                }
+            }
+            for (int q = 0; q < TXQ_TEST_QUEUES; q++) {
+                wrapped[q] += queues[q].wrapped;
+            }
+            libframes_txq_drain(&txq, rand() % (LIBFRAMES_RX_RING_SZ / 2));
+            uint32_t frame_sz;
+            while (libframes_read_begin(&d, &frame_sz) == 0) {
+                const void *p;
+                libframes_read_peek(&d, &p, &frame_sz);
+                char expected[LIBFRAMES_MAX_FRAME_SZ];
+                int q = ((const char *)p)[0];
+                EXPECT((q >= 0 && q < TXQ_TEST_QUEUES), 1);
+                EXPECT(frame_sz, txq_test_frame(q, received[q]++, expected));
+                EXPECT(memcmp(p, expected, frame_sz), 0);
+                libframes_read_end(&d);
+            }
+        }
+        for (int q = 0; q < TXQ_TEST_QUEUES; q++) {
+            EXPECT(received[q] + queues[q].stats.depth, pushed[q]);
+            EXPECT(queues[q].stats.frame_count, received[q]);
+            EXPECT((wrapped[q] > 0), 1);
+        }
+        EXPECT(d.stats.rx_frame_count, c.stats.write_frame_count);
+    }
+
+    // A control frame only waits for the bulk frame going out ahead of it,
+    // not for all of the ones queued.
+    puts("priority queues, a link at 16 bytes/ms shared by bulk and control frames");
+    uint64_t fifo_ns = txq_test_link(1);
+    uint64_t priority_ns = txq_test_link(2);
+    uint64_t bound_ns = (LIBFRAMES_ENCODED_MAX_SZ(LIBFRAMES_MAX_FRAME_SZ) + LIBFRAMES_ENCODED_MAX_SZ(8)) / 16 * TXQ_TEST_TICK_NS;
+    EXPECT((priority_ns <= bound_ns), 1);
+    EXPECT((fifo_ns > 5 * bound_ns), 1);
 }
+#endif